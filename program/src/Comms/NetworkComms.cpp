@@ -54,21 +54,90 @@ QString NetworkComms::username() const
     return m_manager->userName() + "@" + QHostInfo::localHostName();
 }
 
+/**
+ * @brief NetworkComms::hasPngImagePeers
+ * @return
+ *
+ * Returns @c true if at least one of the connected peers can only read PNG images (older
+ * clients, which also only read the legacy diagonal layout)
+ */
+bool NetworkComms::hasPngImagePeers() const
+{
+    foreach(P2P_Connection* connection, m_peers.values()) {
+        if(!connection->supportsWireImages())
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief NetworkComms::hasWireImagePeers
+ * @return
+ *
+ * Returns @c true if at least one of the connected peers can read wire images
+ */
+bool NetworkComms::hasWireImagePeers() const
+{
+    foreach(P2P_Connection* connection, m_peers.values()) {
+        if(connection->supportsWireImages())
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief NetworkComms::hasLegacyCryptoPeers
+ * @return
+ *
+ * Returns @c true if at least one of the connected peers can only decrypt messages that use
+ * the legacy (Caesar + XOR) cipher
+ */
+bool NetworkComms::hasLegacyCryptoPeers() const
+{
+    foreach(P2P_Connection* connection, m_peers.values()) {
+        if(!connection->supportsSealedMessages())
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief NetworkComms::hasBareMessagePeers
+ * @return
+ *
+ * Returns @c true if at least one of the connected peers can only read messages without a
+ * message envelope
+ */
+bool NetworkComms::hasBareMessagePeers() const
+{
+    foreach(P2P_Connection* connection, m_peers.values()) {
+        if(!connection->supportsMessageEnvelopes())
+            return true;
+    }
+
+    return false;
+}
+
 /**
  * @brief NetworkComms::sendBinaryData
  * @param data
+ * @param wireImageData
  *
- * Sends the given @a data to all connected peers
+ * Sends the given @a data to all connected peers. If @a wireImageData is not empty, it is
+ * sent instead of @a data to the peers that support the wire image container.
  */
-void NetworkComms::sendBinaryData(const QByteArray& data)
+void NetworkComms::sendBinaryData(const QByteArray& data, const QByteArray& wireImageData)
 {
-    // Data is empty, abort
-    if(data.isEmpty())
-        return;
-
     // Send data to each connected peer
-    foreach(P2P_Connection* connection, m_peers.values())
-        connection->sendBinaryData(data);
+    foreach(P2P_Connection* connection, m_peers.values()) {
+        if(!wireImageData.isEmpty() && connection->supportsWireImages())
+            connection->sendBinaryData(wireImageData);
+        else if(!data.isEmpty())
+            connection->sendBinaryData(data);
+    }
 }
 
 /**
@@ -43,7 +43,11 @@ public:
     NetworkComms();
 
     QString username() const;
-    void sendBinaryData(const QByteArray& data);
+    bool hasPngImagePeers() const;
+    bool hasWireImagePeers() const;
+    bool hasLegacyCryptoPeers() const;
+    bool hasBareMessagePeers() const;
+    void sendBinaryData(const QByteArray& data, const QByteArray& wireImageData = QByteArray());
     bool hasConnection(const QHostAddress& senderIp, int senderPort = -1) const;
 
 private slots:
@@ -28,6 +28,13 @@
 static const int PONG_TIMEOUT = 60 * 1000;
 static const int PING_INTERVAL = 5 * 1000;
 
+/*
+ * Features supported by this client, announced to the peer in each ping & pong packet
+ */
+static const quint8 LOCAL_CAPABILITIES = P2P_Connection::WireImages |
+                                         P2P_Connection::SealedMessages |
+                                         P2P_Connection::MessageEnvelopes;
+
 /**
  * @brief P2P_Connection::P2P_Connection
  * @param parent
@@ -39,6 +46,7 @@ P2P_Connection::P2P_Connection(QObject* parent) : QTcpSocket(parent)
 {
     // Initialize internal variables
     m_username = "Unknown";
+    m_peerCapabilities = 0;
     m_greetingMessageSent = false;
     m_greetingMessage = "Undefined";
 
@@ -84,6 +92,43 @@ QString P2P_Connection::name()
     return m_username;
 }
 
+/**
+ * @brief P2P_Connection::supportsWireImages
+ * @return
+ *
+ * Returns @c true if the peer announced that it can read images in the wire image container
+ * (instead of PNG images). Older clients do not send their capabilities, so only PNG images
+ * that use the legacy diagonal layout are sent to them.
+ */
+bool P2P_Connection::supportsWireImages() const
+{
+    return m_peerCapabilities & WireImages;
+}
+
+/**
+ * @brief P2P_Connection::supportsSealedMessages
+ * @return
+ *
+ * Returns @c true if the peer announced that it can open messages sealed with the
+ * ChaCha20-Poly1305 stream format. Older clients only know the legacy cipher.
+ */
+bool P2P_Connection::supportsSealedMessages() const
+{
+    return m_peerCapabilities & SealedMessages;
+}
+
+/**
+ * @brief P2P_Connection::supportsMessageEnvelopes
+ * @return
+ *
+ * Returns @c true if the peer announced that it can read messages that start with a message
+ * envelope. Older clients expect the bare (JSON) message.
+ */
+bool P2P_Connection::supportsMessageEnvelopes() const
+{
+    return m_peerCapabilities & MessageEnvelopes;
+}
+
 /**
  * @brief P2P_Connection::setGreetingMessage
  * @param message
@@ -124,39 +169,40 @@ bool P2P_Connection::sendBinaryData(const QByteArray& data)
 /**
  * @brief P2P_Connection::processReadyRead
  *
- * Process and react to incoming data from peer
+ * Process and react to incoming data from peer.
+ *
+ * A single read may contain several packets (e.g. a ping sent right after a message), so all
+ * complete packets in the buffer are processed before returning.
  */
 void P2P_Connection::processReadyRead()
 {
     // Add data to buffer
     m_buffer.append(readAll());
 
-    // Get range from which
-    int initIndex = m_buffer.indexOf(headerStartCode());
-    int stopIndex = m_buffer.indexOf(headerEndCode());
+    // Process every complete packet in the buffer
+    while (isValid()) {
+        // Get range from which
+        int initIndex = m_buffer.indexOf(headerStartCode());
+        if (initIndex < 0)
+            return;
 
-    // Packet incomplete
-    if (initIndex < 0 || stopIndex < 0)
-        return;
-
-    // Increment stop index to last byte of
-    stopIndex += headerEndCode().length();
+        int stopIndex = m_buffer.indexOf(headerEndCode(), initIndex);
 
-    // Construct byte array with packet from buffer
-    QByteArray packet;
-    for (int i = initIndex; i < stopIndex; ++i)
-        packet.append(m_buffer.at(i));
+        // Packet incomplete
+        if (stopIndex < 0)
+            return;
 
-    // Remove packet from buffer
-    m_buffer.remove(0, stopIndex);
+        // Construct byte array with packet from buffer (without the header codes)
+        const int dataIndex = initIndex + headerStartCode().length();
+        QByteArray packet = m_buffer.mid(dataIndex, stopIndex - dataIndex);
 
-    // Chop header codes from packet
-    packet.remove(0, headerStartCode().length());
-    packet.chop(headerEndCode().length());
+        // Remove packet from buffer
+        m_buffer.remove(0, stopIndex + headerEndCode().length());
 
-    // Analize packet
-    if (!packet.isEmpty())
-        readPacket(packet);
+        // Analize packet
+        if (!packet.isEmpty())
+            readPacket(packet);
+    }
 }
 
 /**
@@ -172,10 +218,12 @@ void P2P_Connection::sendPing()
         return;
     }
 
-    // Send header code & data
+    // Send header code & data (with the features supported by this client)
     QByteArray packet;
     packet.append(headerStartCode());
     packet.append(Ping);
+    packet.append(static_cast<char>(LOCAL_CAPABILITIES));
+    packet.append(Ping);
     packet.append(headerEndCode());
 
     // Send ping
@@ -189,10 +237,12 @@ void P2P_Connection::sendPing()
  */
 void P2P_Connection::sendPong()
 {
-    // Send header code & data
+    // Send header code & data (with the features supported by this client)
     QByteArray packet;
     packet.append(headerStartCode());
     packet.append(Pong);
+    packet.append(static_cast<char>(LOCAL_CAPABILITIES));
+    packet.append(Pong);
     packet.append(headerEndCode());
 
     // Send pong respongse
@@ -256,9 +306,11 @@ void P2P_Connection::readPacket(QByteArray& packet)
         emit newMessage(m_username, packet);
         break;
     case Ping:
+        processCapabilities(packet);
         sendPong();
         break;
     case Pong:
+        processCapabilities(packet);
         m_pongTimer.restart();
         break;
     default:
@@ -294,6 +346,22 @@ void P2P_Connection::processGreeting(QByteArray& data)
     emit readyForUse();
 }
 
+/**
+ * @brief P2P_Connection::processCapabilities
+ * @param data
+ *
+ * Registers the features supported by the peer, which are sent between the type codes of
+ * ping & pong packets. Older clients send empty ping & pong packets (and only compare the
+ * type codes of the packets they receive), so they are never sent a packet they do not
+ * understand and are treated as clients without capabilities (so is every peer until its
+ * first ping or pong packet is received).
+ */
+void P2P_Connection::processCapabilities(const QByteArray& data)
+{
+    if(!data.isEmpty())
+        m_peerCapabilities = static_cast<quint8>(data.at(0));
+}
+
 /**
  * @brief P2P_Connection::headerEndCode
  * @return
@@ -47,11 +47,20 @@ public:
         Undefined
     };
 
+    enum Capability {
+        WireImages = 0x01,
+        SealedMessages = 0x02,
+        MessageEnvelopes = 0x04
+    };
+
     P2P_Connection(QObject* parent = Q_NULLPTR);
     P2P_Connection(qintptr socketDescriptor, QObject* parent = Q_NULLPTR);
     ~P2P_Connection() override;
 
     QString name();
+    bool supportsWireImages() const;
+    bool supportsSealedMessages() const;
+    bool supportsMessageEnvelopes() const;
     void setGreetingMessage(const QString& message);
     bool sendBinaryData(const QByteArray& data);
 
@@ -65,6 +74,7 @@ private:
     bool sendData(const QByteArray& data);
     void readPacket(QByteArray& packet);
     void processGreeting(QByteArray& data);
+    void processCapabilities(const QByteArray& data);
 
     QByteArray headerEndCode() const;
     QByteArray headerStartCode() const;
@@ -76,6 +86,7 @@ private:
     QString m_greetingMessage;
     QElapsedTimer m_pongTimer;
     bool m_greetingMessageSent;
+    quint8 m_peerCapabilities;
 };
 
 #endif
@@ -0,0 +1,467 @@
+/*
+ * Copyright (c) 2020 Alex Spataru <https://github.com/alex-spataru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "AeadStream.h"
+#include "ChaCha20Poly1305.h"
+
+#include <QThread>
+#include <QVector>
+#include <QFuture>
+#include <QtEndian>
+#include <QAtomicInt>
+#include <QtConcurrent>
+#include <QRandomGenerator>
+
+#include <climits>
+#include <cstring>
+
+/*
+ * Header fields, the first 24 bytes of the header are also authenticated with every chunk
+ */
+static const char STREAM_MAGIC[4] = {'L', 'S', 'B', 'A'};
+static const quint8 STREAM_VERSION = 1;
+static const quint8 CIPHER_CHACHA20_POLY1305 = 1;
+static const int HEADER_DATA_SIZE = 24;
+static const int CHUNK_SIZE_OFFSET = 8;
+static const int NONCE_OFFSET = 12;
+
+/*
+ * Values XOR-ed with the last word of the stream nonce to obtain the nonce of the header tag
+ * and the nonce of the last chunk, chunk indexes must stay below both of them
+ */
+static const quint32 HEADER_NONCE_MASK = 0xffffffff;
+static const quint32 LAST_CHUNK_FLAG = 0x80000000;
+static const quint32 MAX_CHUNKS = LAST_CHUNK_FLAG - 1;
+
+/*
+ * Streams larger than this are sealed/opened on several threads, in bands of whole chunks
+ * that hold (at least) this many bytes
+ */
+static const int PARALLEL_BAND_BYTES = 1024 * 1024;
+
+/**
+ * @brief run_chunks
+ * @param chunks
+ * @param chunkSize
+ * @param threads
+ * @param function
+ *
+ * Splits the given number of @a chunks in up to @a threads bands and calls @a function with
+ * the index of the first chunk and the number of chunks of each band.
+ *
+ * The first band is processed on the calling thread, the rest on the global thread pool.
+ */
+template<typename Function>
+static void run_chunks(const qint64 chunks, const int chunkSize, const int threads,
+                       Function function)
+{
+    // Calculate number of bands
+    const int maxThreads = threads > 0 ? threads : QThread::idealThreadCount();
+    const qint64 minChunks = qMax(1, PARALLEL_BAND_BYTES / chunkSize);
+    const qint64 maxBands = qMin<qint64>(maxThreads, chunks / minChunks);
+    const int bands = static_cast<int>(qBound<qint64>(1, maxBands, 256));
+    if(bands == 1) {
+        function(0, chunks);
+        return;
+    }
+
+    // Process bands in parallel
+    const qint64 bandChunks = (chunks + bands - 1) / bands;
+    QVector<QFuture<void>> futures;
+    for(qint64 first = bandChunks; first < chunks; first += bandChunks) {
+        const qint64 count = qMin(bandChunks, chunks - first);
+        futures.append(QtConcurrent::run([=]() {
+            function(first, count);
+        }));
+    }
+
+    // Process first band on the calling thread & wait for the rest
+    function(0, qMin(bandChunks, chunks));
+    for(int i = 0; i < futures.count(); ++i)
+        futures[i].waitForFinished();
+}
+
+/**
+ * @brief header_nonce
+ * @param header
+ * @param nonce
+ *
+ * Writes the nonce used to authenticate the given @a header
+ */
+static void header_nonce(const uchar* header, uchar* nonce)
+{
+    memcpy(nonce, header + NONCE_OFFSET, ChaCha20Poly1305::NonceSize);
+    const quint32 word = qFromLittleEndian<quint32>(nonce + 8);
+    qToLittleEndian<quint32>(word ^ HEADER_NONCE_MASK, nonce + 8);
+}
+
+/**
+ * @brief AeadStream::AeadStream
+ * @param key
+ *
+ * Initializes a stream that uses the given 256-bit @a key, @c beginSeal() or @c beginOpen()
+ * must be called before processing any chunk.
+ */
+AeadStream::AeadStream(const QByteArray& key) :
+    m_chunkSize(0),
+    m_chunkIndex(0),
+    m_key(key)
+{
+    Q_ASSERT(key.length() == ChaCha20Poly1305::KeySize);
+}
+
+/**
+ * @brief AeadStream::isSealed
+ * @param data
+ * @return
+ *
+ * Returns @c true if the given @a data starts with the header of a sealed stream
+ */
+bool AeadStream::isSealed(const QByteArray& data)
+{
+    if(data.length() < HeaderSize + TagSize)
+        return false;
+
+    return memcmp(data.constData(), STREAM_MAGIC, sizeof(STREAM_MAGIC)) == 0 &&
+           static_cast<quint8>(data.at(4)) == STREAM_VERSION;
+}
+
+/**
+ * @brief AeadStream::sealedSize
+ * @param length
+ * @param chunkSize
+ * @return
+ *
+ * Returns the size of a sealed stream that holds @a length bytes of data
+ */
+qint64 AeadStream::sealedSize(const qint64 length, const int chunkSize)
+{
+    Q_ASSERT(chunkSize > 0);
+
+    const qint64 chunks = qMax<qint64>(1, (length + chunkSize - 1) / chunkSize);
+    return HeaderSize + length + chunks * TagSize;
+}
+
+/**
+ * @brief AeadStream::chunkSize
+ * @return
+ *
+ * Returns the size of the chunks of the stream (the last chunk may be smaller)
+ */
+int AeadStream::chunkSize() const
+{
+    return m_chunkSize;
+}
+
+/**
+ * @brief AeadStream::beginSeal
+ * @param chunkSize
+ * @return
+ *
+ * Starts a new stream with a random nonce and returns its header, which must be sent before
+ * the sealed chunks.
+ */
+QByteArray AeadStream::beginSeal(const int chunkSize)
+{
+    Q_ASSERT(chunkSize > 0);
+
+    // Generate random nonce
+    quint32 nonce[3];
+    QRandomGenerator::system()->fillRange(nonce, 3);
+
+    // Write header fields
+    QByteArray header(HeaderSize, 0);
+    uchar* data = reinterpret_cast<uchar*>(header.data());
+    memcpy(data, STREAM_MAGIC, sizeof(STREAM_MAGIC));
+    data[4] = STREAM_VERSION;
+    data[5] = CIPHER_CHACHA20_POLY1305;
+    qToLittleEndian<quint32>(static_cast<quint32>(chunkSize), data + CHUNK_SIZE_OFFSET);
+    for(int i = 0; i < 3; ++i)
+        qToLittleEndian<quint32>(nonce[i], data + NONCE_OFFSET + 4 * i);
+
+    // Authenticate header fields
+    uchar tagNonce[ChaCha20Poly1305::NonceSize];
+    header_nonce(data, tagNonce);
+    ChaCha20Poly1305::seal(reinterpret_cast<const uchar*>(m_key.constData()), tagNonce,
+                           data, HEADER_DATA_SIZE, Q_NULLPTR, 0, data + HEADER_DATA_SIZE);
+
+    // Reset stream state
+    m_chunkIndex = 0;
+    m_chunkSize = chunkSize;
+    m_header = header.left(HEADER_DATA_SIZE);
+
+    return header;
+}
+
+/**
+ * @brief AeadStream::beginOpen
+ * @param header
+ * @return
+ *
+ * Validates the given stream @a header, returns @c false if the header is invalid or if it
+ * was not sealed with the key of this stream. The header is only 40 bytes long, so a wrong
+ * key is detected before any chunk is decrypted.
+ */
+bool AeadStream::beginOpen(const QByteArray& header)
+{
+    // Check header fields
+    m_header.clear();
+    if(header.length() < HeaderSize)
+        return false;
+
+    const uchar* data = reinterpret_cast<const uchar*>(header.constData());
+    const qint64 chunkSize = qFromLittleEndian<quint32>(data + CHUNK_SIZE_OFFSET);
+    if(memcmp(data, STREAM_MAGIC, sizeof(STREAM_MAGIC)) != 0 || data[4] != STREAM_VERSION ||
+            data[5] != CIPHER_CHACHA20_POLY1305 || chunkSize <= 0 || chunkSize > INT_MAX)
+        return false;
+
+    // Check header tag
+    uchar tagNonce[ChaCha20Poly1305::NonceSize];
+    header_nonce(data, tagNonce);
+    if(!ChaCha20Poly1305::open(reinterpret_cast<const uchar*>(m_key.constData()), tagNonce,
+                               data, HEADER_DATA_SIZE, Q_NULLPTR, 0, data + HEADER_DATA_SIZE))
+        return false;
+
+    // Reset stream state
+    m_chunkIndex = 0;
+    m_chunkSize = static_cast<int>(chunkSize);
+    m_header = header.left(HEADER_DATA_SIZE);
+
+    return true;
+}
+
+/**
+ * @brief AeadStream::sealChunk
+ * @param data
+ * @param length
+ * @param last
+ * @param tag
+ *
+ * Encrypts the next chunk of the stream in place and writes its 16-byte @a tag. All chunks,
+ * except the @a last one, must be exactly @c chunkSize() bytes long.
+ */
+void AeadStream::sealChunk(uchar* data, const int length, const bool last, uchar* tag)
+{
+    sealChunkAt(m_chunkIndex, data, length, last, tag);
+    ++m_chunkIndex;
+}
+
+/**
+ * @brief AeadStream::openChunk
+ * @param data
+ * @param length
+ * @param last
+ * @param tag
+ * @return
+ *
+ * Authenticates and decrypts the next chunk of the stream in place. Returns @c false (and
+ * leaves @a data untouched) if the chunk was modified, reordered or is not the @a last one
+ * when it should be.
+ */
+bool AeadStream::openChunk(uchar* data, const int length, const bool last, const uchar* tag)
+{
+    if(!openChunkAt(m_chunkIndex, data, length, last, tag))
+        return false;
+
+    ++m_chunkIndex;
+    return true;
+}
+
+/**
+ * @brief AeadStream::seal
+ * @param data
+ * @param key
+ * @param chunkSize
+ * @param threads
+ * @param reserved
+ * @return
+ *
+ * Returns the sealed stream (header and chunks) of the given @a data. Large streams are
+ * sealed by up to @a threads threads (zero uses one thread per CPU core), each chunk has
+ * its own nonce, so the output does not depend on the number of threads.
+ *
+ * The first @a reserved bytes of @a data are not sealed, they are copied in front of the
+ * stream (e.g. room for a message envelope, which can then be written in place).
+ */
+QByteArray AeadStream::seal(const QByteArray& data, const QByteArray& key, const int chunkSize,
+                            const int threads, const int reserved)
+{
+    Q_ASSERT(reserved >= 0 && reserved <= data.length());
+
+    // Allocate output, copy reserved bytes & write header
+    AeadStream stream(key);
+    const qint64 length = data.length() - reserved;
+    QByteArray output(static_cast<int>(reserved + sealedSize(length, chunkSize)),
+                      Qt::Uninitialized);
+    if(reserved > 0)
+        memcpy(output.data(), data.constData(), static_cast<size_t>(reserved));
+
+    memcpy(output.data() + reserved, stream.beginSeal(chunkSize).constData(), HeaderSize);
+
+    // Copy & seal each chunk
+    const qint64 chunks = qMax<qint64>(1, (length + chunkSize - 1) / chunkSize);
+    const char* input = data.constData() + reserved;
+    uchar* sealed = reinterpret_cast<uchar*>(output.data()) + reserved + HeaderSize;
+    run_chunks(chunks, chunkSize, threads, [&](const qint64 first, const qint64 count) {
+        for(qint64 i = first; i < first + count; ++i) {
+            const qint64 offset = i * chunkSize;
+            const int bytes = static_cast<int>(qMin<qint64>(chunkSize, length - offset));
+            uchar* chunk = sealed + i * (chunkSize + TagSize);
+            if(bytes > 0)
+                memcpy(chunk, input + offset, static_cast<size_t>(bytes));
+
+            stream.sealChunkAt(static_cast<quint32>(i), chunk, bytes, i == chunks - 1,
+                               chunk + bytes);
+        }
+    });
+
+    return output;
+}
+
+/**
+ * @brief AeadStream::open
+ * @param data
+ * @param key
+ * @param output
+ * @param threads
+ * @return
+ *
+ * Authenticates and decrypts the given sealed stream @a data and writes the result to
+ * @a output. Returns @c false (and clears @a output) if the stream is invalid, if it was
+ * sealed with a different key or if any chunk was modified. Large streams are opened by up
+ * to @a threads threads (zero uses one thread per CPU core).
+ */
+bool AeadStream::open(const QByteArray& data, const QByteArray& key, QByteArray* output,
+                      const int threads)
+{
+    Q_ASSERT(output);
+
+    // Check header (and key)
+    output->clear();
+    AeadStream stream(key);
+    if(!isSealed(data) || !stream.beginOpen(data.left(HeaderSize)))
+        return false;
+
+    // Get number of chunks, only the last chunk can be smaller than the chunk size
+    const int chunkSize = stream.chunkSize();
+    const qint64 remaining = data.length() - HeaderSize;
+    const qint64 sealedChunk = qint64(chunkSize) + TagSize;
+    qint64 chunks = remaining / sealedChunk;
+    if(remaining % sealedChunk >= TagSize)
+        ++chunks;
+    else if(remaining % sealedChunk != 0 || chunks == 0)
+        return false;
+
+    // Copy & open each chunk
+    QAtomicInt failed(0);
+    const qint64 length = remaining - chunks * TagSize;
+    QByteArray plaintext(static_cast<int>(length), Qt::Uninitialized);
+    const uchar* sealed = reinterpret_cast<const uchar*>(data.constData()) + HeaderSize;
+    uchar* opened = reinterpret_cast<uchar*>(plaintext.data());
+    run_chunks(chunks, chunkSize, threads, [&](const qint64 first, const qint64 count) {
+        for(qint64 i = first; i < first + count && !failed.loadAcquire(); ++i) {
+            const qint64 offset = i * chunkSize;
+            const int bytes = static_cast<int>(qMin<qint64>(chunkSize, length - offset));
+            const uchar* chunk = sealed + i * sealedChunk;
+            if(bytes > 0)
+                memcpy(opened + offset, chunk, static_cast<size_t>(bytes));
+
+            if(!stream.openChunkAt(static_cast<quint32>(i), opened + offset, bytes,
+                                   i == chunks - 1, chunk + bytes))
+                failed.storeRelease(1);
+        }
+    });
+
+    if(failed.loadAcquire())
+        return false;
+
+    *output = plaintext;
+    return true;
+}
+
+/**
+ * @brief AeadStream::chunkNonce
+ * @param index
+ * @param last
+ * @param nonce
+ *
+ * Writes the nonce of the chunk with the given @a index, which is the stream nonce with the
+ * chunk index (and the last chunk flag) XOR-ed into its last word.
+ */
+void AeadStream::chunkNonce(const quint32 index, const bool last, uchar* nonce) const
+{
+    memcpy(nonce, m_header.constData() + NONCE_OFFSET, ChaCha20Poly1305::NonceSize);
+
+    const quint32 value = index | (last ? LAST_CHUNK_FLAG : 0);
+    const quint32 word = qFromLittleEndian<quint32>(nonce + 8);
+    qToLittleEndian<quint32>(word ^ value, nonce + 8);
+}
+
+/**
+ * @brief AeadStream::sealChunkAt
+ * @param index
+ * @param data
+ * @param length
+ * @param last
+ * @param tag
+ *
+ * Seals the chunk with the given @a index in place, chunks do not depend on each other, so
+ * they can be sealed in any order (and by several threads at once).
+ */
+void AeadStream::sealChunkAt(const quint32 index, uchar* data, const int length,
+                             const bool last, uchar* tag) const
+{
+    Q_ASSERT(!m_header.isEmpty());
+    Q_ASSERT(length == m_chunkSize || (last && length < m_chunkSize));
+    Q_ASSERT(index < MAX_CHUNKS);
+
+    uchar nonce[ChaCha20Poly1305::NonceSize];
+    chunkNonce(index, last, nonce);
+    ChaCha20Poly1305::seal(reinterpret_cast<const uchar*>(m_key.constData()), nonce,
+                           reinterpret_cast<const uchar*>(m_header.constData()),
+                           HEADER_DATA_SIZE, data, length, tag);
+}
+
+/**
+ * @brief AeadStream::openChunkAt
+ * @param index
+ * @param data
+ * @param length
+ * @param last
+ * @param tag
+ * @return
+ *
+ * Opens the chunk with the given @a index in place, in the same way as @c sealChunkAt()
+ */
+bool AeadStream::openChunkAt(const quint32 index, uchar* data, const int length,
+                             const bool last, const uchar* tag) const
+{
+    if(m_header.isEmpty() || length > m_chunkSize || (!last && length != m_chunkSize) ||
+            index >= MAX_CHUNKS)
+        return false;
+
+    uchar nonce[ChaCha20Poly1305::NonceSize];
+    chunkNonce(index, last, nonce);
+    return ChaCha20Poly1305::open(reinterpret_cast<const uchar*>(m_key.constData()), nonce,
+                                  reinterpret_cast<const uchar*>(m_header.constData()),
+                                  HEADER_DATA_SIZE, data, length, tag);
+}
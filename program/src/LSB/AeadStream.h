@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2020 Alex Spataru <https://github.com/alex-spataru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef AEAD_STREAM_H
+#define AEAD_STREAM_H
+
+#include <QtGlobal>
+#include <QByteArray>
+
+/*
+ * Chunked authenticated encryption (ChaCha20-Poly1305) of a byte stream.
+ *
+ * A sealed stream starts with a 40-byte header, which holds the magic bytes, the version,
+ * the cipher, the chunk size, a random nonce and a tag that authenticates the header itself.
+ * The header is followed by the chunks, each one is encrypted and authenticated on its own
+ * and followed by its 16-byte tag:
+ *
+ *     | Header (40) | Chunk 0 + Tag (16) | Chunk 1 + Tag (16) | ... | Last chunk + Tag (16) |
+ *
+ * The nonce of each chunk is derived from the stream nonce, the chunk index and a flag that
+ * marks the last chunk, so that chunks cannot be reordered, dropped or appended. Since the
+ * header tag can only be verified with the right key, a wrong key is rejected before any
+ * chunk is processed, and large streams can be encrypted/decrypted one chunk at a time.
+ */
+class AeadStream
+{
+public:
+    enum {
+        HeaderSize = 40,
+        TagSize = 16,
+        DefaultChunkSize = 64 * 1024
+    };
+
+    AeadStream(const QByteArray& key);
+
+    static bool isSealed(const QByteArray& data);
+    static qint64 sealedSize(const qint64 length, const int chunkSize = DefaultChunkSize);
+
+    int chunkSize() const;
+    QByteArray beginSeal(const int chunkSize = DefaultChunkSize);
+    bool beginOpen(const QByteArray& header);
+
+    void sealChunk(uchar* data, const int length, const bool last, uchar* tag);
+    bool openChunk(uchar* data, const int length, const bool last, const uchar* tag);
+
+    static QByteArray seal(const QByteArray& data, const QByteArray& key,
+                           const int chunkSize = DefaultChunkSize, const int threads = 0,
+                           const int reserved = 0);
+    static bool open(const QByteArray& data, const QByteArray& key, QByteArray* output,
+                     const int threads = 0);
+
+private:
+    void chunkNonce(const quint32 index, const bool last, uchar* nonce) const;
+    void sealChunkAt(const quint32 index, uchar* data, const int length, const bool last,
+                     uchar* tag) const;
+    bool openChunkAt(const quint32 index, uchar* data, const int length, const bool last,
+                     const uchar* tag) const;
+
+private:
+    int m_chunkSize;
+    quint32 m_chunkIndex;
+    QByteArray m_key;
+    QByteArray m_header;
+};
+
+#endif
@@ -0,0 +1,624 @@
+/*
+ * Copyright (c) 2020 Alex Spataru <https://github.com/alex-spataru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "BitPlane.h"
+#include "CpuFeatures.h"
+
+#include <cstring>
+
+#if defined(LSB_X86)
+    #include <immintrin.h>
+#endif
+
+/*
+ * Mask used by the SIMD kernels to clear the LSB of the red, green and blue channels
+ */
+static const quint32 KEEP_MASK = 0xfffefefe;
+
+/*
+ * Function signatures of the embedding/extraction kernels
+ */
+typedef void (*EmbedKernel)(QRgb*, const uchar*, const int);
+typedef void (*ExtractKernel)(const QRgb*, uchar*, const int);
+
+/*
+ * Bit position of the red, green, blue and alpha channels inside a 32-bit pixel
+ */
+static const int CHANNEL_SHIFT[4] = {16, 8, 0, 24};
+
+/**
+ * @brief gcd
+ * @param a
+ * @param b
+ * @return
+ *
+ * Greatest common divisor, used to calculate the size of pixel groups at compile time
+ */
+static constexpr int gcd(const int a, const int b)
+{
+    return b == 0 ? a : gcd(b, a % b);
+}
+
+/**
+ * @brief channel_mask
+ * @return
+ *
+ * Returns a mask with the bits of a pixel that are used to store data when writing
+ * @a Depth bits over each one of the first @a Channels channels (R, G, B, A).
+ */
+template<int Depth, int Channels>
+static inline quint32 channel_mask()
+{
+    quint32 mask = 0;
+    for(int c = 0; c < Channels; ++c)
+        mask |= ((1u << Depth) - 1) << CHANNEL_SHIFT[c];
+
+    return mask;
+}
+
+/**
+ * @brief spread_bits
+ * @param bits
+ * @return
+ *
+ * Places the lowest @a Depth x @a Channels @a bits over the low bits of each color channel
+ * of a 32-bit pixel, red receives the first @a Depth bits, then green, blue and alpha.
+ */
+template<int Depth, int Channels>
+static inline quint32 spread_bits(const quint32 bits)
+{
+    quint32 pixel = 0;
+    for(int c = 0; c < Channels; ++c)
+        pixel |= ((bits >> (c * Depth)) & ((1u << Depth) - 1)) << CHANNEL_SHIFT[c];
+
+    return pixel;
+}
+
+/**
+ * @brief gather_bits
+ * @param pixel
+ * @return
+ *
+ * Inverse of @c spread_bits(), returns the data bits stored in the given @a pixel
+ */
+template<int Depth, int Channels>
+static inline quint32 gather_bits(const quint32 pixel)
+{
+    quint32 bits = 0;
+    for(int c = 0; c < Channels; ++c)
+        bits |= ((pixel >> CHANNEL_SHIFT[c]) & ((1u << Depth) - 1)) << (c * Depth);
+
+    return bits;
+}
+
+/**
+ * @brief read_group
+ * @param data
+ * @return
+ *
+ * Returns the 24 bits of the three bytes that are written over a group of eight pixels
+ */
+static inline quint32 read_group(const uchar* data)
+{
+    return static_cast<quint32>(data[0]) |
+           static_cast<quint32>(data[1]) << 8 |
+           static_cast<quint32>(data[2]) << 16;
+}
+
+/**
+ * @brief write_group
+ * @param data
+ * @param bits
+ *
+ * Writes the 24 @a bits read from a group of eight pixels as three bytes
+ */
+static inline void write_group(uchar* data, const quint32 bits)
+{
+    data[0] = static_cast<uchar>(bits);
+    data[1] = static_cast<uchar>(bits >> 8);
+    data[2] = static_cast<uchar>(bits >> 16);
+}
+
+/**
+ * @brief embed_tail
+ * @param pixels
+ * @param data
+ * @param bytes
+ *
+ * Bit-by-bit reference implementation of the embedding process, used for the last bytes
+ * that do not fill a complete group of pixels. Channel bits that do not receive data are
+ * left untouched.
+ */
+template<int Depth, int Channels>
+static void embed_tail(QRgb* pixels, const uchar* data, const int bytes)
+{
+    const int bitsPerPixel = Depth * Channels;
+    for(int bit = 0; bit < bytes * 8; ++bit) {
+        const int slot = bit % bitsPerPixel;
+        const int shift = CHANNEL_SHIFT[slot / Depth] + slot % Depth;
+        const quint32 value = (data[bit / 8] >> (bit % 8)) & 1;
+        QRgb& pixel = pixels[bit / bitsPerPixel];
+        pixel = (pixel & ~(1u << shift)) | (value << shift);
+    }
+}
+
+/**
+ * @brief extract_tail
+ * @param pixels
+ * @param data
+ * @param bytes
+ *
+ * Bit-by-bit reference implementation of the extraction process, used for the last bytes
+ * that do not fill a complete group of pixels.
+ */
+template<int Depth, int Channels>
+static void extract_tail(const QRgb* pixels, uchar* data, const int bytes)
+{
+    if(bytes <= 0)
+        return;
+
+    const int bitsPerPixel = Depth * Channels;
+    memset(data, 0, static_cast<size_t>(bytes));
+    for(int bit = 0; bit < bytes * 8; ++bit) {
+        const int slot = bit % bitsPerPixel;
+        const int shift = CHANNEL_SHIFT[slot / Depth] + slot % Depth;
+        data[bit / 8] |= ((pixels[bit / bitsPerPixel] >> shift) & 1) << (bit % 8);
+    }
+}
+
+/**
+ * @brief embed_scalar
+ * @param pixels
+ * @param data
+ * @param bytes
+ *
+ * Portable embedding kernel. Data is processed in groups that start and end at both a byte
+ * and a pixel boundary (e.g. eight pixels for each three bytes when writing one bit over
+ * three channels). Since the group size is known at compile time, the compiler can fully
+ * unroll the inner loops and resolve the bit buffer bookkeeping, so that each variant is
+ * free of data-dependent branches.
+ */
+template<int Depth, int Channels>
+static void embed_scalar(QRgb* pixels, const uchar* data, const int bytes)
+{
+    const int bitsPerPixel = Depth * Channels;
+    const int groupPixels = 8 / gcd(bitsPerPixel, 8);
+    const int groupBytes = bitsPerPixel / gcd(bitsPerPixel, 8);
+    const quint32 valueMask = (1u << bitsPerPixel) - 1;
+    const quint32 keepMask = ~channel_mask<Depth, Channels>();
+
+    int i = 0;
+    for(; i + groupBytes <= bytes; i += groupBytes, pixels += groupPixels) {
+        quint64 buffer = 0;
+        int available = 0;
+        const uchar* source = data + i;
+        for(int p = 0; p < groupPixels; ++p) {
+            while(available < bitsPerPixel) {
+                buffer |= static_cast<quint64>(*source++) << available;
+                available += 8;
+            }
+
+            const quint32 bits = static_cast<quint32>(buffer) & valueMask;
+            pixels[p] = (pixels[p] & keepMask) | spread_bits<Depth, Channels>(bits);
+            buffer >>= bitsPerPixel;
+            available -= bitsPerPixel;
+        }
+    }
+
+    embed_tail<Depth, Channels>(pixels, data + i, bytes - i);
+}
+
+/**
+ * @brief extract_scalar
+ * @param pixels
+ * @param data
+ * @param bytes
+ *
+ * Portable extraction kernel, inverse of @c embed_scalar()
+ */
+template<int Depth, int Channels>
+static void extract_scalar(const QRgb* pixels, uchar* data, const int bytes)
+{
+    const int bitsPerPixel = Depth * Channels;
+    const int groupPixels = 8 / gcd(bitsPerPixel, 8);
+    const int groupBytes = bitsPerPixel / gcd(bitsPerPixel, 8);
+
+    int i = 0;
+    for(; i + groupBytes <= bytes; i += groupBytes, pixels += groupPixels) {
+        quint64 buffer = 0;
+        int available = 0;
+        uchar* target = data + i;
+        for(int p = 0; p < groupPixels; ++p) {
+            buffer |= static_cast<quint64>(gather_bits<Depth, Channels>(pixels[p])) << available;
+            available += bitsPerPixel;
+
+            while(available >= 8) {
+                *target++ = static_cast<uchar>(buffer);
+                buffer >>= 8;
+                available -= 8;
+            }
+        }
+    }
+
+    extract_tail<Depth, Channels>(pixels, data + i, bytes - i);
+}
+
+#if defined(LSB_X86)
+
+/**
+ * @brief spread_sse2
+ * @param bits
+ * @return
+ *
+ * Vector version of @c spread_bits(), converts four 3-bit values into four pixel masks
+ */
+LSB_TARGET("sse2") static inline __m128i spread_sse2(const __m128i bits)
+{
+    const __m128i r = _mm_slli_epi32(_mm_and_si128(bits, _mm_set1_epi32(1)), 16);
+    const __m128i g = _mm_slli_epi32(_mm_and_si128(bits, _mm_set1_epi32(2)), 7);
+    const __m128i b = _mm_srli_epi32(_mm_and_si128(bits, _mm_set1_epi32(4)), 2);
+    return _mm_or_si128(_mm_or_si128(r, g), b);
+}
+
+/**
+ * @brief compact_mask
+ * @param mask
+ * @return
+ *
+ * Converts the byte mask of four pixels (as returned by @c _mm_movemask_epi8, with the
+ * blue, green, red and alpha LSBs of each pixel) into the 12 stream bits of those pixels.
+ */
+static inline quint32 compact_mask(const quint32 mask)
+{
+    // Swap red and blue bits of each pixel (B, G, R, A -> R, G, B, A)
+    const quint32 rgb = ((mask >> 2) & 0x1111) | (mask & 0x2222) | ((mask & 0x1111) << 2);
+
+    // Drop the alpha bit of each pixel
+    return (rgb & 0x7) | ((rgb >> 1) & 0x38) | ((rgb >> 2) & 0x1c0) | ((rgb >> 3) & 0xe00);
+}
+
+/**
+ * @brief embed_sse2
+ * @param pixels
+ * @param data
+ * @param bytes
+ *
+ * SSE2 embedding kernel, processes 16 pixels (6 bytes) per iteration
+ */
+LSB_TARGET("sse2") static void embed_sse2(QRgb* pixels, const uchar* data, const int bytes)
+{
+    const __m128i keep = _mm_set1_epi32(static_cast<int>(KEEP_MASK));
+
+    int i = 0;
+    for(; i + 6 <= bytes; i += 6, pixels += 16) {
+        for(int k = 0; k < 2; ++k) {
+            // Split the 24 bits of the group into eight 3-bit values
+            const int bits = static_cast<int>(read_group(data + i + 3 * k));
+            const __m128i lo = _mm_setr_epi32(bits, bits >> 3, bits >> 6, bits >> 9);
+            const __m128i hi = _mm_setr_epi32(bits >> 12, bits >> 15, bits >> 18, bits >> 21);
+
+            // Replace LSBs of the pixels
+            __m128i* p = reinterpret_cast<__m128i*>(pixels + 8 * k);
+            const __m128i p0 = _mm_and_si128(_mm_loadu_si128(p + 0), keep);
+            const __m128i p1 = _mm_and_si128(_mm_loadu_si128(p + 1), keep);
+            _mm_storeu_si128(p + 0, _mm_or_si128(p0, spread_sse2(lo)));
+            _mm_storeu_si128(p + 1, _mm_or_si128(p1, spread_sse2(hi)));
+        }
+    }
+
+    embed_scalar<1, 3>(pixels, data + i, bytes - i);
+}
+
+/**
+ * @brief extract_sse2
+ * @param pixels
+ * @param data
+ * @param bytes
+ *
+ * SSE2 extraction kernel, processes 16 pixels (6 bytes) per iteration
+ */
+LSB_TARGET("sse2") static void extract_sse2(const QRgb* pixels, uchar* data, const int bytes)
+{
+    int i = 0;
+    for(; i + 6 <= bytes; i += 6, pixels += 16) {
+        for(int k = 0; k < 2; ++k) {
+            // Move the LSB of each byte to the MSB and collect them
+            const __m128i* p = reinterpret_cast<const __m128i*>(pixels + 8 * k);
+            const __m128i p0 = _mm_slli_epi16(_mm_loadu_si128(p + 0), 7);
+            const __m128i p1 = _mm_slli_epi16(_mm_loadu_si128(p + 1), 7);
+            const quint32 m0 = static_cast<quint32>(_mm_movemask_epi8(p0));
+            const quint32 m1 = static_cast<quint32>(_mm_movemask_epi8(p1));
+
+            // Write the bytes of the group
+            write_group(data + i + 3 * k, compact_mask(m0) | compact_mask(m1) << 12);
+        }
+    }
+
+    extract_scalar<1, 3>(pixels, data + i, bytes - i);
+}
+
+/**
+ * @brief embed_avx2
+ * @param pixels
+ * @param data
+ * @param bytes
+ *
+ * AVX2 embedding kernel, processes 32 pixels (12 bytes) per iteration. Each group of three
+ * bytes is broadcasted to a 256-bit register, afterwards, a byte shuffle moves the byte that
+ * contains the bit of each color channel to the position of that channel.
+ */
+LSB_TARGET("avx2") static void embed_avx2(QRgb* pixels, const uchar* data, const int bytes)
+{
+    // Source byte & bit mask for the B, G, R, A channels of eight pixels
+    const __m256i shuffle = _mm256_setr_epi8(0, 0, 0, -1, 0, 0, 0, -1,
+                                             1, 0, 0, -1, 1, 1, 1, -1,
+                                             1, 1, 1, -1, 2, 2, 1, -1,
+                                             2, 2, 2, -1, 2, 2, 2, -1);
+    const __m256i select = _mm256_setr_epi8(4, 2, 1, 0, 32, 16, 8, 0,
+                                            1, -128, 64, 0, 8, 4, 2, 0,
+                                            64, 32, 16, 0, 2, 1, -128, 0,
+                                            16, 8, 4, 0, -128, 64, 32, 0);
+    const __m256i ones = _mm256_set1_epi32(0x00010101);
+    const __m256i keep = _mm256_set1_epi32(static_cast<int>(KEEP_MASK));
+
+    int i = 0;
+    for(; i + 12 <= bytes; i += 12, pixels += 32) {
+        for(int k = 0; k < 4; ++k) {
+            // Obtain a 0/1 value for each color channel
+            const __m256i group = _mm256_set1_epi32(static_cast<int>(read_group(data + i + 3 * k)));
+            const __m256i channels = _mm256_and_si256(_mm256_shuffle_epi8(group, shuffle), select);
+            const __m256i bits = _mm256_and_si256(_mm256_cmpeq_epi8(channels, select), ones);
+
+            // Replace LSBs of the pixels
+            __m256i* p = reinterpret_cast<__m256i*>(pixels + 8 * k);
+            const __m256i value = _mm256_and_si256(_mm256_loadu_si256(p), keep);
+            _mm256_storeu_si256(p, _mm256_or_si256(value, bits));
+        }
+    }
+
+    embed_sse2(pixels, data + i, bytes - i);
+}
+
+/**
+ * @brief extract_avx2
+ * @param pixels
+ * @param data
+ * @param bytes
+ *
+ * AVX2 extraction kernel, processes 32 pixels (12 bytes) per iteration. A byte shuffle
+ * reorders the channels of each 4-pixel lane in stream order (R, G, B) and drops the alpha
+ * channel, then the LSBs are collected with a single byte mask operation.
+ */
+LSB_TARGET("avx2") static void extract_avx2(const QRgb* pixels, uchar* data, const int bytes)
+{
+    const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+                                             -1, -1, -1, -1,
+                                             2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+                                             -1, -1, -1, -1);
+
+    int i = 0;
+    for(; i + 12 <= bytes; i += 12, pixels += 32) {
+        for(int k = 0; k < 4; ++k) {
+            // Reorder channels & move the LSB of each byte to the MSB
+            const __m256i* p = reinterpret_cast<const __m256i*>(pixels + 8 * k);
+            const __m256i value = _mm256_shuffle_epi8(_mm256_loadu_si256(p), shuffle);
+            const __m256i lsbs = _mm256_slli_epi16(value, 7);
+            const quint32 mask = static_cast<quint32>(_mm256_movemask_epi8(lsbs));
+
+            // Each 128-bit lane contributes 12 bits
+            write_group(data + i + 3 * k, (mask & 0xfff) | ((mask >> 4) & 0xfff000));
+        }
+    }
+
+    extract_sse2(pixels, data + i, bytes - i);
+}
+
+#endif
+
+/**
+ * @brief BitPlane::bestKernel
+ * @return
+ *
+ * Returns the fastest kernel supported by the CPU, the CPU features are only queried once
+ */
+BitPlane::Kernel BitPlane::bestKernel()
+{
+    static const Kernel kernel = kernelSupported(KernelAVX2) ? KernelAVX2 :
+                                 kernelSupported(KernelSSE2) ? KernelSSE2 : KernelScalar;
+
+    return kernel;
+}
+
+/**
+ * @brief BitPlane::kernelSupported
+ * @param kernel
+ * @return
+ *
+ * Returns @c true if the given @a kernel can be executed by the current CPU
+ */
+bool BitPlane::kernelSupported(const Kernel kernel)
+{
+    switch(kernel) {
+#if defined(LSB_X86)
+    case KernelSSE2:
+        return CpuFeatures::hasSSE2();
+    case KernelAVX2:
+        return CpuFeatures::hasAVX2();
+#endif
+    case KernelScalar:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief BitPlane::bitsPerPixel
+ * @param depth
+ * @param alpha
+ * @return
+ *
+ * Returns the number of data bits stored in each pixel when writing @a depth bits over each
+ * color channel (and over the alpha channel if @a alpha is set to @c true).
+ */
+int BitPlane::bitsPerPixel(const int depth, const bool alpha)
+{
+    Q_ASSERT(depth >= 1 && depth <= 4);
+    return depth * (alpha ? 4 : 3);
+}
+
+/**
+ * @brief BitPlane::pixelsForBytes
+ * @param bytes
+ * @param depth
+ * @param alpha
+ * @return
+ *
+ * Returns the number of pixels needed to store the given number of @a bytes
+ */
+int BitPlane::pixelsForBytes(const int bytes, const int depth, const bool alpha)
+{
+    const qint64 bits = static_cast<qint64>(bytes) * 8;
+    const int bitsPerPixel = BitPlane::bitsPerPixel(depth, alpha);
+    return static_cast<int>((bits + bitsPerPixel - 1) / bitsPerPixel);
+}
+
+/**
+ * @brief BitPlane::groupBytes
+ * @param depth
+ * @param alpha
+ * @return
+ *
+ * Returns the smallest number of bytes that fill a whole number of pixels. A stream can be
+ * split at any multiple of this value and each part embedded/extracted independently, since
+ * no pixel is shared between two parts.
+ */
+int BitPlane::groupBytes(const int depth, const bool alpha)
+{
+    const int bitsPerPixel = BitPlane::bitsPerPixel(depth, alpha);
+    return bitsPerPixel / gcd(8, bitsPerPixel);
+}
+
+/**
+ * @brief BitPlane::embed
+ * @param pixels
+ * @param data
+ * @param bytes
+ * @param depth
+ * @param alpha
+ *
+ * Writes the given @a data over the @a depth low bits of the color channels of the given
+ * @a pixels (including the alpha channel if @a alpha is set to @c true). The fastest kernel
+ * available is used. The pixel buffer must hold at least @c pixelsForBytes() pixels.
+ */
+void BitPlane::embed(QRgb* pixels, const uchar* data, const int bytes, const int depth,
+                     const bool alpha)
+{
+    Q_ASSERT(depth >= 1 && depth <= 4);
+
+    static const EmbedKernel kernels[2][4] = {
+        {embed_scalar<1, 3>, embed_scalar<2, 3>, embed_scalar<3, 3>, embed_scalar<4, 3>},
+        {embed_scalar<1, 4>, embed_scalar<2, 4>, embed_scalar<3, 4>, embed_scalar<4, 4>}
+    };
+
+    if(depth == 1 && !alpha)
+        embed(bestKernel(), pixels, data, bytes);
+    else
+        kernels[alpha][depth - 1](pixels, data, bytes);
+}
+
+/**
+ * @brief BitPlane::extract
+ * @param pixels
+ * @param data
+ * @param bytes
+ * @param depth
+ * @param alpha
+ *
+ * Reads @a bytes bytes written with @c embed() using the same @a depth and @a alpha values.
+ * The fastest kernel available is used.
+ */
+void BitPlane::extract(const QRgb* pixels, uchar* data, const int bytes, const int depth,
+                       const bool alpha)
+{
+    Q_ASSERT(depth >= 1 && depth <= 4);
+
+    static const ExtractKernel kernels[2][4] = {
+        {extract_scalar<1, 3>, extract_scalar<2, 3>, extract_scalar<3, 3>, extract_scalar<4, 3>},
+        {extract_scalar<1, 4>, extract_scalar<2, 4>, extract_scalar<3, 4>, extract_scalar<4, 4>}
+    };
+
+    if(depth == 1 && !alpha)
+        extract(bestKernel(), pixels, data, bytes);
+    else
+        kernels[alpha][depth - 1](pixels, data, bytes);
+}
+
+/**
+ * @brief BitPlane::embed
+ * @param kernel
+ * @param pixels
+ * @param data
+ * @param bytes
+ *
+ * Writes the given @a data over the LSBs of the red, green and blue channels of the given
+ * @a pixels using the given @a kernel, all kernels produce exactly the same output.
+ */
+void BitPlane::embed(const Kernel kernel, QRgb* pixels, const uchar* data, const int bytes)
+{
+    Q_ASSERT(kernelSupported(kernel));
+
+    EmbedKernel function = embed_scalar<1, 3>;
+#if defined(LSB_X86)
+    if(kernel == KernelAVX2)
+        function = embed_avx2;
+    else if(kernel == KernelSSE2)
+        function = embed_sse2;
+#endif
+
+    function(pixels, data, bytes);
+}
+
+/**
+ * @brief BitPlane::extract
+ * @param kernel
+ * @param pixels
+ * @param data
+ * @param bytes
+ *
+ * Reads @a bytes bytes from the LSBs of the red, green and blue channels of the given
+ * @a pixels using the given @a kernel, all kernels produce exactly the same output.
+ */
+void BitPlane::extract(const Kernel kernel, const QRgb* pixels, uchar* data, const int bytes)
+{
+    Q_ASSERT(kernelSupported(kernel));
+
+    ExtractKernel function = extract_scalar<1, 3>;
+#if defined(LSB_X86)
+    if(kernel == KernelAVX2)
+        function = extract_avx2;
+    else if(kernel == KernelSSE2)
+        function = extract_sse2;
+#endif
+
+    function(pixels, data, bytes);
+}
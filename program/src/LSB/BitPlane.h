@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2020 Alex Spataru <https://github.com/alex-spataru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef BIT_PLANE_H
+#define BIT_PLANE_H
+
+#include <QRgb>
+#include <QtGlobal>
+
+/*
+ * Writes/reads a stream of bytes over the low bits of the color channels of a contiguous run
+ * of 32-bit pixels (QImage::Format_RGB32/ARGB32).
+ *
+ * Each pixel stores depth x 3 bits (depth x 4 if the alpha channel is used), with depth
+ * going from 1 to 4 bits per channel. The bits of the stream (LSB-first within each byte)
+ * fill the red channel first, then green, blue and alpha; within each channel, the first
+ * bit goes to the LSB. Bits of the pixel that do not store data are never modified.
+ *
+ * With one bit per channel and no alpha (the default), three bytes fill exactly eight pixels
+ * and SSE2/AVX2 kernels are used when available.
+ */
+class BitPlane
+{
+public:
+    enum Kernel {
+        KernelScalar,
+        KernelSSE2,
+        KernelAVX2
+    };
+
+    static Kernel bestKernel();
+    static bool kernelSupported(const Kernel kernel);
+
+    static int bitsPerPixel(const int depth, const bool alpha);
+    static int pixelsForBytes(const int bytes, const int depth = 1, const bool alpha = false);
+    static int groupBytes(const int depth = 1, const bool alpha = false);
+
+    static void embed(QRgb* pixels, const uchar* data, const int bytes,
+                      const int depth = 1, const bool alpha = false);
+    static void extract(const QRgb* pixels, uchar* data, const int bytes,
+                        const int depth = 1, const bool alpha = false);
+
+    static void embed(const Kernel kernel, QRgb* pixels, const uchar* data, const int bytes);
+    static void extract(const Kernel kernel, const QRgb* pixels, uchar* data, const int bytes);
+};
+
+#endif
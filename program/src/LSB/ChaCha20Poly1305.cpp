@@ -0,0 +1,789 @@
+/*
+ * Copyright (c) 2020 Alex Spataru <https://github.com/alex-spataru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "ChaCha20Poly1305.h"
+#include "CpuFeatures.h"
+
+#include <QtEndian>
+
+#include <cstring>
+
+#if defined(LSB_X86)
+    #include <immintrin.h>
+#endif
+
+/*
+ * ChaCha20 constants ("expand 32-byte k") and number of double rounds
+ */
+static const quint32 CHACHA_CONSTANTS[4] = {0x61707865, 0x3320646e, 0x79622d32, 0x6b206574};
+static const int CHACHA_DOUBLE_ROUNDS = 10;
+
+/*
+ * Poly1305 works with 130-bit numbers stored in five 26-bit limbs
+ */
+static const quint32 POLY_LIMB_MASK = 0x3ffffff;
+
+/*
+ * Signature of the ChaCha20 kernels, which XOR the keystream generated from the given
+ * @a state with @a length bytes of @a data and advance the block counter of the state
+ */
+typedef void (*ChaChaKernel)(quint32* state, uchar* data, qint64 length);
+
+/*
+ * Incremental Poly1305 state
+ */
+struct Poly1305 {
+    quint32 r[5];
+    quint32 h[5];
+    quint32 pad[4];
+    uchar buffer[16];
+    int leftover;
+};
+
+/**
+ * @brief rotate_left
+ * @param value
+ * @param bits
+ * @return
+ *
+ * Rotates the given 32-bit @a value to the left by the given number of @a bits
+ */
+static inline quint32 rotate_left(const quint32 value, const int bits)
+{
+    return (value << bits) | (value >> (32 - bits));
+}
+
+/**
+ * @brief quarter_round
+ * @param x
+ * @param a
+ * @param b
+ * @param c
+ * @param d
+ *
+ * Applies the ChaCha quarter round to the words @a a, @a b, @a c and @a d of the block @a x
+ */
+static inline void quarter_round(quint32* x, const int a, const int b, const int c, const int d)
+{
+    x[a] += x[b];
+    x[d] = rotate_left(x[d] ^ x[a], 16);
+    x[c] += x[d];
+    x[b] = rotate_left(x[b] ^ x[c], 12);
+    x[a] += x[b];
+    x[d] = rotate_left(x[d] ^ x[a], 8);
+    x[c] += x[d];
+    x[b] = rotate_left(x[b] ^ x[c], 7);
+}
+
+/**
+ * @brief init_state
+ * @param state
+ * @param key
+ * @param nonce
+ * @param counter
+ *
+ * Initializes the ChaCha20 @a state with the given 256-bit @a key, 96-bit @a nonce and block
+ * @a counter
+ */
+static void init_state(quint32* state, const uchar* key, const uchar* nonce,
+                       const quint32 counter)
+{
+    for(int i = 0; i < 4; ++i)
+        state[i] = CHACHA_CONSTANTS[i];
+    for(int i = 0; i < 8; ++i)
+        state[4 + i] = qFromLittleEndian<quint32>(key + 4 * i);
+
+    state[12] = counter;
+    for(int i = 0; i < 3; ++i)
+        state[13 + i] = qFromLittleEndian<quint32>(nonce + 4 * i);
+}
+
+/**
+ * @brief chacha_block
+ * @param state
+ * @param output
+ *
+ * Generates the 64-byte keystream block for the current @a state (without advancing it)
+ */
+static void chacha_block(const quint32* state, uchar* output)
+{
+    quint32 x[16];
+    memcpy(x, state, sizeof(x));
+    for(int i = 0; i < CHACHA_DOUBLE_ROUNDS; ++i) {
+        quarter_round(x, 0, 4, 8, 12);
+        quarter_round(x, 1, 5, 9, 13);
+        quarter_round(x, 2, 6, 10, 14);
+        quarter_round(x, 3, 7, 11, 15);
+        quarter_round(x, 0, 5, 10, 15);
+        quarter_round(x, 1, 6, 11, 12);
+        quarter_round(x, 2, 7, 8, 13);
+        quarter_round(x, 3, 4, 9, 14);
+    }
+
+    for(int i = 0; i < 16; ++i)
+        qToLittleEndian<quint32>(x[i] + state[i], output + 4 * i);
+}
+
+/**
+ * @brief chacha20_scalar
+ * @param state
+ * @param data
+ * @param length
+ *
+ * Reference ChaCha20 kernel, generates one block at a time
+ */
+static void chacha20_scalar(quint32* state, uchar* data, qint64 length)
+{
+    uchar block[ChaCha20Poly1305::BlockSize];
+    while(length > 0) {
+        chacha_block(state, block);
+        ++state[12];
+
+        const int bytes = static_cast<int>(qMin<qint64>(length, ChaCha20Poly1305::BlockSize));
+        for(int i = 0; i < bytes; ++i)
+            data[i] ^= block[i];
+
+        data += bytes;
+        length -= bytes;
+    }
+}
+
+#if defined(LSB_X86)
+
+/**
+ * @brief rotate_sse2
+ * @param value
+ * @return
+ *
+ * Rotates each 32-bit lane of @a value to the left by @c Bits bits
+ */
+template<int Bits>
+LSB_TARGET("sse2") static inline __m128i rotate_sse2(const __m128i value)
+{
+    return _mm_or_si128(_mm_slli_epi32(value, Bits), _mm_srli_epi32(value, 32 - Bits));
+}
+
+/**
+ * @brief quarter_round_sse2
+ * @param x
+ * @param a
+ * @param b
+ * @param c
+ * @param d
+ *
+ * Vector version of @c quarter_round(), each lane belongs to a different block
+ */
+LSB_TARGET("sse2") static inline void quarter_round_sse2(__m128i* x, const int a, const int b,
+                                                         const int c, const int d)
+{
+    x[a] = _mm_add_epi32(x[a], x[b]);
+    x[d] = rotate_sse2<16>(_mm_xor_si128(x[d], x[a]));
+    x[c] = _mm_add_epi32(x[c], x[d]);
+    x[b] = rotate_sse2<12>(_mm_xor_si128(x[b], x[c]));
+    x[a] = _mm_add_epi32(x[a], x[b]);
+    x[d] = rotate_sse2<8>(_mm_xor_si128(x[d], x[a]));
+    x[c] = _mm_add_epi32(x[c], x[d]);
+    x[b] = rotate_sse2<7>(_mm_xor_si128(x[b], x[c]));
+}
+
+/**
+ * @brief chacha20_sse2
+ * @param state
+ * @param data
+ * @param length
+ *
+ * SSE2 ChaCha20 kernel, generates four blocks at a time: each vector holds the same word of
+ * four consecutive blocks, which are transposed back to block order before the XOR
+ */
+LSB_TARGET("sse2") static void chacha20_sse2(quint32* state, uchar* data, qint64 length)
+{
+    const int stride = 4 * ChaCha20Poly1305::BlockSize;
+    while(length >= stride) {
+        // Load state, the counter of each lane points to a different block
+        __m128i input[16];
+        __m128i x[16];
+        for(int i = 0; i < 16; ++i)
+            input[i] = _mm_set1_epi32(static_cast<int>(state[i]));
+        input[12] = _mm_add_epi32(input[12], _mm_set_epi32(3, 2, 1, 0));
+        for(int i = 0; i < 16; ++i)
+            x[i] = input[i];
+
+        // Apply rounds
+        for(int i = 0; i < CHACHA_DOUBLE_ROUNDS; ++i) {
+            quarter_round_sse2(x, 0, 4, 8, 12);
+            quarter_round_sse2(x, 1, 5, 9, 13);
+            quarter_round_sse2(x, 2, 6, 10, 14);
+            quarter_round_sse2(x, 3, 7, 11, 15);
+            quarter_round_sse2(x, 0, 5, 10, 15);
+            quarter_round_sse2(x, 1, 6, 11, 12);
+            quarter_round_sse2(x, 2, 7, 8, 13);
+            quarter_round_sse2(x, 3, 4, 9, 14);
+        }
+
+        // Transpose each group of four words & XOR them with the data of each block
+        for(int group = 0; group < 4; ++group) {
+            const __m128i a = _mm_add_epi32(x[4 * group + 0], input[4 * group + 0]);
+            const __m128i b = _mm_add_epi32(x[4 * group + 1], input[4 * group + 1]);
+            const __m128i c = _mm_add_epi32(x[4 * group + 2], input[4 * group + 2]);
+            const __m128i d = _mm_add_epi32(x[4 * group + 3], input[4 * group + 3]);
+            const __m128i ab0 = _mm_unpacklo_epi32(a, b);
+            const __m128i cd0 = _mm_unpacklo_epi32(c, d);
+            const __m128i ab1 = _mm_unpackhi_epi32(a, b);
+            const __m128i cd1 = _mm_unpackhi_epi32(c, d);
+            const __m128i rows[4] = {
+                _mm_unpacklo_epi64(ab0, cd0), _mm_unpackhi_epi64(ab0, cd0),
+                _mm_unpacklo_epi64(ab1, cd1), _mm_unpackhi_epi64(ab1, cd1)
+            };
+
+            for(int block = 0; block < 4; ++block) {
+                __m128i* p = reinterpret_cast<__m128i*>(data + block * 64 + group * 16);
+                _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), rows[block]));
+            }
+        }
+
+        state[12] += 4;
+        data += stride;
+        length -= stride;
+    }
+
+    chacha20_scalar(state, data, length);
+}
+
+/**
+ * @brief rotate_avx2
+ * @param value
+ * @return
+ *
+ * Rotates each 32-bit lane of @a value to the left by @c Bits bits, rotations by whole bytes
+ * are done with a single byte shuffle
+ */
+template<int Bits>
+LSB_TARGET("avx2") static inline __m256i rotate_avx2(const __m256i value)
+{
+    if(Bits == 16) {
+        const __m256i mask = _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+                                              2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+        return _mm256_shuffle_epi8(value, mask);
+    }
+
+    if(Bits == 8) {
+        const __m256i mask = _mm256_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14,
+                                              3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14);
+        return _mm256_shuffle_epi8(value, mask);
+    }
+
+    return _mm256_or_si256(_mm256_slli_epi32(value, Bits), _mm256_srli_epi32(value, 32 - Bits));
+}
+
+/**
+ * @brief quarter_round_avx2
+ * @param x
+ * @param a
+ * @param b
+ * @param c
+ * @param d
+ *
+ * Vector version of @c quarter_round(), each lane belongs to a different block
+ */
+LSB_TARGET("avx2") static inline void quarter_round_avx2(__m256i* x, const int a, const int b,
+                                                         const int c, const int d)
+{
+    x[a] = _mm256_add_epi32(x[a], x[b]);
+    x[d] = rotate_avx2<16>(_mm256_xor_si256(x[d], x[a]));
+    x[c] = _mm256_add_epi32(x[c], x[d]);
+    x[b] = rotate_avx2<12>(_mm256_xor_si256(x[b], x[c]));
+    x[a] = _mm256_add_epi32(x[a], x[b]);
+    x[d] = rotate_avx2<8>(_mm256_xor_si256(x[d], x[a]));
+    x[c] = _mm256_add_epi32(x[c], x[d]);
+    x[b] = rotate_avx2<7>(_mm256_xor_si256(x[b], x[c]));
+}
+
+/**
+ * @brief chacha20_avx2
+ * @param state
+ * @param data
+ * @param length
+ *
+ * AVX2 ChaCha20 kernel, generates eight blocks at a time. The transposition works on each
+ * 128-bit half separately, so the low half yields blocks 0-3 and the high half blocks 4-7.
+ */
+LSB_TARGET("avx2") static void chacha20_avx2(quint32* state, uchar* data, qint64 length)
+{
+    const int stride = 8 * ChaCha20Poly1305::BlockSize;
+    while(length >= stride) {
+        // Load state, the counter of each lane points to a different block
+        __m256i input[16];
+        __m256i x[16];
+        for(int i = 0; i < 16; ++i)
+            input[i] = _mm256_set1_epi32(static_cast<int>(state[i]));
+        input[12] = _mm256_add_epi32(input[12], _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        for(int i = 0; i < 16; ++i)
+            x[i] = input[i];
+
+        // Apply rounds
+        for(int i = 0; i < CHACHA_DOUBLE_ROUNDS; ++i) {
+            quarter_round_avx2(x, 0, 4, 8, 12);
+            quarter_round_avx2(x, 1, 5, 9, 13);
+            quarter_round_avx2(x, 2, 6, 10, 14);
+            quarter_round_avx2(x, 3, 7, 11, 15);
+            quarter_round_avx2(x, 0, 5, 10, 15);
+            quarter_round_avx2(x, 1, 6, 11, 12);
+            quarter_round_avx2(x, 2, 7, 8, 13);
+            quarter_round_avx2(x, 3, 4, 9, 14);
+        }
+
+        // Transpose each group of four words within each 128-bit half
+        __m256i rows[4][4];
+        for(int group = 0; group < 4; ++group) {
+            const __m256i a = _mm256_add_epi32(x[4 * group + 0], input[4 * group + 0]);
+            const __m256i b = _mm256_add_epi32(x[4 * group + 1], input[4 * group + 1]);
+            const __m256i c = _mm256_add_epi32(x[4 * group + 2], input[4 * group + 2]);
+            const __m256i d = _mm256_add_epi32(x[4 * group + 3], input[4 * group + 3]);
+            const __m256i ab0 = _mm256_unpacklo_epi32(a, b);
+            const __m256i cd0 = _mm256_unpacklo_epi32(c, d);
+            const __m256i ab1 = _mm256_unpackhi_epi32(a, b);
+            const __m256i cd1 = _mm256_unpackhi_epi32(c, d);
+            rows[group][0] = _mm256_unpacklo_epi64(ab0, cd0);
+            rows[group][1] = _mm256_unpackhi_epi64(ab0, cd0);
+            rows[group][2] = _mm256_unpacklo_epi64(ab1, cd1);
+            rows[group][3] = _mm256_unpackhi_epi64(ab1, cd1);
+        }
+
+        // Join the halves of each block & XOR them with the data
+        for(int block = 0; block < 4; ++block) {
+            const __m256i keystream[4] = {
+                _mm256_permute2x128_si256(rows[0][block], rows[1][block], 0x20),
+                _mm256_permute2x128_si256(rows[2][block], rows[3][block], 0x20),
+                _mm256_permute2x128_si256(rows[0][block], rows[1][block], 0x31),
+                _mm256_permute2x128_si256(rows[2][block], rows[3][block], 0x31)
+            };
+
+            for(int i = 0; i < 4; ++i) {
+                const int offset = (block + (i / 2) * 4) * 64 + (i % 2) * 32;
+                __m256i* p = reinterpret_cast<__m256i*>(data + offset);
+                _mm256_storeu_si256(p, _mm256_xor_si256(_mm256_loadu_si256(p), keystream[i]));
+            }
+        }
+
+        state[12] += 8;
+        data += stride;
+        length -= stride;
+    }
+
+    chacha20_sse2(state, data, length);
+}
+
+#endif
+
+/**
+ * @brief poly1305_init
+ * @param poly
+ * @param key
+ *
+ * Initializes the Poly1305 state with the given 256-bit one-time @a key
+ */
+static void poly1305_init(Poly1305* poly, const uchar* key)
+{
+    // Clamp r
+    poly->r[0] = (qFromLittleEndian<quint32>(key + 0)) & 0x3ffffff;
+    poly->r[1] = (qFromLittleEndian<quint32>(key + 3) >> 2) & 0x3ffff03;
+    poly->r[2] = (qFromLittleEndian<quint32>(key + 6) >> 4) & 0x3ffc0ff;
+    poly->r[3] = (qFromLittleEndian<quint32>(key + 9) >> 6) & 0x3f03fff;
+    poly->r[4] = (qFromLittleEndian<quint32>(key + 12) >> 8) & 0x00fffff;
+
+    // Save s & reset accumulator
+    for(int i = 0; i < 4; ++i)
+        poly->pad[i] = qFromLittleEndian<quint32>(key + 16 + 4 * i);
+    for(int i = 0; i < 5; ++i)
+        poly->h[i] = 0;
+
+    poly->leftover = 0;
+}
+
+/**
+ * @brief poly1305_blocks
+ * @param poly
+ * @param data
+ * @param length
+ * @param final
+ *
+ * Adds the 16-byte blocks of @a data to the accumulator and multiplies it by r (modulo
+ * 2^130 - 5). The last, padded, block of a message is processed with @a final set to
+ * @c true, so that the 2^128 bit is not added to it.
+ */
+static void poly1305_blocks(Poly1305* poly, const uchar* data, qint64 length, const bool final)
+{
+    const quint32 hibit = final ? 0 : (1 << 24);
+    const quint32 r0 = poly->r[0], r1 = poly->r[1], r2 = poly->r[2];
+    const quint32 r3 = poly->r[3], r4 = poly->r[4];
+    const quint32 s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+    quint32 h0 = poly->h[0], h1 = poly->h[1], h2 = poly->h[2], h3 = poly->h[3];
+    quint32 h4 = poly->h[4];
+
+    while(length >= 16) {
+        // h += m
+        h0 += (qFromLittleEndian<quint32>(data + 0)) & POLY_LIMB_MASK;
+        h1 += (qFromLittleEndian<quint32>(data + 3) >> 2) & POLY_LIMB_MASK;
+        h2 += (qFromLittleEndian<quint32>(data + 6) >> 4) & POLY_LIMB_MASK;
+        h3 += (qFromLittleEndian<quint32>(data + 9) >> 6) & POLY_LIMB_MASK;
+        h4 += (qFromLittleEndian<quint32>(data + 12) >> 8) | hibit;
+
+        // h *= r
+        const quint64 d0 = quint64(h0) * r0 + quint64(h1) * s4 + quint64(h2) * s3 +
+                           quint64(h3) * s2 + quint64(h4) * s1;
+        quint64 d1 = quint64(h0) * r1 + quint64(h1) * r0 + quint64(h2) * s4 +
+                     quint64(h3) * s3 + quint64(h4) * s2;
+        quint64 d2 = quint64(h0) * r2 + quint64(h1) * r1 + quint64(h2) * r0 +
+                     quint64(h3) * s4 + quint64(h4) * s3;
+        quint64 d3 = quint64(h0) * r3 + quint64(h1) * r2 + quint64(h2) * r1 +
+                     quint64(h3) * r0 + quint64(h4) * s4;
+        quint64 d4 = quint64(h0) * r4 + quint64(h1) * r3 + quint64(h2) * r2 +
+                     quint64(h3) * r1 + quint64(h4) * r0;
+
+        // Partial reduction modulo 2^130 - 5
+        quint32 carry = static_cast<quint32>(d0 >> 26);
+        h0 = static_cast<quint32>(d0) & POLY_LIMB_MASK;
+        d1 += carry;
+        carry = static_cast<quint32>(d1 >> 26);
+        h1 = static_cast<quint32>(d1) & POLY_LIMB_MASK;
+        d2 += carry;
+        carry = static_cast<quint32>(d2 >> 26);
+        h2 = static_cast<quint32>(d2) & POLY_LIMB_MASK;
+        d3 += carry;
+        carry = static_cast<quint32>(d3 >> 26);
+        h3 = static_cast<quint32>(d3) & POLY_LIMB_MASK;
+        d4 += carry;
+        carry = static_cast<quint32>(d4 >> 26);
+        h4 = static_cast<quint32>(d4) & POLY_LIMB_MASK;
+        h0 += carry * 5;
+        carry = h0 >> 26;
+        h0 &= POLY_LIMB_MASK;
+        h1 += carry;
+
+        data += 16;
+        length -= 16;
+    }
+
+    poly->h[0] = h0;
+    poly->h[1] = h1;
+    poly->h[2] = h2;
+    poly->h[3] = h3;
+    poly->h[4] = h4;
+}
+
+/**
+ * @brief poly1305_update
+ * @param poly
+ * @param data
+ * @param length
+ *
+ * Adds @a length bytes of @a data to the message being authenticated
+ */
+static void poly1305_update(Poly1305* poly, const uchar* data, qint64 length)
+{
+    // Complete the buffered block
+    if(poly->leftover > 0 && length > 0) {
+        const int bytes = static_cast<int>(qMin<qint64>(16 - poly->leftover, length));
+        memcpy(poly->buffer + poly->leftover, data, static_cast<size_t>(bytes));
+        poly->leftover += bytes;
+        data += bytes;
+        length -= bytes;
+        if(poly->leftover < 16)
+            return;
+
+        poly1305_blocks(poly, poly->buffer, 16, false);
+        poly->leftover = 0;
+    }
+
+    // Process whole blocks & buffer the rest
+    const qint64 whole = length & ~qint64(15);
+    poly1305_blocks(poly, data, whole, false);
+    if(length > whole)
+        memcpy(poly->buffer, data + whole, static_cast<size_t>(length - whole));
+
+    poly->leftover = static_cast<int>(length - whole);
+}
+
+/**
+ * @brief poly1305_pad
+ * @param poly
+ *
+ * Adds zeros to the message until its length is a multiple of 16 (used by the AEAD
+ * construction between the additional data and the ciphertext)
+ */
+static void poly1305_pad(Poly1305* poly)
+{
+    static const uchar zeros[16] = {0};
+    if(poly->leftover > 0)
+        poly1305_update(poly, zeros, 16 - poly->leftover);
+}
+
+/**
+ * @brief poly1305_finish
+ * @param poly
+ * @param tag
+ *
+ * Processes the last block of the message and writes the 16-byte authentication @a tag
+ */
+static void poly1305_finish(Poly1305* poly, uchar* tag)
+{
+    // Process the last (partial) block
+    if(poly->leftover > 0) {
+        poly->buffer[poly->leftover] = 1;
+        for(int i = poly->leftover + 1; i < 16; ++i)
+            poly->buffer[i] = 0;
+
+        poly1305_blocks(poly, poly->buffer, 16, true);
+    }
+
+    // Fully carry h
+    quint32 h0 = poly->h[0], h1 = poly->h[1], h2 = poly->h[2], h3 = poly->h[3];
+    quint32 h4 = poly->h[4];
+    quint32 carry = h1 >> 26;
+    h1 &= POLY_LIMB_MASK;
+    h2 += carry;
+    carry = h2 >> 26;
+    h2 &= POLY_LIMB_MASK;
+    h3 += carry;
+    carry = h3 >> 26;
+    h3 &= POLY_LIMB_MASK;
+    h4 += carry;
+    carry = h4 >> 26;
+    h4 &= POLY_LIMB_MASK;
+    h0 += carry * 5;
+    carry = h0 >> 26;
+    h0 &= POLY_LIMB_MASK;
+    h1 += carry;
+
+    // Compute h + -p
+    quint32 g0 = h0 + 5;
+    carry = g0 >> 26;
+    g0 &= POLY_LIMB_MASK;
+    quint32 g1 = h1 + carry;
+    carry = g1 >> 26;
+    g1 &= POLY_LIMB_MASK;
+    quint32 g2 = h2 + carry;
+    carry = g2 >> 26;
+    g2 &= POLY_LIMB_MASK;
+    quint32 g3 = h3 + carry;
+    carry = g3 >> 26;
+    g3 &= POLY_LIMB_MASK;
+    quint32 g4 = h4 + carry - (1 << 26);
+
+    // Select h if h < p, or h + -p if h >= p (without branches)
+    quint32 mask = (g4 >> 31) - 1;
+    h0 = (h0 & ~mask) | (g0 & mask);
+    h1 = (h1 & ~mask) | (g1 & mask);
+    h2 = (h2 & ~mask) | (g2 & mask);
+    h3 = (h3 & ~mask) | (g3 & mask);
+    h4 = (h4 & ~mask) | (g4 & mask);
+
+    // h = (h + s) % 2^128
+    const quint32 w0 = h0 | (h1 << 26);
+    const quint32 w1 = (h1 >> 6) | (h2 << 20);
+    const quint32 w2 = (h2 >> 12) | (h3 << 14);
+    const quint32 w3 = (h3 >> 18) | (h4 << 8);
+    quint64 f = quint64(w0) + poly->pad[0];
+    qToLittleEndian<quint32>(static_cast<quint32>(f), tag + 0);
+    f = quint64(w1) + poly->pad[1] + (f >> 32);
+    qToLittleEndian<quint32>(static_cast<quint32>(f), tag + 4);
+    f = quint64(w2) + poly->pad[2] + (f >> 32);
+    qToLittleEndian<quint32>(static_cast<quint32>(f), tag + 8);
+    f = quint64(w3) + poly->pad[3] + (f >> 32);
+    qToLittleEndian<quint32>(static_cast<quint32>(f), tag + 12);
+}
+
+/**
+ * @brief aead_tag
+ * @param key
+ * @param nonce
+ * @param aad
+ * @param aadLength
+ * @param ciphertext
+ * @param length
+ * @param tag
+ *
+ * Computes the AEAD authentication @a tag of the given additional data and @a ciphertext,
+ * the Poly1305 key is the first half of the ChaCha20 block with counter zero
+ */
+static void aead_tag(const uchar* key, const uchar* nonce, const uchar* aad, const int aadLength,
+                     const uchar* ciphertext, const qint64 length, uchar* tag)
+{
+    // Generate one-time key
+    quint32 state[16];
+    uchar block[ChaCha20Poly1305::BlockSize];
+    init_state(state, key, nonce, 0);
+    chacha_block(state, block);
+
+    // Authenticate additional data, ciphertext & lengths
+    Poly1305 poly;
+    uchar lengths[16];
+    qToLittleEndian<quint64>(static_cast<quint64>(aadLength), lengths);
+    qToLittleEndian<quint64>(static_cast<quint64>(length), lengths + 8);
+    poly1305_init(&poly, block);
+    poly1305_update(&poly, aad, aadLength);
+    poly1305_pad(&poly);
+    poly1305_update(&poly, ciphertext, length);
+    poly1305_pad(&poly);
+    poly1305_update(&poly, lengths, sizeof(lengths));
+    poly1305_finish(&poly, tag);
+}
+
+/**
+ * @brief ChaCha20Poly1305::bestKernel
+ * @return
+ *
+ * Returns the fastest kernel supported by the CPU, the CPU features are only queried once
+ */
+ChaCha20Poly1305::Kernel ChaCha20Poly1305::bestKernel()
+{
+    static const Kernel kernel = kernelSupported(KernelAVX2) ? KernelAVX2 :
+                                 kernelSupported(KernelSSE2) ? KernelSSE2 : KernelScalar;
+
+    return kernel;
+}
+
+/**
+ * @brief ChaCha20Poly1305::kernelSupported
+ * @param kernel
+ * @return
+ *
+ * Returns @c true if the given @a kernel can be executed by the current CPU
+ */
+bool ChaCha20Poly1305::kernelSupported(const Kernel kernel)
+{
+    switch(kernel) {
+#if defined(LSB_X86)
+    case KernelSSE2:
+        return CpuFeatures::hasSSE2();
+    case KernelAVX2:
+        return CpuFeatures::hasAVX2();
+#endif
+    case KernelScalar:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief ChaCha20Poly1305::chacha20
+ * @param kernel
+ * @param key
+ * @param nonce
+ * @param counter
+ * @param data
+ * @param length
+ *
+ * XORs @a length bytes of @a data with the ChaCha20 keystream of the given 256-bit @a key and
+ * 96-bit @a nonce, starting at the block @a counter. The same call encrypts and decrypts.
+ */
+void ChaCha20Poly1305::chacha20(const Kernel kernel, const uchar* key, const uchar* nonce,
+                                const quint32 counter, uchar* data, const qint64 length)
+{
+    Q_ASSERT(kernelSupported(kernel));
+
+    ChaChaKernel function = chacha20_scalar;
+#if defined(LSB_X86)
+    if(kernel == KernelAVX2)
+        function = chacha20_avx2;
+    else if(kernel == KernelSSE2)
+        function = chacha20_sse2;
+#endif
+
+    quint32 state[16];
+    init_state(state, key, nonce, counter);
+    function(state, data, length);
+}
+
+/**
+ * @brief ChaCha20Poly1305::poly1305
+ * @param key
+ * @param data
+ * @param length
+ * @param tag
+ *
+ * Writes the 16-byte Poly1305 @a tag of the given @a data with the 256-bit one-time @a key
+ */
+void ChaCha20Poly1305::poly1305(const uchar* key, const uchar* data, const qint64 length,
+                                uchar* tag)
+{
+    Poly1305 poly;
+    poly1305_init(&poly, key);
+    poly1305_update(&poly, data, length);
+    poly1305_finish(&poly, tag);
+}
+
+/**
+ * @brief ChaCha20Poly1305::seal
+ * @param key
+ * @param nonce
+ * @param aad
+ * @param aadLength
+ * @param data
+ * @param length
+ * @param tag
+ *
+ * Encrypts @a length bytes of @a data in place and writes the 16-byte authentication @a tag,
+ * which also covers the additional data @a aad (which is not encrypted).
+ *
+ * @warning A nonce must never be used twice with the same key
+ */
+void ChaCha20Poly1305::seal(const uchar* key, const uchar* nonce, const uchar* aad,
+                            const int aadLength, uchar* data, const qint64 length, uchar* tag)
+{
+    chacha20(bestKernel(), key, nonce, 1, data, length);
+    aead_tag(key, nonce, aad, aadLength, data, length, tag);
+}
+
+/**
+ * @brief ChaCha20Poly1305::open
+ * @param key
+ * @param nonce
+ * @param aad
+ * @param aadLength
+ * @param data
+ * @param length
+ * @param tag
+ * @return
+ *
+ * Checks the authentication @a tag of the given ciphertext & additional data and decrypts
+ * @a length bytes of @a data in place. If the tag does not match (wrong key or corrupted
+ * data), @c false is returned and @a data is not modified.
+ */
+bool ChaCha20Poly1305::open(const uchar* key, const uchar* nonce, const uchar* aad,
+                            const int aadLength, uchar* data, const qint64 length,
+                            const uchar* tag)
+{
+    // Compare tags in constant time
+    uchar expected[TagSize];
+    aead_tag(key, nonce, aad, aadLength, data, length, expected);
+    uchar difference = 0;
+    for(int i = 0; i < TagSize; ++i)
+        difference |= expected[i] ^ tag[i];
+
+    if(difference != 0)
+        return false;
+
+    chacha20(bestKernel(), key, nonce, 1, data, length);
+    return true;
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2020 Alex Spataru <https://github.com/alex-spataru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef CHACHA20_POLY1305_H
+#define CHACHA20_POLY1305_H
+
+#include <QtGlobal>
+
+/*
+ * Implements the ChaCha20 stream cipher, the Poly1305 authenticator and their combination
+ * as an AEAD construction (RFC 8439).
+ *
+ * The ChaCha20 keystream is generated by the fastest kernel supported by the CPU: SSE2
+ * computes four blocks at a time and AVX2 computes eight blocks at a time, all kernels
+ * produce exactly the same output. Data is always encrypted/decrypted in place.
+ */
+class ChaCha20Poly1305
+{
+public:
+    enum Kernel {
+        KernelScalar,
+        KernelSSE2,
+        KernelAVX2
+    };
+
+    enum {
+        KeySize = 32,
+        NonceSize = 12,
+        TagSize = 16,
+        BlockSize = 64
+    };
+
+    static Kernel bestKernel();
+    static bool kernelSupported(const Kernel kernel);
+
+    static void chacha20(const Kernel kernel, const uchar* key, const uchar* nonce,
+                         const quint32 counter, uchar* data, const qint64 length);
+    static void poly1305(const uchar* key, const uchar* data, const qint64 length, uchar* tag);
+
+    static void seal(const uchar* key, const uchar* nonce, const uchar* aad,
+                     const int aadLength, uchar* data, const qint64 length, uchar* tag);
+    static bool open(const uchar* key, const uchar* nonce, const uchar* aad,
+                     const int aadLength, uchar* data, const qint64 length, const uchar* tag);
+};
+
+#endif
@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2020 Alex Spataru <https://github.com/alex-spataru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "ChatMessage.h"
+
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QCborStreamReader>
+#include <QCborStreamWriter>
+
+/*
+ * Number of items of the CBOR array (type, file name & data)
+ */
+static const int CBOR_ITEMS = 3;
+
+/*
+ * Names of the message types in the JSON container
+ */
+static const char* JSON_TEXT = "Text";
+static const char* JSON_FILE = "File";
+
+/**
+ * @brief read_cbor_string
+ * @param reader
+ * @param string
+ * @return
+ *
+ * Reads the (possibly chunked) text string at the current position of the @a reader
+ */
+static bool read_cbor_string(QCborStreamReader& reader, QString* string)
+{
+    if(!reader.isString())
+        return false;
+
+    QCborStreamReader::StringResult<QString> result = reader.readString();
+    while(result.status == QCborStreamReader::Ok) {
+        string->append(result.data);
+        result = reader.readString();
+    }
+
+    return result.status == QCborStreamReader::EndOfString;
+}
+
+/**
+ * @brief read_cbor_bytes
+ * @param reader
+ * @param bytes
+ * @return
+ *
+ * Reads the (possibly chunked) byte string at the current position of the @a reader
+ */
+static bool read_cbor_bytes(QCborStreamReader& reader, QByteArray* bytes)
+{
+    if(!reader.isByteArray())
+        return false;
+
+    QCborStreamReader::StringResult<QByteArray> result = reader.readByteArray();
+    while(result.status == QCborStreamReader::Ok) {
+        bytes->append(result.data);
+        result = reader.readByteArray();
+    }
+
+    return result.status == QCborStreamReader::EndOfString;
+}
+
+/**
+ * @brief ChatMessage::ChatMessage
+ *
+ * Creates an invalid message
+ */
+ChatMessage::ChatMessage() :
+    m_type(Invalid)
+{
+}
+
+/**
+ * @brief ChatMessage::ChatMessage
+ * @param type
+ * @param fileName
+ * @param data
+ *
+ * Creates a message of the given @a type, the @a fileName is only used by file messages
+ */
+ChatMessage::ChatMessage(const Type type, const QString& fileName, const QByteArray& data) :
+    m_type(type),
+    m_fileName(fileName),
+    m_data(data)
+{
+}
+
+/**
+ * @brief ChatMessage::isValid
+ * @return
+ *
+ * Returns @c true if the message has a known type
+ */
+bool ChatMessage::isValid() const
+{
+    return m_type == Text || m_type == File;
+}
+
+/**
+ * @brief ChatMessage::type
+ * @return
+ *
+ * Returns the type of the message
+ */
+ChatMessage::Type ChatMessage::type() const
+{
+    return m_type;
+}
+
+/**
+ * @brief ChatMessage::fileName
+ * @return
+ *
+ * Returns the name of the file sent with the message (empty for text messages)
+ */
+QString ChatMessage::fileName() const
+{
+    return m_fileName;
+}
+
+/**
+ * @brief ChatMessage::data
+ * @return
+ *
+ * Returns the text (UTF-8) or the file contents of the message
+ */
+QByteArray ChatMessage::data() const
+{
+    return m_data;
+}
+
+/**
+ * @brief ChatMessage::toCbor
+ * @param reserved
+ * @return
+ *
+ * Returns the CBOR representation of the message, the data is written as a byte string.
+ *
+ * The CBOR data is written after @a reserved zero bytes, so that a header (e.g. the message
+ * envelope) can be written in front of it later on without copying the message.
+ */
+QByteArray ChatMessage::toCbor(const int reserved) const
+{
+    QByteArray cbor(reserved, '\0');
+    cbor.reserve(reserved + m_data.length() + m_fileName.length() * 3 + 32);
+    {
+        QCborStreamWriter writer(&cbor);
+        writer.startArray(CBOR_ITEMS);
+        writer.append(static_cast<quint64>(m_type));
+        writer.append(m_fileName);
+        writer.append(m_data);
+        writer.endArray();
+    }
+
+    return cbor;
+}
+
+/**
+ * @brief ChatMessage::toJson
+ * @return
+ *
+ * Returns the JSON container of the message (with the data encoded in Base64), which is the
+ * format used by older clients
+ */
+QByteArray ChatMessage::toJson() const
+{
+    // Create base64 string
+    QString base64 = QString::fromUtf8(m_data.toBase64());
+
+    // Generate JSON object
+    QJsonObject jsonObject;
+    jsonObject.insert("MessageType", m_type == File ? JSON_FILE : JSON_TEXT);
+    jsonObject.insert("Length", QJsonValue(base64.length()));
+    jsonObject.insert("FileName", m_fileName);
+    jsonObject.insert("Base64", QJsonValue(base64));
+
+    // Return byte array
+    return QJsonDocument(jsonObject).toJson(QJsonDocument::Compact);
+}
+
+/**
+ * @brief ChatMessage::fromCbor
+ * @param cbor
+ * @return
+ *
+ * Reads a message from its CBOR representation, an invalid message is returned if the
+ * data is not a valid message
+ */
+ChatMessage ChatMessage::fromCbor(const QByteArray& cbor)
+{
+    // Check that data is an array with the expected number of items
+    QCborStreamReader reader(cbor);
+    if(reader.lastError() != QCborError::NoError || !reader.isArray())
+        return ChatMessage();
+    if(!reader.isLengthKnown() || reader.length() != CBOR_ITEMS)
+        return ChatMessage();
+
+    // Read message type
+    reader.enterContainer();
+    if(reader.lastError() != QCborError::NoError || !reader.isUnsignedInteger())
+        return ChatMessage();
+
+    const quint64 type = reader.toUnsignedInteger();
+    if(type != Text && type != File)
+        return ChatMessage();
+
+    // Read file name & data
+    QString fileName;
+    QByteArray data;
+    reader.next();
+    if(!read_cbor_string(reader, &fileName) || !read_cbor_bytes(reader, &data))
+        return ChatMessage();
+
+    return ChatMessage(static_cast<Type>(type), fileName, data);
+}
+
+/**
+ * @brief ChatMessage::fromJson
+ * @param json
+ * @return
+ *
+ * Reads a message from its JSON container, an invalid message is returned if the JSON
+ * document is invalid or if the Base64 data does not have the expected length.
+ *
+ * If @a isJson is not null, it is set to @c true if the data is a JSON document (even if it
+ * is not a valid message), so that callers can tell plain text from encrypted data without
+ * parsing it again.
+ */
+ChatMessage ChatMessage::fromJson(const QByteArray& json, bool* isJson)
+{
+    // Obtain JSON document
+    QJsonParseError error;
+    const QJsonDocument document = QJsonDocument::fromJson(json, &error);
+    if(isJson)
+        *isJson = error.error == QJsonParseError::NoError;
+    if(document.isEmpty())
+        return ChatMessage();
+
+    // Get data from JSON object
+    const int length = document.object().value("Length").toInt();
+    const QString fileName = document.object().value("FileName").toString();
+    const QString messageType = document.object().value("MessageType").toString();
+    const QString base64 = document.object().value("Base64").toString();
+
+    // Cancel if size does not match
+    if(length != base64.length() || base64.isEmpty())
+        return ChatMessage();
+
+    // Convert from Base64 to normal data
+    const QByteArray data = QByteArray::fromBase64(base64.toUtf8());
+    if(messageType == JSON_TEXT)
+        return ChatMessage(Text, fileName, data);
+    if(messageType == JSON_FILE)
+        return ChatMessage(File, fileName, data);
+
+    return ChatMessage();
+}
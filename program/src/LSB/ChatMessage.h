@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2020 Alex Spataru <https://github.com/alex-spataru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef CHAT_MESSAGE_H
+#define CHAT_MESSAGE_H
+
+#include <QString>
+#include <QByteArray>
+
+/*
+ * Text message or file exchanged between peers, before it is encrypted and embedded in an
+ * image.
+ *
+ * Messages are encoded as a CBOR array with the message type, the file name and the content
+ * as a raw byte string, so each payload byte costs exactly one byte. The JSON container
+ * (with the content encoded in Base64) is still supported, since it is the only format that
+ * older clients can read & write.
+ */
+class ChatMessage
+{
+public:
+    enum Type {
+        Invalid = 0,
+        Text = 1,
+        File = 2
+    };
+
+    ChatMessage();
+    ChatMessage(const Type type, const QString& fileName, const QByteArray& data);
+
+    bool isValid() const;
+    Type type() const;
+    QString fileName() const;
+    QByteArray data() const;
+
+    QByteArray toCbor(const int reserved = 0) const;
+    QByteArray toJson() const;
+
+    static ChatMessage fromCbor(const QByteArray& cbor);
+    static ChatMessage fromJson(const QByteArray& json, bool* isJson = Q_NULLPTR);
+
+private:
+    Type m_type;
+    QString m_fileName;
+    QByteArray m_data;
+};
+
+#endif
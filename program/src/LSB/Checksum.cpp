@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2020 Alex Spataru <https://github.com/alex-spataru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "Checksum.h"
+#include "CpuFeatures.h"
+
+#include <cstring>
+
+#if defined(LSB_X86)
+    #include <immintrin.h>
+#endif
+
+#if defined(__ARM_FEATURE_CRC32)
+    #include <arm_acle.h>
+#endif
+
+/*
+ * Reversed CRC-32C (Castagnoli) polynomial
+ */
+static const quint32 CRC32C_POLYNOMIAL = 0x82f63b78;
+
+/**
+ * @brief crc32c_table
+ * @return
+ *
+ * Returns the lookup table used by the portable CRC-32C implementation, the table is
+ * generated the first time that this function is called.
+ */
+static const quint32* crc32c_table()
+{
+    static quint32 table[256];
+    static const bool initialized = [] {
+        for(quint32 i = 0; i < 256; ++i) {
+            quint32 crc = i;
+            for(int bit = 0; bit < 8; ++bit)
+                crc = (crc >> 1) ^ (CRC32C_POLYNOMIAL & (0u - (crc & 1)));
+
+            table[i] = crc;
+        }
+
+        return true;
+    }();
+
+    Q_UNUSED(initialized)
+    return table;
+}
+
+/**
+ * @brief crc32c_portable
+ * @param crc
+ * @param data
+ * @param length
+ * @return
+ *
+ * Table-driven CRC-32C implementation, used when the CPU has no CRC32 instruction
+ */
+static quint32 crc32c_portable(quint32 crc, const uchar* data, qint64 length)
+{
+    const quint32* table = crc32c_table();
+    while(length-- > 0)
+        crc = table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+
+    return crc;
+}
+
+#if defined(LSB_X86)
+/**
+ * @brief crc32c_sse42
+ * @param crc
+ * @param data
+ * @param length
+ * @return
+ *
+ * CRC-32C implementation that uses the SSE4.2 CRC32 instruction
+ */
+LSB_TARGET("sse4.2") static quint32 crc32c_sse42(quint32 crc, const uchar* data, qint64 length)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    quint64 crc64 = crc;
+    for(; length >= 8; length -= 8, data += 8) {
+        quint64 value;
+        memcpy(&value, data, sizeof(value));
+        crc64 = _mm_crc32_u64(crc64, value);
+    }
+
+    crc = static_cast<quint32>(crc64);
+#endif
+
+    for(; length >= 4; length -= 4, data += 4) {
+        quint32 value;
+        memcpy(&value, data, sizeof(value));
+        crc = _mm_crc32_u32(crc, value);
+    }
+
+    while(length-- > 0)
+        crc = _mm_crc32_u8(crc, *data++);
+
+    return crc;
+}
+#endif
+
+#if defined(__ARM_FEATURE_CRC32)
+/**
+ * @brief crc32c_armv8
+ * @param crc
+ * @param data
+ * @param length
+ * @return
+ *
+ * CRC-32C implementation that uses the ARMv8 CRC32 instructions
+ */
+static quint32 crc32c_armv8(quint32 crc, const uchar* data, qint64 length)
+{
+    for(; length >= 8; length -= 8, data += 8) {
+        quint64 value;
+        memcpy(&value, data, sizeof(value));
+        crc = __crc32cd(crc, value);
+    }
+
+    while(length-- > 0)
+        crc = __crc32cb(crc, *data++);
+
+    return crc;
+}
+#endif
+
+/**
+ * @brief Checksum::crc32c
+ * @param data
+ * @param length
+ * @param crc
+ * @return
+ *
+ * Calculates the CRC-32C (Castagnoli) checksum of the given @a data. The calculation can be
+ * split in several calls by passing the value returned by the previous call as @a crc.
+ *
+ * The CRC32 instructions of the CPU are used when available (SSE4.2 or ARMv8).
+ */
+quint32 Checksum::crc32c(const void* data, const qint64 length, const quint32 crc)
+{
+    const uchar* bytes = static_cast<const uchar*>(data);
+
+#if defined(__ARM_FEATURE_CRC32)
+    return ~crc32c_armv8(~crc, bytes, length);
+#else
+    #if defined(LSB_X86)
+    if(CpuFeatures::hasSSE42())
+        return ~crc32c_sse42(~crc, bytes, length);
+    #endif
+
+    return ~crc32c_portable(~crc, bytes, length);
+#endif
+}
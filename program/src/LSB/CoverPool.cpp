@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2020 Alex Spataru <https://github.com/alex-spataru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "CoverPool.h"
+
+#include <QThread>
+#include <QMutexLocker>
+#include <QtConcurrent>
+#include <QRandomGenerator>
+
+/*
+ * Standard cover sizes kept in the pool & number of covers kept for each size
+ */
+static const int COVER_SIZES[] = {64, 128, 256, 512, 1024};
+static const int COVERS_PER_SIZE = 2;
+
+/**
+ * @brief CoverPool::CoverPool
+ *
+ * Creates an empty pool, covers are generated with a generator seeded from system entropy
+ * (independent from the one used by @c LSB::generateImage()).
+ */
+CoverPool::CoverPool() :
+    m_stop(false),
+    m_refilling(false),
+    m_generator(QRandomGenerator::system()->generate64())
+{
+    m_threadPool.setMaxThreadCount(1);
+}
+
+/**
+ * @brief CoverPool::~CoverPool
+ *
+ * Stops the worker thread and waits for it to finish
+ */
+CoverPool::~CoverPool()
+{
+    m_mutex.lock();
+    m_stop = true;
+    m_mutex.unlock();
+
+    m_threadPool.waitForDone();
+}
+
+/**
+ * @brief CoverPool::clear
+ *
+ * Releases all the covers stored in the pool
+ */
+void CoverPool::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_covers.clear();
+}
+
+/**
+ * @brief CoverPool::reserve
+ *
+ * Starts generating covers in the background if the pool is not full
+ */
+void CoverPool::reserve()
+{
+    QMutexLocker locker(&m_mutex);
+    if(m_refilling || m_stop)
+        return;
+
+    m_refilling = true;
+    QtConcurrent::run(&m_threadPool, [this]() {
+        refill();
+    });
+}
+
+/**
+ * @brief CoverPool::take
+ * @param size
+ * @return
+ *
+ * Removes the smallest cover that is at least @a size pixels wide from the pool and returns
+ * it cropped to @a size x @a size pixels, afterwards, the pool is refilled in the background.
+ *
+ * A null image is returned if no suitable cover is ready (or if @a size is larger than the
+ * largest standard size), in that case the caller shall generate the cover itself.
+ */
+QImage CoverPool::take(const int size)
+{
+    // Find the smallest cover that fits the requested size
+    QImage cover;
+    m_mutex.lock();
+    for(const int standardSize : COVER_SIZES) {
+        if(standardSize >= size && !m_covers.value(standardSize).isEmpty()) {
+            cover = m_covers[standardSize].takeLast();
+            break;
+        }
+    }
+    m_mutex.unlock();
+
+    // Replace the cover that has been taken
+    reserve();
+
+    // Crop cover to the requested size
+    if(cover.isNull() || cover.width() == size)
+        return cover;
+
+    return cover.copy(0, 0, size, size);
+}
+
+/**
+ * @brief CoverPool::refill
+ *
+ * Generates covers (on the worker thread) until every standard size has the required number
+ * of covers, the smallest sizes are generated first since they are used more often.
+ */
+void CoverPool::refill()
+{
+    QThread::currentThread()->setPriority(QThread::LowestPriority);
+
+    forever {
+        // Find a size that needs more covers
+        int size = 0;
+        m_mutex.lock();
+        for(const int standardSize : COVER_SIZES) {
+            if(m_covers.value(standardSize).count() < COVERS_PER_SIZE) {
+                size = standardSize;
+                break;
+            }
+        }
+
+        // Pool is full (or is being destroyed)
+        if(size == 0 || m_stop) {
+            m_refilling = false;
+            m_mutex.unlock();
+            return;
+        }
+        m_mutex.unlock();
+
+        // Generate cover outside the lock
+        QImage cover(size, size, QImage::Format_RGB32);
+        m_generator.fill(reinterpret_cast<QRgb*>(cover.bits()),
+                         static_cast<qint64>(size) * size);
+
+        // Add cover to the pool
+        m_mutex.lock();
+        m_covers[size].append(cover);
+        m_mutex.unlock();
+    }
+}
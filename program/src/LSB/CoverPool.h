@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2020 Alex Spataru <https://github.com/alex-spataru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef COVER_POOL_H
+#define COVER_POOL_H
+
+#include <QMap>
+#include <QList>
+#include <QMutex>
+#include <QImage>
+#include <QThreadPool>
+
+#include "NoiseGenerator.h"
+
+/*
+ * Keeps a small number of random cover images of a few standard sizes ready to be used,
+ * the pool is refilled by a low-priority worker thread whenever a cover is taken.
+ *
+ * Covers are cropped to the requested size when they are taken, so the images produced by
+ * the LSB module have exactly the same size as if they were generated on demand.
+ */
+class CoverPool
+{
+public:
+    CoverPool();
+    ~CoverPool();
+
+    void clear();
+    void reserve();
+    QImage take(const int size);
+
+private:
+    Q_DISABLE_COPY(CoverPool)
+
+    void refill();
+
+    bool m_stop;
+    bool m_refilling;
+    QMutex m_mutex;
+    NoiseGenerator m_generator;
+    QThreadPool m_threadPool;
+    QMap<int, QList<QImage>> m_covers;
+};
+
+#endif
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2020 Alex Spataru <https://github.com/alex-spataru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "CpuFeatures.h"
+
+#if defined(LSB_X86)
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+    #else
+        #include <cpuid.h>
+    #endif
+#endif
+
+/*
+ * Feature bits reported by the CPUID instruction
+ */
+#define CPUID_1_EDX_SSE2    (1 << 26)
+#define CPUID_1_ECX_SSE42   (1 << 20)
+#define CPUID_1_ECX_OSXSAVE (1 << 27)
+#define CPUID_1_ECX_AVX     (1 << 28)
+#define CPUID_7_EBX_AVX2    (1 << 5)
+
+/**
+ * @brief cpuid
+ * @param leaf
+ * @param regs
+ *
+ * Executes the CPUID instruction with the given @a leaf (and sub-leaf 0) and writes the
+ * values of the EAX, EBX, ECX and EDX registers to @a regs. If CPUID is not available, all
+ * registers are set to zero.
+ */
+static void cpuid(const unsigned int leaf, unsigned int regs[4])
+{
+    regs[0] = regs[1] = regs[2] = regs[3] = 0;
+
+#if defined(LSB_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuidex(info, static_cast<int>(leaf), 0);
+    for(int i = 0; i < 4; ++i)
+        regs[i] = static_cast<unsigned int>(info[i]);
+#elif defined(LSB_X86)
+    if(leaf <= __get_cpuid_max(0, nullptr))
+        __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#else
+    (void) leaf;
+#endif
+}
+
+/**
+ * @brief os_saves_ymm_registers
+ * @return
+ *
+ * Returns @c true if the operating system preserves the state of the AVX (YMM) registers
+ * when switching between threads, which is required to use AVX/AVX2 instructions.
+ */
+static bool os_saves_ymm_registers()
+{
+#if defined(LSB_X86)
+    unsigned int regs[4];
+    cpuid(1, regs);
+    if(!(regs[2] & CPUID_1_ECX_OSXSAVE) || !(regs[2] & CPUID_1_ECX_AVX))
+        return false;
+
+    #if defined(_MSC_VER)
+    const unsigned long long xcr0 = _xgetbv(0);
+    #else
+    unsigned int eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    const unsigned long long xcr0 = (static_cast<unsigned long long>(edx) << 32) | eax;
+    #endif
+
+    return (xcr0 & 0x6) == 0x6;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief CpuFeatures::hasSSE2
+ * @return
+ *
+ * Returns @c true if the CPU supports the SSE2 instruction set
+ */
+bool CpuFeatures::hasSSE2()
+{
+    static const bool supported = [] {
+        unsigned int regs[4];
+        cpuid(1, regs);
+        return (regs[3] & CPUID_1_EDX_SSE2) != 0;
+    }();
+
+    return supported;
+}
+
+/**
+ * @brief CpuFeatures::hasSSE42
+ * @return
+ *
+ * Returns @c true if the CPU supports the SSE4.2 instruction set (which includes the
+ * CRC32C instruction)
+ */
+bool CpuFeatures::hasSSE42()
+{
+    static const bool supported = [] {
+        unsigned int regs[4];
+        cpuid(1, regs);
+        return (regs[2] & CPUID_1_ECX_SSE42) != 0;
+    }();
+
+    return supported;
+}
+
+/**
+ * @brief CpuFeatures::hasAVX2
+ * @return
+ *
+ * Returns @c true if both the CPU and the operating system support the AVX2 instruction set
+ */
+bool CpuFeatures::hasAVX2()
+{
+    static const bool supported = [] {
+        unsigned int regs[4];
+        cpuid(7, regs);
+        return (regs[1] & CPUID_7_EBX_AVX2) && os_saves_ymm_registers();
+    }();
+
+    return supported;
+}
@@ -21,18 +21,659 @@
  */
 
 #include "Crypto.h"
+#include "AeadStream.h"
+#include "CpuFeatures.h"
 
-/*
- * Quick and dirty min() implementation
- */
-#define min(x,y) x > y ? x : y
+#include <QThread>
+#include <QVector>
+#include <QFuture>
+#include <QAtomicInt>
+#include <QtConcurrent>
+#include <QPasswordDigestor>
+#include <QMessageAuthenticationCode>
+
+#if defined(LSB_X86)
+    #include <immintrin.h>
+#endif
 
 /*
  * Define ASCII alphabet for Caesar cypher
  */
 #define ALPHABET_START  33
 #define ALPHABET_END    126
-#define ALPHABET_SIZE   ALPHABET_END - ALPHABET_START
+#define ALPHABET_SIZE   (ALPHABET_END - ALPHABET_START)
+
+/*
+ * Number of bytes of the longest vector register used by the kernels, the expanded key
+ * pattern is padded with this many bytes so that vector loads never need a modulo
+ */
+static const int PATTERN_PADDING = 32;
+
+/*
+ * Buffers larger than this are split in bands of (at least) this size, which are processed
+ * in parallel. The key phase of each band is derived from its offset, so the output does not
+ * depend on the number of bands.
+ */
+static const int PARALLEL_BAND_BYTES = 1024 * 1024;
+
+/*
+ * Maximum number of threads used to process large buffers (zero uses all CPU cores)
+ */
+static QAtomicInt THREAD_COUNT(0);
+
+/*
+ * Parameters of the password-based key derivation (PBKDF2-HMAC-SHA256) used by the sealed
+ * (ChaCha20-Poly1305) mode. The salt is fixed because both peers must derive the same key
+ * from the password alone, the random nonce of each stream keeps messages unique.
+ */
+static const char KDF_SALT[] = "LSB-Chat";
+static const int KDF_ITERATIONS = 100000;
+static const int KDF_KEY_SIZE = 32;
+
+/*
+ * Label of the subkey used by the scatter layout, derived from the sealed key with
+ * HMAC-SHA256 so that both keys are independent
+ */
+static const char SCATTER_KEY_LABEL[] = "LSB-Chat scatter layout";
+
+/*
+ * Signature of the fused Caesar + XOR kernels, @a input and @a output may point to the same
+ * buffer (in-place processing)
+ */
+typedef void (*CipherKernel)(const uchar* input, uchar* output, const qint64 length,
+                             const uchar* pattern, const int keyLength, int phase,
+                             const int shift);
+
+/**
+ * @brief caesar_shift
+ * @param key
+ * @return
+ *
+ * Returns the rotation applied by the Caesar cypher for the given @a key. Messages have always
+ * been encrypted with the larger of the key length and the alphabet size (93), so this is
+ * kept as-is to remain compatible with older versions of the program.
+ */
+static int caesar_shift(const QByteArray& key)
+{
+    return qMax(key.length(), ALPHABET_SIZE);
+}
+
+/**
+ * @brief key_pattern
+ * @param key
+ * @return
+ *
+ * Returns the @a key repeated to fill its length plus PATTERN_PADDING bytes, so that the
+ * key bytes for any position can be read with a single (vector) load from the pattern
+ */
+static QByteArray key_pattern(const QByteArray& key)
+{
+    Q_ASSERT(!key.isEmpty());
+
+    QByteArray pattern(key.length() + PATTERN_PADDING, Qt::Uninitialized);
+    for(int i = 0; i < pattern.length(); ++i)
+        pattern[i] = key.at(i % key.length());
+
+    return pattern;
+}
+
+/**
+ * @brief encrypt_scalar
+ * @param input
+ * @param output
+ * @param length
+ * @param pattern
+ * @param keyLength
+ * @param phase
+ * @param shift
+ *
+ * Reference implementation of the cypher: rotates printable characters by @a shift positions
+ * within the alphabet and XORs the result with the key, in a single pass. The key byte used
+ * for the first byte is the one found at the given @a phase of the key @a pattern.
+ */
+static void encrypt_scalar(const uchar* input, uchar* output, const qint64 length,
+                           const uchar* pattern, const int keyLength, int phase,
+                           const int shift)
+{
+    for(qint64 i = 0; i < length; ++i) {
+        // Get byte (we use int to handle ASCII-table overflow)
+        int byte = static_cast<signed char>(input[i]);
+
+        // Only encrypt alphabet characters, ensure byte is valid ASCII character
+        if(byte >= ALPHABET_START && byte <= ALPHABET_END) {
+            byte += shift;
+            if(byte > ALPHABET_END)
+                byte = byte - ALPHABET_END + ALPHABET_START - 1;
+        }
+
+        // XOR with the key
+        output[i] = static_cast<uchar>(byte) ^ pattern[phase];
+        if(++phase == keyLength)
+            phase = 0;
+    }
+}
+
+/**
+ * @brief decrypt_scalar
+ * @param input
+ * @param output
+ * @param length
+ * @param pattern
+ * @param keyLength
+ * @param phase
+ * @param shift
+ *
+ * Inverse of @c encrypt_scalar(), XORs each byte with the key and rotates printable
+ * characters back to their original position
+ */
+static void decrypt_scalar(const uchar* input, uchar* output, const qint64 length,
+                           const uchar* pattern, const int keyLength, int phase,
+                           const int shift)
+{
+    for(qint64 i = 0; i < length; ++i) {
+        // XOR with the key
+        int byte = static_cast<signed char>(input[i] ^ pattern[phase]);
+        if(++phase == keyLength)
+            phase = 0;
+
+        // Only decipher alphabet characters, ensure byte is valid ASCII character
+        if(byte >= ALPHABET_START && byte <= ALPHABET_END) {
+            byte -= shift;
+            if(byte < ALPHABET_START)
+                byte = byte + ALPHABET_END - ALPHABET_START + 1;
+        }
+
+        output[i] = static_cast<uchar>(byte);
+    }
+}
+
+/*
+ * The vector kernels work with 8-bit lanes, so the rotation is split in two parts:
+ *
+ * - Alphabet characters are moved by the low byte of the shift (modulo 256, like the char
+ *   conversion of the scalar code).
+ * - The alphabet size plus one (94) is subtracted/added back when the character overflows
+ *   the alphabet. Since the shift is never smaller than 93, this happens for every alphabet
+ *   character, except for the bounds of the alphabet when the shift is exactly 93. Comparing
+ *   against a threshold computed from the shift reproduces the scalar results exactly.
+ */
+
+/**
+ * @brief encrypt_threshold
+ * @param shift
+ * @return
+ *
+ * Returns the value above which an alphabet character overflows when rotated by @a shift
+ */
+static inline int encrypt_threshold(const int shift)
+{
+    return ALPHABET_END - qMin(shift, ALPHABET_SIZE + 1);
+}
+
+/**
+ * @brief decrypt_threshold
+ * @param shift
+ * @return
+ *
+ * Returns the value below which an alphabet character underflows when rotated by @a shift
+ */
+static inline int decrypt_threshold(const int shift)
+{
+    return ALPHABET_START + qMin(shift, ALPHABET_SIZE + 1);
+}
+
+#if defined(LSB_X86)
+
+/**
+ * @brief encrypt_sse2
+ * @param input
+ * @param output
+ * @param length
+ * @param pattern
+ * @param keyLength
+ * @param phase
+ * @param shift
+ *
+ * SSE2 version of @c encrypt_scalar(), processes 16 bytes per iteration
+ */
+LSB_TARGET("sse2") static void encrypt_sse2(const uchar* input, uchar* output,
+                                            const qint64 length, const uchar* pattern,
+                                            const int keyLength, int phase, const int shift)
+{
+    const __m128i start = _mm_set1_epi8(ALPHABET_START - 1);
+    const __m128i end = _mm_set1_epi8(ALPHABET_END + 1);
+    const __m128i threshold = _mm_set1_epi8(static_cast<char>(encrypt_threshold(shift)));
+    const __m128i move = _mm_set1_epi8(static_cast<char>(shift));
+    const __m128i wrap = _mm_set1_epi8(ALPHABET_SIZE + 1);
+
+    qint64 i = 0;
+    for(; i + 16 <= length; i += 16) {
+        const __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+        const __m128i key = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern + phase));
+
+        // Rotate alphabet characters
+        const __m128i alphabet = _mm_and_si128(_mm_cmpgt_epi8(data, start),
+                                               _mm_cmpgt_epi8(end, data));
+        const __m128i overflow = _mm_and_si128(alphabet, _mm_cmpgt_epi8(data, threshold));
+        __m128i value = _mm_add_epi8(data, _mm_and_si128(alphabet, move));
+        value = _mm_sub_epi8(value, _mm_and_si128(overflow, wrap));
+
+        // XOR with the key
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm_xor_si128(value, key));
+        phase += 16;
+        if(phase >= keyLength)
+            phase %= keyLength;
+    }
+
+    encrypt_scalar(input + i, output + i, length - i, pattern, keyLength, phase, shift);
+}
+
+/**
+ * @brief decrypt_sse2
+ * @param input
+ * @param output
+ * @param length
+ * @param pattern
+ * @param keyLength
+ * @param phase
+ * @param shift
+ *
+ * SSE2 version of @c decrypt_scalar(), processes 16 bytes per iteration
+ */
+LSB_TARGET("sse2") static void decrypt_sse2(const uchar* input, uchar* output,
+                                            const qint64 length, const uchar* pattern,
+                                            const int keyLength, int phase, const int shift)
+{
+    const __m128i start = _mm_set1_epi8(ALPHABET_START - 1);
+    const __m128i end = _mm_set1_epi8(ALPHABET_END + 1);
+    const __m128i threshold = _mm_set1_epi8(static_cast<char>(decrypt_threshold(shift)));
+    const __m128i move = _mm_set1_epi8(static_cast<char>(shift));
+    const __m128i wrap = _mm_set1_epi8(ALPHABET_SIZE + 1);
+
+    qint64 i = 0;
+    for(; i + 16 <= length; i += 16) {
+        const __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+        const __m128i key = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern + phase));
+
+        // XOR with the key
+        const __m128i value = _mm_xor_si128(data, key);
+
+        // Rotate alphabet characters back
+        const __m128i alphabet = _mm_and_si128(_mm_cmpgt_epi8(value, start),
+                                               _mm_cmpgt_epi8(end, value));
+        const __m128i underflow = _mm_and_si128(alphabet, _mm_cmpgt_epi8(threshold, value));
+        __m128i result = _mm_sub_epi8(value, _mm_and_si128(alphabet, move));
+        result = _mm_add_epi8(result, _mm_and_si128(underflow, wrap));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), result);
+        phase += 16;
+        if(phase >= keyLength)
+            phase %= keyLength;
+    }
+
+    decrypt_scalar(input + i, output + i, length - i, pattern, keyLength, phase, shift);
+}
+
+/**
+ * @brief encrypt_avx2
+ * @param input
+ * @param output
+ * @param length
+ * @param pattern
+ * @param keyLength
+ * @param phase
+ * @param shift
+ *
+ * AVX2 version of @c encrypt_scalar(), processes 32 bytes per iteration
+ */
+LSB_TARGET("avx2") static void encrypt_avx2(const uchar* input, uchar* output,
+                                            const qint64 length, const uchar* pattern,
+                                            const int keyLength, int phase, const int shift)
+{
+    const __m256i start = _mm256_set1_epi8(ALPHABET_START - 1);
+    const __m256i end = _mm256_set1_epi8(ALPHABET_END + 1);
+    const __m256i threshold = _mm256_set1_epi8(static_cast<char>(encrypt_threshold(shift)));
+    const __m256i move = _mm256_set1_epi8(static_cast<char>(shift));
+    const __m256i wrap = _mm256_set1_epi8(ALPHABET_SIZE + 1);
+
+    qint64 i = 0;
+    for(; i + 32 <= length; i += 32) {
+        const __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + i));
+        const __m256i key = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pattern + phase));
+
+        // Rotate alphabet characters
+        const __m256i alphabet = _mm256_and_si256(_mm256_cmpgt_epi8(data, start),
+                                                  _mm256_cmpgt_epi8(end, data));
+        const __m256i overflow = _mm256_and_si256(alphabet, _mm256_cmpgt_epi8(data, threshold));
+        __m256i value = _mm256_add_epi8(data, _mm256_and_si256(alphabet, move));
+        value = _mm256_sub_epi8(value, _mm256_and_si256(overflow, wrap));
+
+        // XOR with the key
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + i),
+                            _mm256_xor_si256(value, key));
+        phase += 32;
+        if(phase >= keyLength)
+            phase %= keyLength;
+    }
+
+    encrypt_sse2(input + i, output + i, length - i, pattern, keyLength, phase, shift);
+}
+
+/**
+ * @brief decrypt_avx2
+ * @param input
+ * @param output
+ * @param length
+ * @param pattern
+ * @param keyLength
+ * @param phase
+ * @param shift
+ *
+ * AVX2 version of @c decrypt_scalar(), processes 32 bytes per iteration
+ */
+LSB_TARGET("avx2") static void decrypt_avx2(const uchar* input, uchar* output,
+                                            const qint64 length, const uchar* pattern,
+                                            const int keyLength, int phase, const int shift)
+{
+    const __m256i start = _mm256_set1_epi8(ALPHABET_START - 1);
+    const __m256i end = _mm256_set1_epi8(ALPHABET_END + 1);
+    const __m256i threshold = _mm256_set1_epi8(static_cast<char>(decrypt_threshold(shift)));
+    const __m256i move = _mm256_set1_epi8(static_cast<char>(shift));
+    const __m256i wrap = _mm256_set1_epi8(ALPHABET_SIZE + 1);
+
+    qint64 i = 0;
+    for(; i + 32 <= length; i += 32) {
+        const __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + i));
+        const __m256i key = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pattern + phase));
+
+        // XOR with the key
+        const __m256i value = _mm256_xor_si256(data, key);
+
+        // Rotate alphabet characters back
+        const __m256i alphabet = _mm256_and_si256(_mm256_cmpgt_epi8(value, start),
+                                                  _mm256_cmpgt_epi8(end, value));
+        const __m256i underflow = _mm256_and_si256(alphabet,
+                                                   _mm256_cmpgt_epi8(threshold, value));
+        __m256i result = _mm256_sub_epi8(value, _mm256_and_si256(alphabet, move));
+        result = _mm256_add_epi8(result, _mm256_and_si256(underflow, wrap));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + i), result);
+        phase += 32;
+        if(phase >= keyLength)
+            phase %= keyLength;
+    }
+
+    decrypt_sse2(input + i, output + i, length - i, pattern, keyLength, phase, shift);
+}
+
+#endif
+
+/**
+ * @brief encrypt_kernel
+ * @param kernel
+ * @return
+ *
+ * Returns the encryption function that implements the given @a kernel
+ */
+static CipherKernel encrypt_kernel(const Crypto::Kernel kernel)
+{
+#if defined(LSB_X86)
+    if(kernel == Crypto::KernelAVX2)
+        return encrypt_avx2;
+    else if(kernel == Crypto::KernelSSE2)
+        return encrypt_sse2;
+#else
+    Q_UNUSED(kernel);
+#endif
+
+    return encrypt_scalar;
+}
+
+/**
+ * @brief decrypt_kernel
+ * @param kernel
+ * @return
+ *
+ * Returns the decryption function that implements the given @a kernel
+ */
+static CipherKernel decrypt_kernel(const Crypto::Kernel kernel)
+{
+#if defined(LSB_X86)
+    if(kernel == Crypto::KernelAVX2)
+        return decrypt_avx2;
+    else if(kernel == Crypto::KernelSSE2)
+        return decrypt_sse2;
+#else
+    Q_UNUSED(kernel);
+#endif
+
+    return decrypt_scalar;
+}
+
+/**
+ * @brief run_kernel
+ * @param function
+ * @param input
+ * @param output
+ * @param length
+ * @param context
+ * @param offset
+ *
+ * Processes @a length bytes of @a input to @a output with the given kernel @a function, where
+ * @a offset is the position of the first byte within the whole message (it selects the key
+ * byte used for the first byte, so a message can be processed in several parts).
+ */
+static void run_kernel(CipherKernel function, const char* input, char* output,
+                       const qint64 length, const CryptoContext& context, const qint64 offset)
+{
+    Q_ASSERT(!context.isEmpty());
+    Q_ASSERT(offset >= 0);
+
+    // Processes a band of the buffer, its position selects the first key byte
+    const int shift = context.shift();
+    const int keyLength = context.key().length();
+    const uchar* pattern = reinterpret_cast<const uchar*>(context.pattern().constData());
+    const auto band = [=](const qint64 first, const qint64 count) {
+        function(reinterpret_cast<const uchar*>(input + first),
+                 reinterpret_cast<uchar*>(output + first), count, pattern, keyLength,
+                 static_cast<int>((offset + first) % keyLength), shift);
+    };
+
+    // Calculate number of bands
+    const qint64 maxBands = qMin<qint64>(Crypto::threadCount(), length / PARALLEL_BAND_BYTES);
+    const int bands = static_cast<int>(qBound<qint64>(1, maxBands, 256));
+    if(bands == 1) {
+        band(0, length);
+        return;
+    }
+
+    // Process bands in parallel (band size is a multiple of the widest vector)
+    qint64 bandBytes = (length + bands - 1) / bands;
+    bandBytes = (bandBytes + PATTERN_PADDING - 1) / PATTERN_PADDING * PATTERN_PADDING;
+    QVector<QFuture<void>> futures;
+    for(qint64 first = bandBytes; first < length; first += bandBytes) {
+        const qint64 count = qMin(bandBytes, length - first);
+        futures.append(QtConcurrent::run([=]() {
+            band(first, count);
+        }));
+    }
+
+    // Process first band on the calling thread & wait for the rest
+    band(0, qMin(bandBytes, length));
+    for(int i = 0; i < futures.count(); ++i)
+        futures[i].waitForFinished();
+}
+
+/**
+ * @brief CryptoContext::CryptoContext
+ *
+ * Creates an empty context, which cannot be used to encrypt or decrypt data
+ */
+CryptoContext::CryptoContext() :
+    m_shift(0)
+{
+}
+
+/**
+ * @brief CryptoContext::CryptoContext
+ * @param password
+ *
+ * Builds the key schedule of the given @a password (the sealed key is derived on first use)
+ */
+CryptoContext::CryptoContext(const QByteArray& password) :
+    m_shift(0),
+    m_key(password)
+{
+    if(!password.isEmpty()) {
+        m_shift = caesar_shift(password);
+        m_pattern = key_pattern(password);
+    }
+}
+
+/**
+ * @brief CryptoContext::isEmpty
+ * @return
+ *
+ * Returns @c true if the context was built without a password
+ */
+bool CryptoContext::isEmpty() const
+{
+    return m_key.isEmpty();
+}
+
+/**
+ * @brief CryptoContext::shift
+ * @return
+ *
+ * Returns the Caesar shift of the legacy cipher
+ */
+int CryptoContext::shift() const
+{
+    return m_shift;
+}
+
+/**
+ * @brief CryptoContext::key
+ * @return
+ *
+ * Returns the password (the XOR key of the legacy cipher)
+ */
+const QByteArray& CryptoContext::key() const
+{
+    return m_key;
+}
+
+/**
+ * @brief CryptoContext::pattern
+ * @return
+ *
+ * Returns the XOR key repeated (and padded) so that the kernels never need a modulo
+ */
+const QByteArray& CryptoContext::pattern() const
+{
+    return m_pattern;
+}
+
+/**
+ * @brief CryptoContext::sealKey
+ * @return
+ *
+ * Returns the 256-bit key of the sealed mode, the slow KDF only runs the first time this
+ * function is called.
+ */
+const QByteArray& CryptoContext::sealKey() const
+{
+    Q_ASSERT(!isEmpty());
+
+    if(m_sealKey.isEmpty())
+        m_sealKey = Crypto::deriveKey(m_key);
+
+    return m_sealKey;
+}
+
+/**
+ * @brief CryptoContext::scatterKey
+ * @return
+ *
+ * Returns the key of the scatter layout (see @c ScatterLayout). It is derived from the output
+ * of the slow KDF, so images do not allow to check a password guess without running it.
+ */
+const QByteArray& CryptoContext::scatterKey() const
+{
+    Q_ASSERT(!isEmpty());
+
+    if(m_scatterKey.isEmpty()) {
+        m_scatterKey = QMessageAuthenticationCode::hash(QByteArray(SCATTER_KEY_LABEL), sealKey(),
+                                                        QCryptographicHash::Sha256);
+    }
+
+    return m_scatterKey;
+}
+
+/**
+ * @brief Crypto::bestKernel
+ * @return
+ *
+ * Returns the fastest kernel supported by the CPU, the CPU features are only queried once
+ */
+Crypto::Kernel Crypto::bestKernel()
+{
+    static const Kernel kernel = kernelSupported(KernelAVX2) ? KernelAVX2 :
+                                 kernelSupported(KernelSSE2) ? KernelSSE2 : KernelScalar;
+
+    return kernel;
+}
+
+/**
+ * @brief Crypto::kernelSupported
+ * @param kernel
+ * @return
+ *
+ * Returns @c true if the given @a kernel can be executed by the current CPU
+ */
+bool Crypto::kernelSupported(const Kernel kernel)
+{
+    switch(kernel) {
+#if defined(LSB_X86)
+    case KernelSSE2:
+        return CpuFeatures::hasSSE2();
+    case KernelAVX2:
+        return CpuFeatures::hasAVX2();
+#endif
+    case KernelScalar:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Crypto::threadCount
+ * @return
+ *
+ * Returns the maximum number of threads used to encrypt/decrypt large buffers
+ */
+int Crypto::threadCount()
+{
+    const int threads = THREAD_COUNT.loadAcquire();
+    if(threads <= 0)
+        return QThread::idealThreadCount();
+
+    return threads;
+}
+
+/**
+ * @brief Crypto::setThreadCount
+ * @param threads
+ *
+ * Changes the maximum number of @a threads used to encrypt/decrypt large buffers, a value of
+ * zero (the default) uses one thread per CPU core. Buffers are split in independent bands
+ * (or chunks in the sealed mode), so the output is the same for any number of threads.
+ */
+void Crypto::setThreadCount(const int threads)
+{
+    THREAD_COUNT.storeRelease(qMax(0, threads));
+}
 
 /**
  * @brief Crypto::encryptData
@@ -45,6 +686,9 @@
  *   -# With the length of the key, we execute a Caesar cypher on printable characters of the
  *      given @a data
  *   -# With the given key, we execute a XOR cypher on the output of the Caesar cypher
+ *
+ * Both steps are done in a single pass by the fastest kernel available, writing directly to
+ * an output buffer that is allocated once.
  */
 QByteArray Crypto::encryptData(const QByteArray& data, const QByteArray& key, CryptoError* error)
 {
@@ -57,46 +701,11 @@ QByteArray Crypto::encryptData(const QByteArray& data, const QByteArray& key, Cr
         return data;
     }
 
-    // Init. variables & reset error state
-    QByteArray caesar;
-    QByteArray xorData;
+    // Reset error state & encrypt data
     *error = kNoError;
-
-    // Execute Caesar cipher with length of key over whole ASCII table
-    {
-        // Get key length
-        int k = min(key.length(), ALPHABET_SIZE);
-
-        // Rotate each individual byte of the data
-        for (int i = 0; i < data.length(); ++i) {
-            // Get byte (we use int to handle ASCII-table overflow)
-            int byte = static_cast<int>(data.at(i));
-
-            // Only encrypt alphabet characters
-            if (byte >= ALPHABET_START && byte <= ALPHABET_END) {
-                // Move byte
-                byte += k;
-
-                // Ensure byte is valid ASCII character
-                if (byte > ALPHABET_END)
-                    byte = byte - ALPHABET_END + ALPHABET_START - 1;
-            }
-
-            // Add obtained byte to encrypted data array
-            caesar.append(static_cast<char>(byte));
-        }
-    }
-
-    // Execute XOR cipher on Caesar output
-    int k = key.length();
-    for (int i = 0; i < caesar.length(); ++i) {
-        char byte = caesar.at(i);
-        byte ^= key.at(i % k);
-        xorData.append(byte);
-    }
-
-    // Return output
-    return xorData;
+    QByteArray output(data.length(), Qt::Uninitialized);
+    encrypt(bestKernel(), data.constData(), output.data(), data.length(), key);
+    return output;
 }
 
 /**
@@ -110,6 +719,8 @@ QByteArray Crypto::encryptData(const QByteArray& data, const QByteArray& key, Cr
  *   -# We execute a XOR cypher between the @a data and the @a key to obtain the original
  *      Caesar cypher
  *   -# We execute inverse Caesar algorithm to obtain original data
+ *
+ * Both steps are done in a single pass by the fastest kernel available.
  */
 QByteArray Crypto::decryptData(const QByteArray& data, const QByteArray& key, CryptoError* error)
 {
@@ -122,45 +733,242 @@ QByteArray Crypto::decryptData(const QByteArray& data, const QByteArray& key, Cr
         return data;
     }
 
-    // Init. variables & reset error state
-    QByteArray caesar;
-    QByteArray xorData;
+    // Reset error state & decrypt data
     *error = kNoError;
+    QByteArray output(data.length(), Qt::Uninitialized);
+    decrypt(bestKernel(), data.constData(), output.data(), data.length(), key);
+    return output;
+}
 
-    // Execute XOR cipher on encrypted data to decrypt
-    int k = key.length();
-    for (int i = 0; i < data.length(); ++i) {
-        char byte = data.at(i);
-        byte ^= key.at(i % k);
-        xorData.append(byte);
-    }
-
-    // Caesar De-cipher
-    {
-        // Get key length
-        int k = min(key.length(), ALPHABET_SIZE);
-
-        // Special cases (obtained while testing crypto/decrypt)
-        // Restore original position of each byte
-        for (int i = 0; i < xorData.length(); ++i) {
-            // Get byte (use int. to manage cases where the byte has rotated the entire table)
-            int byte = static_cast<int>(xorData.at(i));
-
-            // Only decipher alphabet characters
-            if (byte >= ALPHABET_START && byte <= ALPHABET_END) {
-                // Move byte to original position
-                byte -= k;
-
-                // Ensure byte is valid ASCII character
-                if (byte < ALPHABET_START)
-                    byte = byte + ALPHABET_END - ALPHABET_START + 1;
-            }
-
-            // Add obtained byte to decrypted data array
-            caesar.append(static_cast<char>(byte));
-        }
+/**
+ * @brief Crypto::encryptInPlace
+ * @param data
+ * @param length
+ * @param key
+ * @param error
+ * @param offset
+ *
+ * Encrypts @a length bytes of the caller-owned buffer @a data in place, producing the same
+ * bytes as @c encryptData() without allocating or copying anything.
+ *
+ * The @a offset is the position of @a data within the whole message, so that a message can
+ * be encrypted in several parts (e.g. while it is being read) and still be decrypted at once,
+ * and vice versa.
+ *
+ * If the @a key is empty, @a error is set to @c kPasswordEmpty and @a data is not modified.
+ */
+void Crypto::encryptInPlace(char* data, const qint64 length, const QByteArray& key,
+                            CryptoError* error, const qint64 offset)
+{
+    encryptInPlace(data, length, CryptoContext(key), error, offset);
+}
+
+/**
+ * @brief Crypto::decryptInPlace
+ * @param data
+ * @param length
+ * @param key
+ * @param error
+ * @param offset
+ *
+ * Decrypts @a length bytes of the caller-owned buffer @a data in place, in the same way as
+ * @c encryptInPlace().
+ */
+void Crypto::decryptInPlace(char* data, const qint64 length, const QByteArray& key,
+                            CryptoError* error, const qint64 offset)
+{
+    decryptInPlace(data, length, CryptoContext(key), error, offset);
+}
+
+/**
+ * @brief Crypto::encryptInPlace
+ * @param data
+ * @param length
+ * @param context
+ * @param error
+ * @param offset
+ *
+ * Same as @c encryptInPlace(), but uses the key schedule of an existing @a context instead of
+ * building it for each call.
+ *
+ * If the @a context is empty, @a error is set to @c kPasswordEmpty and @a data is not modified.
+ */
+void Crypto::encryptInPlace(char* data, const qint64 length, const CryptoContext& context,
+                            CryptoError* error, const qint64 offset)
+{
+    Q_ASSERT(error);
+
+    if(context.isEmpty()) {
+        *error = kPasswordEmpty;
+        return;
+    }
+
+    *error = kNoError;
+    run_kernel(encrypt_kernel(bestKernel()), data, data, length, context, offset);
+}
+
+/**
+ * @brief Crypto::decryptInPlace
+ * @param data
+ * @param length
+ * @param context
+ * @param error
+ * @param offset
+ *
+ * Same as @c decryptInPlace(), but uses the key schedule of an existing @a context
+ */
+void Crypto::decryptInPlace(char* data, const qint64 length, const CryptoContext& context,
+                            CryptoError* error, const qint64 offset)
+{
+    Q_ASSERT(error);
+
+    if(context.isEmpty()) {
+        *error = kPasswordEmpty;
+        return;
     }
 
-    // Return obtained data
-    return caesar;
+    *error = kNoError;
+    run_kernel(decrypt_kernel(bestKernel()), data, data, length, context, offset);
+}
+
+/**
+ * @brief Crypto::deriveKey
+ * @param password
+ * @return
+ *
+ * Returns the 256-bit key used by the sealed mode for the given @a password
+ */
+QByteArray Crypto::deriveKey(const QByteArray& password)
+{
+    return QPasswordDigestor::deriveKeyPbkdf2(QCryptographicHash::Sha256, password,
+                                              QByteArray(KDF_SALT), KDF_ITERATIONS,
+                                              KDF_KEY_SIZE);
+}
+
+/**
+ * @brief Crypto::sealData
+ * @param data
+ * @param password
+ * @param error
+ * @return
+ *
+ * Encrypts and authenticates the given @a data with ChaCha20-Poly1305 (see @c AeadStream),
+ * the output is larger than the input (header and one tag for each chunk).
+ *
+ * If the @a password is empty, @a error is set to @c kPasswordEmpty and the original data
+ * is returned.
+ */
+QByteArray Crypto::sealData(const QByteArray& data, const QByteArray& password,
+                            CryptoError* error)
+{
+    return sealData(data, CryptoContext(password), error);
+}
+
+/**
+ * @brief Crypto::openData
+ * @param data
+ * @param password
+ * @param error
+ * @return
+ *
+ * Authenticates and decrypts the given sealed @a data. If the @a password is wrong or the
+ * data was modified, @a error is set to @c kAuthenticationError and an empty buffer is
+ * returned. A wrong password is detected with the stream header, before decrypting anything.
+ */
+QByteArray Crypto::openData(const QByteArray& data, const QByteArray& password,
+                            CryptoError* error)
+{
+    return openData(data, CryptoContext(password), error);
+}
+
+/**
+ * @brief Crypto::sealData
+ * @param data
+ * @param context
+ * @param error
+ * @param reserved
+ * @return
+ *
+ * Same as @c sealData(), but reuses the key derived by the given @a context. The first
+ * @a reserved bytes of @a data are kept (unencrypted) in front of the output.
+ */
+QByteArray Crypto::sealData(const QByteArray& data, const CryptoContext& context,
+                            CryptoError* error, const int reserved)
+{
+    Q_ASSERT(error);
+
+    if(context.isEmpty()) {
+        *error = kPasswordEmpty;
+        return data;
+    }
+
+    *error = kNoError;
+    return AeadStream::seal(data, context.sealKey(), AeadStream::DefaultChunkSize,
+                            threadCount(), reserved);
+}
+
+/**
+ * @brief Crypto::openData
+ * @param data
+ * @param context
+ * @param error
+ * @return
+ *
+ * Same as @c openData(), but reuses the key derived by the given @a context
+ */
+QByteArray Crypto::openData(const QByteArray& data, const CryptoContext& context,
+                            CryptoError* error)
+{
+    Q_ASSERT(error);
+
+    if(context.isEmpty()) {
+        *error = kPasswordEmpty;
+        return QByteArray();
+    }
+
+    QByteArray output;
+    if(!AeadStream::open(data, context.sealKey(), &output, threadCount())) {
+        *error = kAuthenticationError;
+        return QByteArray();
+    }
+
+    *error = kNoError;
+    return output;
+}
+
+/**
+ * @brief Crypto::encrypt
+ * @param kernel
+ * @param input
+ * @param output
+ * @param length
+ * @param key
+ *
+ * Encrypts @a length bytes of @a input to @a output with the given @a kernel (all kernels
+ * produce exactly the same output). The @a input and @a output buffers may be the same, but
+ * must not overlap otherwise. The @a key must not be empty.
+ */
+void Crypto::encrypt(const Kernel kernel, const char* input, char* output, const int length,
+                     const QByteArray& key)
+{
+    Q_ASSERT(kernelSupported(kernel));
+    run_kernel(encrypt_kernel(kernel), input, output, length, CryptoContext(key), 0);
+}
+
+/**
+ * @brief Crypto::decrypt
+ * @param kernel
+ * @param input
+ * @param output
+ * @param length
+ * @param key
+ *
+ * Decrypts @a length bytes of @a input to @a output with the given @a kernel, in the same way
+ * as @c encrypt().
+ */
+void Crypto::decrypt(const Kernel kernel, const char* input, char* output, const int length,
+                     const QByteArray& key)
+{
+    Q_ASSERT(kernelSupported(kernel));
+    run_kernel(decrypt_kernel(kernel), input, output, length, CryptoContext(key), 0);
 }
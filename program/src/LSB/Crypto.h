@@ -28,14 +28,82 @@
 typedef enum {
     kPasswordEmpty,
     kNoError,
-    kUnknownError
+    kUnknownError,
+    kAuthenticationError
 } CryptoError;
 
+/*
+ * Key schedule of a password, built once when the password changes and shared by every
+ * message encrypted/decrypted with it.
+ *
+ * It holds the Caesar shift and the expanded XOR pattern of the legacy cipher, and the key
+ * of the sealed (ChaCha20-Poly1305) mode. The sealed key comes from a deliberately slow KDF,
+ * so it is derived the first time it is needed and then kept for the lifetime of the context.
+ * The key of the scatter layout is a labelled subkey of the sealed key, so it never reveals
+ * (or allows a cheap check of) the password.
+ */
+class CryptoContext
+{
+public:
+    CryptoContext();
+    explicit CryptoContext(const QByteArray& password);
+
+    bool isEmpty() const;
+    int shift() const;
+    const QByteArray& key() const;
+    const QByteArray& pattern() const;
+    const QByteArray& sealKey() const;
+    const QByteArray& scatterKey() const;
+
+private:
+    int m_shift;
+    QByteArray m_key;
+    QByteArray m_pattern;
+    mutable QByteArray m_sealKey;
+    mutable QByteArray m_scatterKey;
+};
+
 class Crypto
 {
 public:
+    enum Kernel {
+        KernelScalar,
+        KernelSSE2,
+        KernelAVX2
+    };
+
+    static Kernel bestKernel();
+    static bool kernelSupported(const Kernel kernel);
+
+    static int threadCount();
+    static void setThreadCount(const int threads);
+
     static QByteArray encryptData(const QByteArray& data, const QByteArray& key, CryptoError* error);
     static QByteArray decryptData(const QByteArray& data, const QByteArray& key, CryptoError* error);
+
+    static void encryptInPlace(char* data, const qint64 length, const QByteArray& key,
+                               CryptoError* error, const qint64 offset = 0);
+    static void decryptInPlace(char* data, const qint64 length, const QByteArray& key,
+                               CryptoError* error, const qint64 offset = 0);
+    static void encryptInPlace(char* data, const qint64 length, const CryptoContext& context,
+                               CryptoError* error, const qint64 offset = 0);
+    static void decryptInPlace(char* data, const qint64 length, const CryptoContext& context,
+                               CryptoError* error, const qint64 offset = 0);
+
+    static QByteArray deriveKey(const QByteArray& password);
+    static QByteArray sealData(const QByteArray& data, const QByteArray& password,
+                               CryptoError* error);
+    static QByteArray openData(const QByteArray& data, const QByteArray& password,
+                               CryptoError* error);
+    static QByteArray sealData(const QByteArray& data, const CryptoContext& context,
+                               CryptoError* error, const int reserved = 0);
+    static QByteArray openData(const QByteArray& data, const CryptoContext& context,
+                               CryptoError* error);
+
+    static void encrypt(const Kernel kernel, const char* input, char* output, const int length,
+                        const QByteArray& key);
+    static void decrypt(const Kernel kernel, const char* input, char* output, const int length,
+                        const QByteArray& key);
 };
 
 #endif
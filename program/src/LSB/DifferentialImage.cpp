@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2020 Alex Spataru <https://github.com/alex-spataru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "DifferentialImage.h"
+
+/**
+ * @brief DifferentialImage::DifferentialImage
+ *
+ * Creates a null differential image
+ */
+DifferentialImage::DifferentialImage() :
+    m_layout(QByteArray(), 0),
+    m_scatterOffset(0),
+    m_scatterCount(0)
+{
+}
+
+/**
+ * @brief DifferentialImage::DifferentialImage
+ * @param image
+ *
+ * Creates a differential image of the given @a image with no modified pixels (all black).
+ * Images that do not use a 32-bit format are converted, other images are not copied.
+ */
+DifferentialImage::DifferentialImage(const QImage& image) :
+    m_image(image),
+    m_layout(QByteArray(), 0),
+    m_scatterOffset(0),
+    m_scatterCount(0)
+{
+    if(image.format() != QImage::Format_RGB32 && image.format() != QImage::Format_ARGB32)
+        m_image = image.convertToFormat(QImage::Format_ARGB32);
+}
+
+/**
+ * @brief DifferentialImage::isNull
+ * @return
+ *
+ * Returns @c true if the differential image has no size
+ */
+bool DifferentialImage::isNull() const
+{
+    return m_image.isNull();
+}
+
+/**
+ * @brief DifferentialImage::size
+ * @return
+ *
+ * Returns the size of the original image
+ */
+QSize DifferentialImage::size() const
+{
+    return m_image.size();
+}
+
+/**
+ * @brief DifferentialImage::pixelCount
+ * @return
+ *
+ * Returns the number of modified pixels
+ */
+qint64 DifferentialImage::pixelCount() const
+{
+    qint64 count = m_scatterCount;
+    for(int i = 0; i < m_runs.count(); ++i)
+        count += m_runs.at(i).count;
+
+    return count;
+}
+
+/**
+ * @brief DifferentialImage::addRun
+ * @param first
+ * @param count
+ *
+ * Marks @a count consecutive pixels (in raster order) starting at index @a first as
+ * modified. Runs must be added in ascending order and must not overlap.
+ */
+void DifferentialImage::addRun(const qint64 first, const qint64 count)
+{
+    Q_ASSERT(m_runs.isEmpty() || m_runs.last().first + m_runs.last().count <= first);
+    Q_ASSERT(first + count <= static_cast<qint64>(m_image.width()) * m_image.height());
+
+    if(count <= 0)
+        return;
+
+    // Merge with the previous run if possible
+    if(!m_runs.isEmpty() && m_runs.last().first + m_runs.last().count == first) {
+        m_runs.last().count += count;
+        return;
+    }
+
+    Run run;
+    run.first = first;
+    run.count = count;
+    m_runs.append(run);
+}
+
+/**
+ * @brief DifferentialImage::addScattered
+ * @param layout
+ * @param offset
+ * @param count
+ *
+ * Marks the positions of the first @a count indexes of the scatter @a layout as modified,
+ * where position zero of the layout is the pixel at raster index @a offset. The positions are
+ * not stored, @c toImage() runs the inverse permutation for each pixel that it visits.
+ *
+ * @note Only one scattered range can be added, and it must not overlap with the runs
+ */
+void DifferentialImage::addScattered(const ScatterLayout& layout, const qint64 offset,
+                                     const qint64 count)
+{
+    Q_ASSERT(m_scatterCount == 0);
+    Q_ASSERT(count <= layout.size());
+    Q_ASSERT(offset + layout.size() <= static_cast<qint64>(m_image.width()) * m_image.height());
+
+    if(count <= 0)
+        return;
+
+    m_layout = layout;
+    m_scatterOffset = offset;
+    m_scatterCount = count;
+}
+
+/**
+ * @brief DifferentialImage::isScattered
+ * @param index
+ * @return
+ *
+ * Returns @c true if the pixel at the given raster @a index belongs to the scattered range
+ */
+bool DifferentialImage::isScattered(const qint64 index) const
+{
+    const qint64 position = index - m_scatterOffset;
+    if(m_scatterCount <= 0 || position < 0 || position >= m_layout.size())
+        return false;
+
+    return m_layout.inverse(position) < m_scatterCount;
+}
+
+/**
+ * @brief DifferentialImage::toImage
+ * @param size
+ * @return
+ *
+ * Builds an image with black background that only shows the modified pixels, scaled to the
+ * given @a size (nearest neighbour, like @c Qt::FastTransformation). If @a size is not valid,
+ * the image is built with the size of the original image.
+ *
+ * Only the pixels of the output image are visited, so the cost depends on the requested size
+ * and not on the size of the original image (or on the number of scattered pixels).
+ */
+QImage DifferentialImage::toImage(const QSize& size) const
+{
+    // Null image
+    if(isNull())
+        return QImage();
+
+    // Get output size & create black image
+    const int sourceWidth = m_image.width();
+    const int sourceHeight = m_image.height();
+    const int width = size.isEmpty() ? sourceWidth : size.width();
+    const int height = size.isEmpty() ? sourceHeight : size.height();
+    QImage image(width, height, QImage::Format_RGB32);
+    image.fill(Qt::black);
+
+    // Copy modified pixels
+    for(int y = 0; y < height; ++y) {
+        const int sy = static_cast<int>(static_cast<qint64>(y) * sourceHeight / height);
+        const qint64 rowIndex = static_cast<qint64>(sy) * sourceWidth;
+        const QRgb* source = reinterpret_cast<const QRgb*>(m_image.constScanLine(sy));
+        QRgb* output = reinterpret_cast<QRgb*>(image.scanLine(y));
+
+        // Find the first run that ends after the start of the source row
+        int run = 0;
+        int last = m_runs.count();
+        while(run < last) {
+            const int middle = (run + last) / 2;
+            if(m_runs.at(middle).first + m_runs.at(middle).count <= rowIndex)
+                run = middle + 1;
+            else
+                last = middle;
+        }
+
+        // Visit the row, source indexes only grow, so runs are visited in order
+        const bool scattered = m_scatterCount > 0;
+        for(int x = 0; x < width && (scattered || run < m_runs.count()); ++x) {
+            const int sx = static_cast<int>(static_cast<qint64>(x) * sourceWidth / width);
+            const qint64 index = rowIndex + sx;
+            while(run < m_runs.count() && m_runs.at(run).first + m_runs.at(run).count <= index)
+                ++run;
+
+            if((run < m_runs.count() && m_runs.at(run).first <= index) || isScattered(index))
+                output[x] = source[sx] | 0xff000000;
+        }
+    }
+
+    // Return image
+    return image;
+}
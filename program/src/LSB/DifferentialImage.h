@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2020 Alex Spataru <https://github.com/alex-spataru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef DIFFERENTIAL_IMAGE_H
+#define DIFFERENTIAL_IMAGE_H
+
+#include <QImage>
+#include <QVector>
+
+#include "ScatterLayout.h"
+
+/*
+ * Sparse representation of the pixels modified by the LSB algorithm: instead of a full-size
+ * bitmap, only the image (implicitly shared, never copied) and the runs of modified pixels
+ * (raster indexes) are stored. Pixels written with the scatter layout are not listed at all,
+ * only the layout and the number of pixels are stored.
+ *
+ * The bitmap, which shows the modified pixels over a black background, is only built when
+ * @c toImage() is called, and directly at the requested size.
+ */
+class DifferentialImage
+{
+public:
+    DifferentialImage();
+    explicit DifferentialImage(const QImage& image);
+
+    bool isNull() const;
+    QSize size() const;
+    qint64 pixelCount() const;
+
+    void addRun(const qint64 first, const qint64 count);
+    void addScattered(const ScatterLayout& layout, const qint64 offset, const qint64 count);
+    QImage toImage(const QSize& size = QSize()) const;
+
+private:
+    bool isScattered(const qint64 index) const;
+
+private:
+    struct Run {
+        qint64 first;
+        qint64 count;
+    };
+
+    QImage m_image;
+    QVector<Run> m_runs;
+    ScatterLayout m_layout;
+    qint64 m_scatterOffset;
+    qint64 m_scatterCount;
+};
+
+#endif
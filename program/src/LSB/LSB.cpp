@@ -21,56 +21,233 @@
  */
 
 #include "LSB.h"
-
-#include <QtMath>
+#include "UndoLog.h"
+#include "LsbCodec.h"
+#include "PngWriter.h"
+#include "WireImage.h"
+#include "CoverPool.h"
+#include "PngRowReader.h"
+#include "NoiseGenerator.h"
+
+#include <QFile>
+#include <QMutex>
 #include <QBuffer>
-#include <QMessageBox>
+#include <QVector>
+#include <QImageReader>
+#include <QMutexLocker>
 #include <QRandomGenerator>
 
 /*
  * Define local variables
  */
 static QImage SOURCE_IMAGE;
+static QImage WORKING_IMAGE;
+static UndoLog WORKING_UNDO;
 static QImage IMG_COMPOSITE;
-static QImage IMG_DIFFERENTIAL;
+static DifferentialImage IMG_DIFFERENTIAL;
+static QByteArray IMG_PENDING_DATA;
+static QString IMG_PENDING_FILE;
+static LsbCodec CODEC;
+static QMutex NOISE_MUTEX;
+static CoverPool COVER_POOL;
+static bool USE_FIXED_SEED = false;
 static bool USE_GENERATED_IMAGES = true;
+static PngWriter::Profile COMPRESSION_PROFILE = PngWriter::ProfileFastest;
+
+/*
+ * Largest cover that is generated for a message (256 MB of pixel data)
+ */
+static const int MAX_GENERATED_SIZE = 8192;
 
 /*
- * Define image format to use when reading/exporting image data to binary data
+ * Define image format to use when reading binary image data
  */
 static const char* IMAGE_FORMAT = "PNG";
 
 /**
- * @brief set_bit
- * @param num
- * @param position
- * @param bit
+ * @brief noise_generator
  * @return
  *
- * Changes the bit of @a num at the n-th @a position with the given @a bitValue
+ * Returns the generator used to fill random images, which is seeded only once per session
+ * (unless a fixed seed is set with @c LSB::setRandomSeed()).
+ *
+ * @note Calls must be protected with @c NOISE_MUTEX
  */
-int set_bit(int num, int position, bool bitValue)
+static NoiseGenerator& noise_generator()
 {
-    int mask = 1 << position;
+    static NoiseGenerator generator(QRandomGenerator::system()->generate64());
+    return generator;
+}
 
-    if(bitValue)
-        return num | mask;
-    else
-        return num & ~mask;
+/**
+ * @brief whole_image
+ * @param image
+ * @return
+ *
+ * Returns a differential image that shows all the pixels of the given @a image, used to
+ * preview the source image before any data is written over it.
+ */
+static DifferentialImage whole_image(const QImage& image)
+{
+    DifferentialImage differential(image);
+    differential.addRun(0, static_cast<qint64>(image.width()) * image.height());
+    return differential;
+}
+
+/**
+ * @brief clear_pending_image
+ *
+ * Discards the received image that has not been loaded yet
+ */
+static void clear_pending_image()
+{
+    IMG_PENDING_DATA.clear();
+    IMG_PENDING_FILE.clear();
+}
+
+/**
+ * @brief restore_working_image
+ *
+ * Writes back the pixels of the working image that were overwritten by the last message. The
+ * composite & differential images of that message share the data of the working image, so
+ * they are released first if they are still current (otherwise, restoring the pixels would
+ * copy the whole image).
+ */
+static void restore_working_image()
+{
+    if(WORKING_UNDO.isEmpty())
+        return;
+
+    if(IMG_COMPOSITE.constBits() == WORKING_IMAGE.constBits()) {
+        IMG_COMPOSITE = QImage();
+        IMG_DIFFERENTIAL = DifferentialImage();
+    }
+
+    WORKING_UNDO.restore(&WORKING_IMAGE);
+    WORKING_UNDO.clear();
 }
 
 /**
- * @brief get_bit
- * @param num
- * @param position
+ * @brief preview_size
+ * @param imageSize
+ * @param size
+ * @return
+ *
+ * Returns the size of the preview of an image with the given @a imageSize for the requested
+ * @a size. The aspect ratio is kept and the preview covers the requested area (the user
+ * interface crops it), images are never enlarged.
+ */
+static QSize preview_size(const QSize& imageSize, const QSize& size)
+{
+    if(size.isEmpty() || imageSize.isEmpty())
+        return imageSize;
+
+    const QSize scaled = imageSize.scaled(size, Qt::KeepAspectRatioByExpanding);
+    if(scaled.width() >= imageSize.width() || scaled.height() >= imageSize.height())
+        return imageSize;
+
+    return scaled;
+}
+
+/**
+ * @brief scaled_png
+ * @param reader
+ * @param size
  * @return
  *
- * Returns the value of the bit at the n-th @a position of num
+ * Reads the PNG image one row at a time and samples the rows to the given @a size (nearest
+ * neighbour), so that only a single row of the original image is kept in memory.
  */
-bool get_bit(int num, int position)
+static QImage scaled_png(PngRowReader* reader, const QSize& size)
 {
-    bool bit = num & (1 << position);
-    return bit;
+    Q_ASSERT(reader);
+
+    // Create preview image
+    const int width = reader->width();
+    const int height = reader->height();
+    const QSize previewSize = preview_size(QSize(width, height), size);
+    QImage image(previewSize, reader->hasAlphaChannel() ? QImage::Format_ARGB32 :
+                 QImage::Format_RGB32);
+
+    // Sample rows
+    QVector<QRgb> row(width);
+    for(int y = 0; y < previewSize.height(); ++y) {
+        const int sy = static_cast<int>(static_cast<qint64>(y) * height / previewSize.height());
+        while(reader->currentRow() <= sy) {
+            if(!reader->readRow(row.data()))
+                return QImage();
+        }
+
+        QRgb* output = reinterpret_cast<QRgb*>(image.scanLine(y));
+        for(int x = 0; x < previewSize.width(); ++x)
+            output[x] = row.at(static_cast<int>(static_cast<qint64>(x) * width /
+                                                previewSize.width()));
+    }
+
+    return image;
+}
+
+/**
+ * @brief load_pending_preview
+ * @param size
+ * @return
+ *
+ * Reads a preview of the received image that has not been loaded yet with the given @a size,
+ * without decoding the full image into memory. Returns a null image if there is no pending
+ * image or if it cannot be read.
+ */
+static QImage load_pending_preview(const QSize& size)
+{
+    // Wire images are read directly when they are received
+    if(IMG_PENDING_FILE.isEmpty() && IMG_PENDING_DATA.isEmpty())
+        return QImage();
+    if(WireImage::isWireImage(IMG_PENDING_DATA))
+        return QImage();
+
+    // Open file or received data
+    QFile file(IMG_PENDING_FILE);
+    QBuffer buffer(&IMG_PENDING_DATA);
+    QIODevice* device = &buffer;
+    if(!IMG_PENDING_FILE.isEmpty())
+        device = &file;
+    if(!device->open(QIODevice::ReadOnly))
+        return QImage();
+
+    // Sample PNG rows directly
+    {
+        PngRowReader png(device);
+        if(png.isValid())
+            return scaled_png(&png, size);
+    }
+
+    // Other formats (and interlaced PNG images) are scaled while reading
+    device->seek(0);
+    QImageReader reader(device);
+    reader.setScaledSize(preview_size(reader.size(), size));
+    return reader.read();
+}
+
+/**
+ * @brief load_pending_image
+ *
+ * Images received with @c LSB::decodeData(const QByteArray&) (or read with
+ * @c LSB::decodeFile()) are decoded without building the composite & differential images,
+ * this function builds them (only once) when they are actually needed.
+ */
+static void load_pending_image()
+{
+    if(IMG_PENDING_DATA.isEmpty() && IMG_PENDING_FILE.isEmpty())
+        return;
+
+    if(!IMG_PENDING_FILE.isEmpty())
+        IMG_COMPOSITE = QImage(IMG_PENDING_FILE);
+    else if(WireImage::isWireImage(IMG_PENDING_DATA))
+        IMG_COMPOSITE = WireImage::read(IMG_PENDING_DATA);
+    else
+        IMG_COMPOSITE = QImage::fromData(IMG_PENDING_DATA, IMAGE_FORMAT);
+
+    CODEC.decode(IMG_COMPOSITE, &IMG_DIFFERENTIAL);
+    clear_pending_image();
 }
 
 /**
@@ -89,27 +266,122 @@ bool LSB::useGeneratedImages()
  * @param enabled
  *
  * If @a enabled is set to @c true, LSB module will generate an image filled with random pixels
- * for each time the user executes the LSB-Write algorithm.
+ * for each time the user executes the LSB-Write algorithm (covers are prepared in the
+ * background, so that they are ready when a message is sent).
  *
  * If @a enabled is set to @c false, LSB module will execute the LSB-Write algorithm over an
  * existing image selected by the user.
  */
 void LSB::enableGeneratedImages(const bool enabled)
 {
+    clear_pending_image();
     USE_GENERATED_IMAGES = enabled;
 
     if(!enabled) {
+        COVER_POOL.clear();
         IMG_COMPOSITE = SOURCE_IMAGE;
-        IMG_DIFFERENTIAL = SOURCE_IMAGE;
+        IMG_DIFFERENTIAL = whole_image(SOURCE_IMAGE);
     }
 
     else {
+        COVER_POOL.reserve();
         SOURCE_IMAGE = generateImage(0, false);
         IMG_COMPOSITE = generateImage(1000, true);
-        IMG_DIFFERENTIAL = generateImage(1000, false);
+        IMG_DIFFERENTIAL = DifferentialImage(IMG_COMPOSITE);
     }
 }
 
+/**
+ * @brief LSB::bitsPerChannel
+ * @return
+ *
+ * Returns the number of low bits of each color channel that are used to store data
+ */
+int LSB::bitsPerChannel()
+{
+    return CODEC.bitsPerChannel();
+}
+
+/**
+ * @brief LSB::setBitsPerChannel
+ * @param bits
+ *
+ * Changes the number of low @a bits (1 to 4) of each color channel that the LSB-Write
+ * algorithm uses to store data. Using more bits reduces the size of the image needed to
+ * store the data, at the expense of making the changes more visible.
+ *
+ * @note The value is stored in the image header, so the LSB-Read algorithm detects it
+ *       automatically.
+ */
+void LSB::setBitsPerChannel(const int bits)
+{
+    CODEC.setBitsPerChannel(bits);
+}
+
+/**
+ * @brief LSB::useAlphaChannel
+ * @return
+ *
+ * Returns @c true if the LSB-Write algorithm shall also store data on the alpha channel
+ */
+bool LSB::useAlphaChannel()
+{
+    return CODEC.useAlphaChannel();
+}
+
+/**
+ * @brief LSB::enableAlphaChannel
+ * @param enabled
+ *
+ * If @a enabled is set to @c true, the LSB-Write algorithm will also store data over the
+ * alpha channel of the image.
+ *
+ * @note This only has an effect when the source image has an alpha channel (auto-generated
+ *       images do not have one).
+ */
+void LSB::enableAlphaChannel(const bool enabled)
+{
+    CODEC.enableAlphaChannel(enabled);
+}
+
+/**
+ * @brief LSB::setScatterKey
+ * @param key
+ *
+ * Changes the @a key used to scatter the data over the whole image in a pseudo-random order,
+ * an empty @a key writes the data in raster order.
+ *
+ * @note Images written with a key can only be read by peers that use the same key.
+ */
+void LSB::setScatterKey(const QByteArray& key)
+{
+    CODEC.setScatterKey(key);
+}
+
+/**
+ * @brief LSB::compressionProfile
+ * @return
+ *
+ * Returns the compression profile used to export images to PNG data
+ */
+PngWriter::Profile LSB::compressionProfile()
+{
+    return COMPRESSION_PROFILE;
+}
+
+/**
+ * @brief LSB::setCompressionProfile
+ * @param profile
+ *
+ * Changes the compression @a profile used to export images to PNG data. The fastest profile
+ * is used by default, since generated covers are random noise and barely compress at all,
+ * the other profiles trade encoding time for smaller transfers of user-selected images.
+ */
+void LSB::setCompressionProfile(const PngWriter::Profile profile)
+{
+    COMPRESSION_PROFILE = profile;
+}
+
 /**
  * @brief LSB::setSourceImage
  * @param image
@@ -121,42 +393,130 @@ void LSB::enableGeneratedImages(const bool enabled)
  */
 void LSB::setSourceImage(const QImage& image)
 {
+    clear_pending_image();
+    WORKING_IMAGE = QImage();
+    WORKING_UNDO.clear();
     SOURCE_IMAGE = image;
 
     if(!useGeneratedImages()) {
         IMG_COMPOSITE = SOURCE_IMAGE;
-        IMG_DIFFERENTIAL = SOURCE_IMAGE;
+        IMG_DIFFERENTIAL = whole_image(SOURCE_IMAGE);
     }
 }
 
+/**
+ * @brief LSB::capacity
+ * @return
+ *
+ * Returns the maximum number of bytes that can be written with the LSB-Write algorithm with
+ * the current configuration: the capacity of the source image, or the capacity of the largest
+ * cover that is generated if generated images are used.
+ *
+ * Callers should check the size of the data with this function before encoding it.
+ */
+qint64 LSB::capacity()
+{
+    if(useGeneratedImages() || (SOURCE_IMAGE.width() == 0 && SOURCE_IMAGE.height() == 0))
+        return LsbCodec::capacity(QSize(MAX_GENERATED_SIZE, MAX_GENERATED_SIZE),
+                                  bitsPerChannel());
+
+    return LsbCodec::capacity(SOURCE_IMAGE.size(), bitsPerChannel(),
+                              useAlphaChannel() && SOURCE_IMAGE.hasAlphaChannel());
+}
+
+/**
+ * @brief LSB::legacyCapacity
+ * @return
+ *
+ * Returns the maximum number of bytes that can be written with the legacy diagonal layout
+ * (for older clients) with the current configuration, see @c LSB::capacity().
+ */
+qint64 LSB::legacyCapacity()
+{
+    if(useGeneratedImages() || (SOURCE_IMAGE.width() == 0 && SOURCE_IMAGE.height() == 0))
+        return LsbCodec::legacyCapacity(QSize(MAX_GENERATED_SIZE, MAX_GENERATED_SIZE));
+
+    return LsbCodec::legacyCapacity(SOURCE_IMAGE.size());
+}
+
+/**
+ * @brief LSB::requiredCoverSize
+ * @param bytes
+ * @return
+ *
+ * Returns the size of the smallest (square) generated cover that can hold the given number of
+ * @a bytes with the current configuration
+ */
+QSize LSB::requiredCoverSize(const qint64 bytes)
+{
+    return LsbCodec::requiredCoverSize(bytes, bitsPerChannel());
+}
+
 /**
  * @brief LSB::currentCompositeImage
+ * @param size
  * @return
  *
  * Returns the resultant image after executing the LSB algorithm, or the LSB-touched image
  * received when extracting information with the LSB-Read algorithm.
+ *
+ * If @a size is valid, a preview that covers the given @a size is returned (nearest neighbour,
+ * keeping the aspect ratio). Received images that have not been loaded yet are sampled while
+ * reading them, so the full image is only decoded into memory if it is actually needed.
  */
-QImage LSB::currentCompositeImage()
+QImage LSB::currentCompositeImage(const QSize& size)
 {
+    // Received image has not been loaded yet, only read the preview
+    if(!size.isEmpty()) {
+        const QImage preview = load_pending_preview(size);
+        if(!preview.isNull())
+            return preview;
+    }
+
+    load_pending_image();
     if (IMG_COMPOSITE.isNull())
         IMG_COMPOSITE = generateImage(100, false);
 
-    return IMG_COMPOSITE;
+    return IMG_COMPOSITE.scaled(preview_size(IMG_COMPOSITE.size(), size));
 }
 
 /**
  * @brief LSB::currentImageData
+ * @param size
  * @return
  *
  * Returns an image with black background, which only shows the pixels that have been modified
  * by the LSB-Write algorithm.
+ *
+ * The image is built on demand from the list of modified pixels, directly with a size that
+ * covers the given @a size (or with the size of the composite image if @a size is not valid).
  */
-QImage LSB::currentImageData()
+QImage LSB::currentImageData(const QSize& size)
 {
+    load_pending_image();
     if (IMG_DIFFERENTIAL.isNull())
-        IMG_DIFFERENTIAL = generateImage(100, false);
+        IMG_DIFFERENTIAL = DifferentialImage(generateImage(100, false));
 
-    return IMG_DIFFERENTIAL;
+    return IMG_DIFFERENTIAL.toImage(preview_size(IMG_DIFFERENTIAL.size(), size));
+}
+
+/**
+ * @brief LSB::setRandomSeed
+ * @param seed
+ *
+ * Re-seeds the generator used to create random images with the given @a seed, so that the
+ * sequence of images generated afterwards is always the same (useful for tests and
+ * benchmarks). By default, the generator is seeded once per session with system entropy.
+ *
+ * @note Once a fixed seed is set, @c encodeData() stops using the covers prepared in the
+ *       background, since they do not depend on the seed.
+ */
+void LSB::setRandomSeed(const quint64 seed)
+{
+    QMutexLocker locker(&NOISE_MUTEX);
+    noise_generator().seed(seed);
+    USE_FIXED_SEED = true;
+    COVER_POOL.clear();
 }
 
 /**
@@ -171,27 +531,20 @@ QImage LSB::currentImageData()
  */
 QImage LSB::generateImage(const int size, const bool random)
 {
-    // Create image & init. random generator
+    // Create image
     QImage image(QSize(size, size), QImage::Format_RGB32);
-    QRandomGenerator generator = QRandomGenerator::securelySeeded();
-
-    // Initialize rgb values
-    int r = 0;
-    int g = 0;
-    int b = 0;
-
-    // Fill image pixels
-    for (int i = 0; i < image.width(); ++i) {
-        if (random) {
-            r = generator.bounded(0x20, 0xdd);
-            g = generator.bounded(0x20, 0x90);
-            b = generator.bounded(0x20, 0xff);
-        }
 
-        for (int j = 0; j < image.height(); ++j)
-            image.setPixel(j, i, qRgb(r, g, b));
+    // Black image, fill the whole image at once
+    if (!random) {
+        image.fill(Qt::black);
+        return image;
     }
 
+    // Fill all the pixels at once (32-bit images have no padding between scan lines)
+    QMutexLocker locker(&NOISE_MUTEX);
+    const qint64 pixels = static_cast<qint64>(image.width()) * image.height();
+    noise_generator().fill(reinterpret_cast<QRgb*>(image.bits()), pixels);
+
     // Return image
     return image;
 }
@@ -201,92 +554,124 @@ QImage LSB::generateImage(const int size, const bool random)
  * @param data
  * @return
  *
- * Encodes the given @a data in an image using the LSB-Write algorithm, the data is encoded in
- * the following manner:
+ * Encodes the given @a data with the LSB-Write algorithm over the source image (or over a
+ * generated image just large enough to hold the data) and updates the current composite and
+ * differential images.
+ *
+ * Returns a null image if the data does not fit, see @c LSB::capacity().
  *
- * 1) Only the hypothenuse will contain data.
- * 2) The hypothenuse will be calculated considering a rectangular image. The sides are equal
- *    to the smallest side of the image.
- * 3) Data will start with the following format @c{$DATA_LENGTH$}
- * 4) After data length header is written, the given @a data is written over the image
+ * @sa LsbCodec::encode
  */
 QImage LSB::encodeData(const QByteArray& data)
 {
-    // Append data size to start
-    QByteArray injection;
-    injection.append("$");
-    injection.append(QString::number(data.length()));
-    injection.append("$");
-    injection.append(data);
+    // Data does not fit, do not generate a cover for nothing
+    if(data.length() > capacity())
+        return QImage();
 
-    // Reset images (generate random image case)
+    // Select cover image, use a pre-generated cover if there is one ready
+    QImage cover = SOURCE_IMAGE;
     if(useGeneratedImages() || (SOURCE_IMAGE.width() == 0 && SOURCE_IMAGE.height() == 0)) {
-        const int size = qMin(10 * 10000.0, injection.length() * 3.2);
-        IMG_COMPOSITE = generateImage(size, true);
-        IMG_DIFFERENTIAL = generateImage(size, false);
+        const int size = requiredCoverSize(data.length()).width();
+        cover = USE_FIXED_SEED ? QImage() : COVER_POOL.take(size);
+        if(cover.isNull())
+            cover = generateImage(size, true);
     }
 
-    // Reset images using source image
-    else {
-        IMG_COMPOSITE = SOURCE_IMAGE;
-        IMG_DIFFERENTIAL = generateImage(qMin(IMG_COMPOSITE.width(), IMG_COMPOSITE.height()), false);
-    }
-
-    // Calculate the diagonal length using the Pythagorean theorem
-    int cat = qMin(IMG_COMPOSITE.width(), IMG_COMPOSITE.height());
-    int hyp = static_cast<int>(round(sqrt(2.0) * static_cast<double>(cat)));
-
-    // Write data to image using LSB
-    int bytesWritten = 0;
-    for(int i = 0; i < hyp; i += 3) {
-        // We have written all data, exit loop
-        if(bytesWritten >= injection.length())
-            break;
-
-        // Get byte & pixel value
-        char byte = injection.at(bytesWritten);
-        QRgb pixel1 = IMG_COMPOSITE.pixel(i + 0, i + 0);
-        QRgb pixel2 = IMG_COMPOSITE.pixel(i + 1, i + 1);
-        QRgb pixel3 = IMG_COMPOSITE.pixel(i + 2, i + 2);
-
-        // Get individual bits
-        int bits[8];
-        for(int i = 0; i < 8; ++i)
-            bits[i] = ((1 << (i % 8)) & byte) >> (i % 8);
-
-        // Write on LSBs of each byte of the image
-        QRgb lsbPixel1 = qRgb(set_bit(qRed(pixel1),   0, bits[0]),
-                              set_bit(qGreen(pixel1), 0, bits[1]),
-                              set_bit(qBlue(pixel1),  0, bits[2]));
-        QRgb lsbPixel2 = qRgb(set_bit(qRed(pixel2),   0, bits[3]),
-                              set_bit(qGreen(pixel2), 0, bits[4]),
-                              set_bit(qBlue(pixel2),  0, bits[5]));
-        QRgb lsbPixel3 = qRgb(set_bit(qRed(pixel3),   0, bits[6]),
-                              set_bit(qGreen(pixel3), 0, bits[7]),
-                              set_bit(qBlue(pixel3),  0, 1));
-
-        // Update pixels of image
-        IMG_COMPOSITE.setPixel(i + 0, i + 0, lsbPixel1);
-        IMG_COMPOSITE.setPixel(i + 1, i + 1, lsbPixel2);
-        IMG_COMPOSITE.setPixel(i + 2, i + 2, lsbPixel3);
-        IMG_DIFFERENTIAL.setPixel(i + 0, i + 0, lsbPixel1);
-        IMG_DIFFERENTIAL.setPixel(i + 1, i + 1, lsbPixel2);
-        IMG_DIFFERENTIAL.setPixel(i + 2, i + 2, lsbPixel3);
-
-        // Increment written bytes
-        ++bytesWritten;
-    }
+    // Encode data
+    DifferentialImage differential;
+    const QImage composite = CODEC.encode(cover, data, &differential);
+    if(composite.isNull())
+        return QImage();
+
+    // Update current images & return the obtained image
+    clear_pending_image();
+    IMG_COMPOSITE = composite;
+    IMG_DIFFERENTIAL = differential;
+    return composite;
+}
 
-    // Warn user if image was too small
-    if(bytesWritten < injection.length()) {
-        QMessageBox::critical(Q_NULLPTR,
-                              QObject::tr("Error"),
-                              QObject::tr("The image is too small to fit the requested data"));
-        return QImage(0, 0, QImage::Format_RGB32);
-    }
+/**
+ * @brief LSB::encodeLegacyData
+ * @param data
+ * @return
+ *
+ * Encodes the given @a data with the legacy diagonal layout over a copy of the source image
+ * (or over a generated image just large enough to hold the data) and updates the current
+ * composite and differential images. This layout is only used for older clients, which
+ * cannot read the raster layout, so the data is never scattered.
+ *
+ * Returns a null image if the data does not fit, see @c LSB::legacyCapacity().
+ *
+ * @sa LsbCodec::encodeLegacy
+ */
+QImage LSB::encodeLegacyData(const QByteArray& data)
+{
+    // Data does not fit, do not generate a cover for nothing
+    if(data.length() > legacyCapacity())
+        return QImage();
+
+    // Select cover image
+    QImage cover = SOURCE_IMAGE;
+    if(useGeneratedImages() || (SOURCE_IMAGE.width() == 0 && SOURCE_IMAGE.height() == 0))
+        cover = generateImage(LsbCodec::requiredLegacyCoverSize(data.length()).width(), true);
+
+    // Encode data
+    DifferentialImage differential;
+    const QImage composite = LsbCodec::encodeLegacy(cover, data, &differential);
+    if(composite.isNull())
+        return QImage();
+
+    // Update current images & return the obtained image
+    clear_pending_image();
+    IMG_COMPOSITE = composite;
+    IMG_DIFFERENTIAL = differential;
+    return composite;
+}
 
-    // Return the obtained image
-    return IMG_COMPOSITE;
+/**
+ * @brief LSB::encodeToBinaryData
+ * @param data
+ * @param format
+ * @return
+ *
+ * Encodes the given @a data with the LSB-Write algorithm and returns the resulting image in
+ * the given @a format, ready to be sent.
+ *
+ * When the user selected a source image, the data is written directly over a working copy
+ * of it (the source image is only copied when it changes). The original value of the
+ * modified pixels is saved before writing the data and restored before the next message is
+ * written, so the cost of each message depends on the size of the data and not on the size
+ * of the source image.
+ *
+ * Until then, the working image is also the composite image (and the base of the
+ * differential image), so the user interface can show it without copying or decoding it.
+ *
+ * Returns an empty byte array if the data does not fit, see @c LSB::capacity().
+ */
+QByteArray LSB::encodeToBinaryData(const QByteArray& data, const BinaryFormat format)
+{
+    // Generated covers are only used once, there is nothing to restore
+    if(useGeneratedImages() || (SOURCE_IMAGE.width() == 0 && SOURCE_IMAGE.height() == 0))
+        return imageToBinaryData(encodeData(data), format);
+
+    // Restore the pixels of the previous message, the working image is detached from the
+    // source image only once
+    restore_working_image();
+    if(WORKING_IMAGE.isNull())
+        WORKING_IMAGE = SOURCE_IMAGE;
+
+    // Write data over the working image
+    DifferentialImage differential;
+    if(!CODEC.encodeInPlace(&WORKING_IMAGE, data, &WORKING_UNDO, &differential))
+        return QByteArray();
+
+    // Working image is the composite image until the next message is written
+    clear_pending_image();
+    IMG_COMPOSITE = WORKING_IMAGE;
+    IMG_DIFFERENTIAL = differential;
+
+    // Export image
+    return imageToBinaryData(WORKING_IMAGE, format);
 }
 
 /**
@@ -294,107 +679,60 @@ QImage LSB::encodeData(const QByteArray& data)
  * @param image
  * @return
  *
- * Decodes and returns the data contained in the given @a image. If the data is invalid, or
- * the image is invalid, an empty byte array will be returned.
+ * Decodes and returns the data contained in the given @a image with the LSB-Read algorithm
+ * and updates the current composite and differential images.
+ *
+ * @sa LsbCodec::decode
  */
 QByteArray LSB::decodeData(const QImage& image)
 {
-    // Init. variables for obtaining data length
-    int dataLenght = 0;
-    int headerCount = 0;
-    QString lengthString;
-
-    // Calculate the diagonal length using the Pythagorean theorem
-    int cat = qMin(image.width(), image.height());
-    int hyp = static_cast<int>(round(sqrt(2.0) * static_cast<double>(cat)));
-
-    // Decode data
-    QByteArray data;
-    for(int i = 0; i < hyp; i += 3) {
-        // Get pixels
-        QRgb pixel1 = image.pixel(i + 0, i + 0);
-        QRgb pixel2 = image.pixel(i + 1, i + 1);
-        QRgb pixel3 = image.pixel(i + 2, i + 2);
-
-        // Get individual bits
-        bool bits[8] = {
-            get_bit(qRed(pixel1),   0),
-            get_bit(qGreen(pixel1), 0),
-            get_bit(qBlue(pixel1),  0),
-            get_bit(qRed(pixel2),   0),
-            get_bit(qGreen(pixel2), 0),
-            get_bit(qBlue(pixel2),  0),
-            get_bit(qRed(pixel3),   0),
-            get_bit(qGreen(pixel3), 0)
-        };
-
-        // Get byte value from bits
-        char byte = 0;
-        for(int i = 0; i < 8; ++i)
-            byte += (bits[i] << i);
-
-        // Data length not calculated yet
-        if(dataLenght <= 0 && headerCount < 2) {
-            // Get start/end of header
-            if(byte == '$')
-                ++headerCount;
-
-            // Append digit to length string
-            else if(byte >= '0' && byte <= '9')
-                lengthString.append(byte);
-        }
-
-        // If header length is equal to two
-        else if(dataLenght <= 0 && headerCount == 2) {
-            dataLenght = lengthString.toInt();
-            data.append(byte);
-        }
-
-        // Append to data
-        else if(data.length() < dataLenght)
-            data.append(byte);
-        else
-            break;
-    }
-
-    // Update current LSB image
+    clear_pending_image();
     IMG_COMPOSITE = image;
-
-    // Regenerate data image
-    IMG_DIFFERENTIAL = generateImage(cat, false);
-    for(int i = 0; i < cat; ++i)
-        IMG_DIFFERENTIAL.setPixel(i, i, IMG_COMPOSITE.pixel(i, i));
-
-    // Return data
-    return data;
+    return CODEC.decode(image, &IMG_DIFFERENTIAL);
 }
 
 /**
  * @brief LSB::imageToBinaryData
  * @param image
+ * @param format
  * @return
  *
  * Converts the given image to a byte array by exporting the image data using the PNG format.
  * The PNG format was choosen because - unlike JPEG - the format is looseless.
+ *
+ * The image is compressed with the profile set by @c LSB::setCompressionProfile(). If
+ * @a format is @c WireFormat, the image is stored in the (also lossless) container used
+ * between LSB-Chat peers, which is much faster to write & read than PNG.
  */
-QByteArray LSB::imageToBinaryData(const QImage& image)
+QByteArray LSB::imageToBinaryData(const QImage& image, const BinaryFormat format)
 {
-    // Create buffer to treat byte array as file
-    QByteArray arr;
-    QBuffer buffer(&arr);
+    if(format == WireFormat)
+        return WireImage::write(image);
 
-    // If image is empty, return empty buffer
-    if(image.width() <= 0 || image.height() <= 0)
-        return arr;
+    return PngWriter::write(image, COMPRESSION_PROFILE);
+}
 
-    // Save image as PNG to buffer
-    if(buffer.open(QIODevice::WriteOnly)) {
-        image.save(&buffer, IMAGE_FORMAT, 100);
-        buffer.close();
-    }
+/**
+ * @brief LSB::convertBinaryData
+ * @param rawImageData
+ * @param format
+ * @return
+ *
+ * Converts the given @a rawImageData (PNG or wire image) to the given @a format, used to
+ * send the same image to peers that do not support the wire image container.
+ */
+QByteArray LSB::convertBinaryData(const QByteArray& rawImageData, const BinaryFormat format)
+{
+    // Data is already in the requested format
+    const bool wireImage = WireImage::isWireImage(rawImageData);
+    if(wireImage == (format == WireFormat))
+        return rawImageData;
+
+    // Convert image
+    if(wireImage)
+        return imageToBinaryData(WireImage::read(rawImageData), format);
 
-    // Return byte array
-    return arr;
+    return imageToBinaryData(QImage::fromData(rawImageData, IMAGE_FORMAT), format);
 }
 
 /**
@@ -402,26 +740,43 @@ QByteArray LSB::imageToBinaryData(const QImage& image)
  * @param rawImageData
  * @return
  *
- * Creates an image from the given @a rawimageData and attempts to decode the information contained
- * in the image using the LSB-Read algorithm.
+ * Attempts to decode the information contained in the given @a rawImageData (PNG format or
+ * wire image) using the LSB-Read algorithm.
  *
- * @note The image format must be PNG, otherwise, the conversion will fail.
+ * PNG images are read one scan line at a time and decoding stops once the data has been
+ * read, the composite & differential images are only built if the user interface asks for
+ * them.
  */
 QByteArray LSB::decodeData(const QByteArray& rawImageData)
 {
-    // Copy the raw image data and load it into a memory buffer
-    QByteArray data = rawImageData;
-    QBuffer buffer(&data);
-
-    // Open the buffer, load image data and decode image
-    if(buffer.open(QIODevice::ReadOnly)) {
-        QImage image;
-        if(image.load(&buffer, IMAGE_FORMAT))
-            return decodeData(image);
-
-        buffer.close();
-    }
+    // Wire images are cheap to read, decode them directly
+    if(WireImage::isWireImage(rawImageData))
+        return decodeData(WireImage::read(rawImageData));
+
+    IMG_COMPOSITE = QImage();
+    IMG_DIFFERENTIAL = DifferentialImage();
+    clear_pending_image();
+    IMG_PENDING_DATA = rawImageData;
+    return CODEC.decodePng(rawImageData);
+}
 
-    // Error, return empty byte array
-    return QByteArray();
+/**
+ * @brief LSB::decodeFile
+ * @param fileName
+ * @return
+ *
+ * Decodes the information contained in the image stored in the given file using the
+ * LSB-Read algorithm. Only the region of the image that contains the data is read from the
+ * file, the composite & differential images are only built if the user interface asks for
+ * them.
+ *
+ * @sa LsbCodec::decodeFile
+ */
+QByteArray LSB::decodeFile(const QString& fileName)
+{
+    IMG_COMPOSITE = QImage();
+    IMG_DIFFERENTIAL = DifferentialImage();
+    clear_pending_image();
+    IMG_PENDING_FILE = fileName;
+    return CODEC.decodeFile(fileName);
 }
@@ -27,22 +27,51 @@
 #include <QObject>
 #include <QByteArray>
 
+#include "PngWriter.h"
+
 class LSB
 {
 public:
+    enum BinaryFormat {
+        PngFormat,
+        WireFormat
+    };
+
     static bool useGeneratedImages();
     static void enableGeneratedImages(const bool enabled);
+
+    static int bitsPerChannel();
+    static bool useAlphaChannel();
+    static void setBitsPerChannel(const int bits);
+    static void enableAlphaChannel(const bool enabled);
+    static void setScatterKey(const QByteArray& key);
+
+    static PngWriter::Profile compressionProfile();
+    static void setCompressionProfile(const PngWriter::Profile profile);
+
     static void setSourceImage(const QImage& image);
 
-    static QImage currentImageData();
-    static QImage currentCompositeImage();
+    static qint64 capacity();
+    static qint64 legacyCapacity();
+    static QSize requiredCoverSize(const qint64 bytes);
+
+    static QImage currentImageData(const QSize& size = QSize());
+    static QImage currentCompositeImage(const QSize& size = QSize());
+    static void setRandomSeed(const quint64 seed);
     static QImage generateImage(const int size, const bool random);
 
     static QImage encodeData(const QByteArray& data);
+    static QImage encodeLegacyData(const QByteArray& data);
+    static QByteArray encodeToBinaryData(const QByteArray& data,
+                                         const BinaryFormat format = PngFormat);
     static QByteArray decodeData(const QImage& image);
     static QByteArray decodeData(const QByteArray& rawImageData);
+    static QByteArray decodeFile(const QString& fileName);
 
-    static QByteArray imageToBinaryData(const QImage& image);
+    static QByteArray imageToBinaryData(const QImage& image,
+                                        const BinaryFormat format = PngFormat);
+    static QByteArray convertBinaryData(const QByteArray& rawImageData,
+                                        const BinaryFormat format);
 };
 
 #endif
@@ -0,0 +1,1228 @@
+/*
+ * Copyright (c) 2020 Alex Spataru <https://github.com/alex-spataru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "LsbCodec.h"
+#include "BitPlane.h"
+#include "Checksum.h"
+#include "UndoLog.h"
+#include "PngRowReader.h"
+#include "ScatterLayout.h"
+
+#include <QFile>
+#include <QtMath>
+#include <QThread>
+#include <QVector>
+#include <QFuture>
+#include <QtEndian>
+#include <QImageReader>
+#include <QtConcurrent>
+
+#include <climits>
+#include <cstring>
+
+/*
+ * Fixed-size binary header written at the start of images that use the raster layout, the
+ * header is stored over the first 43 pixels of the image and is followed by the payload:
+ *
+ *   Bytes 0-3:   Magic code ("LSBC")
+ *   Byte 4:      Format version
+ *   Byte 5:      Data layout (1: raster order, 2: keyed scatter order)
+ *   Byte 6:      Flags (bits 0-1: data bits per channel minus one, bit 2: alpha channel used)
+ *   Byte 7:      Reserved (zero)
+ *   Bytes 8-11:  Payload length (little endian)
+ *   Bytes 12-15: CRC-32C of the payload (little endian)
+ *
+ * The header itself is always written with one bit per color channel (no alpha) and in raster
+ * order, the flags and the layout define how the payload is written over the rest of the pixels.
+ */
+static const char HEADER_MAGIC[] = "LSBC";
+static const int HEADER_MAGIC_SIZE = 4;
+static const int HEADER_SIZE = 16;
+static const int HEADER_PIXELS = 43;
+static const uchar HEADER_VERSION = 2;
+static const uchar LAYOUT_RASTER = 1;
+static const uchar LAYOUT_SCATTER = 2;
+static const uchar FLAG_DEPTH_MASK = 0x03;
+static const uchar FLAG_ALPHA = 0x04;
+
+/*
+ * Payloads smaller than this are embedded/extracted on the calling thread, larger payloads
+ * are split in bands of (at least) this size, which are processed in parallel
+ */
+static const int PARALLEL_BAND_BYTES = 256 * 1024;
+
+/*
+ * Number of pixel groups extracted at a time when decoding PNG images row by row
+ */
+static const int STREAM_CHUNK_GROUPS = 4096;
+
+/*
+ * Maximum number of pixels gathered/scattered at a time with the scatter layout, the pixel
+ * indexes of each batch are generated together and kept on the stack
+ */
+static const int SCATTER_BATCH_PIXELS = 1024;
+
+/*
+ * Maximum number of digits of the data length in the legacy diagonal layout header
+ */
+static const int LEGACY_MAX_DIGITS = 10;
+
+/*
+ * Describes how the payload is stored in an image using the raster layout
+ */
+struct RasterHeader {
+    int length;
+    int depth;
+    bool alpha;
+    uchar layout;
+    quint32 checksum;
+};
+
+/*
+ * Possible results of reading the raster layout header of an image
+ */
+enum HeaderStatus {
+    HeaderMissing,
+    HeaderInvalid,
+    HeaderValid
+};
+
+/**
+ * @brief normalized_image
+ * @param image
+ * @return
+ *
+ * Returns a version of the given @a image that uses a 32-bit pixel format without padding
+ * between scan lines, so that the LSB algorithm can read/write pixels directly through raw
+ * pointers. Images that already meet these conditions are returned as-is (implicitly shared,
+ * no copy).
+ */
+static QImage normalized_image(const QImage& image)
+{
+    QImage normalized = image;
+    if(image.format() != QImage::Format_RGB32 && image.format() != QImage::Format_ARGB32) {
+        if(image.hasAlphaChannel())
+            normalized = image.convertToFormat(QImage::Format_ARGB32);
+        else
+            normalized = image.convertToFormat(QImage::Format_RGB32);
+    }
+
+    if(normalized.bytesPerLine() != normalized.width() * static_cast<int>(sizeof(QRgb)))
+        normalized = normalized.copy();
+
+    return normalized;
+}
+
+/**
+ * @brief pixel_count
+ * @param image
+ * @return
+ *
+ * Returns the total number of pixels of the given @a image
+ */
+static qint64 pixel_count(const QImage& image)
+{
+    return static_cast<qint64>(image.width()) * image.height();
+}
+
+/**
+ * @brief raster_capacity
+ * @param pixelCount
+ * @param depth
+ * @param alpha
+ * @return
+ *
+ * Returns the maximum number of payload bytes that can be stored in an image with the given
+ * @a pixelCount using the raster layout with @a depth bits per channel (and the alpha
+ * channel if @a alpha is set to @c true).
+ */
+static qint64 raster_capacity(const qint64 pixelCount, const int depth, const bool alpha)
+{
+    const qint64 pixels = qMax<qint64>(0, pixelCount - HEADER_PIXELS);
+    return pixels * BitPlane::bitsPerPixel(depth, alpha) / 8;
+}
+
+/**
+ * @brief raster_header
+ * @param header
+ * @return
+ *
+ * Generates the binary representation of the given raster layout @a header
+ */
+static QByteArray raster_header(const RasterHeader& header)
+{
+    QByteArray data(HEADER_SIZE, 0);
+    memcpy(data.data(), HEADER_MAGIC, HEADER_MAGIC_SIZE);
+    data[4] = static_cast<char>(HEADER_VERSION);
+    data[5] = static_cast<char>(header.layout);
+    data[6] = static_cast<char>((header.depth - 1) | (header.alpha ? FLAG_ALPHA : 0));
+    qToLittleEndian<quint32>(static_cast<quint32>(header.length), data.data() + 8);
+    qToLittleEndian<quint32>(header.checksum, data.data() + 12);
+    return data;
+}
+
+/**
+ * @brief read_raster_header
+ * @param pixels
+ * @param pixelCount
+ * @param hasAlpha
+ * @param header
+ * @return
+ *
+ * Reads the raster layout header from the first @a pixels of an image with the given
+ * @a pixelCount (@a hasAlpha indicates if the image has an alpha channel).
+ *
+ * The magic code is checked first, so that images that do not use the raster layout are
+ * discarded after reading 11 pixels. If the rest of the header is valid and the payload fits
+ * in the image, the given @a header is updated and @c HeaderValid is returned.
+ */
+static HeaderStatus read_raster_header(const QRgb* pixels, const qint64 pixelCount,
+                                       const bool hasAlpha, RasterHeader* header)
+{
+    Q_ASSERT(header);
+
+    // Image too small to contain a header
+    if(pixelCount < HEADER_PIXELS)
+        return HeaderMissing;
+
+    // Read & validate magic code
+    uchar data[HEADER_SIZE];
+    BitPlane::extract(pixels, data, HEADER_MAGIC_SIZE);
+    if(memcmp(data, HEADER_MAGIC, HEADER_MAGIC_SIZE) != 0)
+        return HeaderMissing;
+
+    // Read rest of the header & validate version and layout
+    BitPlane::extract(pixels, data, HEADER_SIZE);
+    if(data[4] != HEADER_VERSION)
+        return HeaderInvalid;
+    if(data[5] != LAYOUT_RASTER && data[5] != LAYOUT_SCATTER)
+        return HeaderInvalid;
+
+    // Validate flags, alpha channel can only be used if the image has one
+    if(data[6] & ~(FLAG_DEPTH_MASK | FLAG_ALPHA))
+        return HeaderInvalid;
+    const int depth = (data[6] & FLAG_DEPTH_MASK) + 1;
+    const bool alpha = (data[6] & FLAG_ALPHA) != 0;
+    if(alpha && !hasAlpha)
+        return HeaderInvalid;
+
+    // Validate payload length
+    const quint32 size = qFromLittleEndian<quint32>(data + 8);
+    if(size > INT_MAX || size > static_cast<quint64>(raster_capacity(pixelCount, depth, alpha)))
+        return HeaderInvalid;
+
+    // Header is valid
+    header->depth = depth;
+    header->alpha = alpha;
+    header->layout = data[5];
+    header->length = static_cast<int>(size);
+    header->checksum = qFromLittleEndian<quint32>(data + 12);
+    return HeaderValid;
+}
+
+/**
+ * @brief diagonal_pixel
+ * @param bits
+ * @param step
+ * @param i
+ * @return
+ *
+ * Returns a pointer to the pixel located at (@a i, @a i), where @a step is equal to the
+ * number of bytes per line of the image plus the size of one pixel.
+ */
+static inline const QRgb* diagonal_pixel(const uchar* bits, const int step, const int i)
+{
+    return reinterpret_cast<const QRgb*>(bits + i * step);
+}
+
+/**
+ * @brief read_byte
+ * @param p1
+ * @param p2
+ * @param p3
+ * @return
+ *
+ * Reads a byte written with the legacy diagonal layout over three consecutive pixels
+ */
+static inline char read_byte(const QRgb p1, const QRgb p2, const QRgb p3)
+{
+    const uint byte = ((p1 >> 16) & 1) << 0 | ((p1 >> 8) & 1) << 1 | (p1 & 1) << 2 |
+                      ((p2 >> 16) & 1) << 3 | ((p2 >> 8) & 1) << 4 | (p2 & 1) << 5 |
+                      ((p3 >> 16) & 1) << 6 | ((p3 >> 8) & 1) << 7;
+
+    return static_cast<char>(byte);
+}
+
+/**
+ * @brief legacy_pixel
+ * @param pixel
+ * @param bits
+ * @return
+ *
+ * Writes the three lowest @a bits to the red, green & blue channels of the given @a pixel
+ * with the legacy diagonal layout (the pixel is made opaque, like older versions did)
+ */
+static inline QRgb legacy_pixel(const QRgb pixel, const uint bits)
+{
+    return 0xff000000 | (pixel & 0x00fefefe) |
+           ((bits >> 0) & 1) << 16 | ((bits >> 1) & 1) << 8 | ((bits >> 2) & 1);
+}
+
+/**
+ * @brief decode_diagonal
+ * @param image
+ * @param differential
+ * @return
+ *
+ * Decodes the data of images generated by older versions of the program, where only the
+ * diagonal of the image contains data (three pixels per byte) and the data starts with the
+ * @c{$DATA_LENGTH$} header. If the header is valid and @a differential is not null, the pixels
+ * of the diagonal are marked as modified in the @a differential image.
+ *
+ * Images that do not start with a valid header are discarded as soon as an unexpected byte
+ * is found.
+ */
+static QByteArray decode_diagonal(const QImage& image, DifferentialImage* differential)
+{
+    // Get raw pixel data & number of bytes stored in the diagonal
+    const int cat = qMin(image.width(), image.height());
+    const int step = image.bytesPerLine() + static_cast<int>(sizeof(QRgb));
+    const uchar* bits = image.constBits();
+    const int bytes = cat / 3;
+
+    // Get the byte stored at the given position of the diagonal
+    auto byteAt = [bits, step](const int index) {
+        return read_byte(*diagonal_pixel(bits, step, 3 * index + 0),
+                         *diagonal_pixel(bits, step, 3 * index + 1),
+                         *diagonal_pixel(bits, step, 3 * index + 2));
+    };
+
+    // Parse the $DATA_LENGTH$ header
+    int index = 1;
+    qint64 length = -1;
+    if(bytes > 0 && byteAt(0) == '$') {
+        qint64 value = 0;
+        for(; index < bytes && index <= LEGACY_MAX_DIGITS + 1; ++index) {
+            const char byte = byteAt(index);
+            if(byte == '$') {
+                if(index > 1)
+                    length = value;
+
+                ++index;
+                break;
+            }
+
+            else if(byte < '0' || byte > '9')
+                break;
+
+            value = value * 10 + (byte - '0');
+        }
+    }
+
+    // Header is invalid or data does not fit in the image
+    if(length < 0 || length > bytes - index)
+        return QByteArray();
+
+    // Read data
+    QByteArray data(static_cast<int>(length), 0);
+    for(int i = 0; i < data.length(); ++i)
+        data[i] = byteAt(index + i);
+
+    // Regenerate data image (if required)
+    if(!differential)
+        return data;
+
+    *differential = DifferentialImage(image);
+    for(int i = 0; i < cat; ++i)
+        differential->addRun(static_cast<qint64>(i) * image.width() + i, 1);
+
+    // Return data
+    return data;
+}
+
+/**
+ * @brief read_pixels
+ * @param reader
+ * @param row
+ * @param column
+ * @param pixels
+ * @param count
+ * @return
+ *
+ * Copies the next @a count pixels (in raster order) of the image being read by @a reader to
+ * @a pixels. The current scan line is stored in @a row and @a column points to the next
+ * pixel of the scan line that has not been copied yet, new scan lines are decoded only when
+ * needed.
+ *
+ * Returns @c false if the image does not have enough pixels or if its data is corrupted.
+ */
+static bool read_pixels(PngRowReader& reader, QVector<QRgb>& row, int& column, QRgb* pixels,
+                        qint64 count)
+{
+    while(count > 0) {
+        // Decode next scan line
+        if(column >= row.count()) {
+            if(!reader.readRow(row.data()))
+                return false;
+
+            column = 0;
+        }
+
+        // Copy pixels from the current scan line
+        const int n = static_cast<int>(qMin<qint64>(count, row.count() - column));
+        memcpy(pixels, row.constData() + column, static_cast<size_t>(n) * sizeof(QRgb));
+        pixels += n;
+        column += n;
+        count -= n;
+    }
+
+    return true;
+}
+
+/**
+ * @brief decode_rows
+ * @param reader
+ * @param fallback
+ * @return
+ *
+ * Reads the raster header & the data from the rows of the given PNG @a reader, stopping as
+ * soon as the data has been read.
+ *
+ * If the image cannot be read row by row (e.g. it is not a PNG image or it is interlaced), if
+ * it does not use the raster layout or if its payload is scattered over the whole image,
+ * @a fallback is set to @c true so that the caller can decode the image by other means.
+ */
+static QByteArray decode_rows(PngRowReader& reader, bool* fallback)
+{
+    Q_ASSERT(fallback);
+
+    // Image cannot be read row by row
+    *fallback = !reader.isValid();
+    if(*fallback)
+        return QByteArray();
+
+    // Initialize scan line buffer
+    QVector<QRgb> row(reader.width());
+    int column = row.count();
+    const qint64 pixelCount = static_cast<qint64>(reader.width()) * reader.height();
+
+    // Read header
+    RasterHeader header;
+    HeaderStatus status = HeaderMissing;
+    if(pixelCount >= HEADER_PIXELS) {
+        QRgb headerPixels[HEADER_PIXELS];
+        if(!read_pixels(reader, row, column, headerPixels, HEADER_PIXELS))
+            return QByteArray();
+
+        status = read_raster_header(headerPixels, pixelCount, reader.hasAlphaChannel(), &header);
+    }
+
+    // Image does not use the raster layout, it must be decoded with the diagonal layout
+    *fallback = status == HeaderMissing;
+    if(status != HeaderValid)
+        return QByteArray();
+
+    // Scattered data can be anywhere in the image, it must be decoded from the whole image
+    *fallback = header.layout == LAYOUT_SCATTER;
+    if(*fallback)
+        return QByteArray();
+
+    // Read data in chunks of whole pixel groups
+    QByteArray data(header.length, 0);
+    uchar* dataBytes = reinterpret_cast<uchar*>(data.data());
+    const int chunkBytes = BitPlane::groupBytes(header.depth, header.alpha) * STREAM_CHUNK_GROUPS;
+    QVector<QRgb> chunk(BitPlane::pixelsForBytes(qMin(chunkBytes, header.length),
+                                                 header.depth,
+                                                 header.alpha));
+    for(int offset = 0; offset < header.length; offset += chunkBytes) {
+        const int bytes = qMin(chunkBytes, header.length - offset);
+        const int pixels = BitPlane::pixelsForBytes(bytes, header.depth, header.alpha);
+        if(!read_pixels(reader, row, column, chunk.data(), pixels))
+            return QByteArray();
+
+        BitPlane::extract(chunk.constData(), dataBytes + offset, bytes, header.depth, header.alpha);
+    }
+
+    // Data is corrupted, abort
+    if(Checksum::crc32c(data.constData(), data.length()) != header.checksum)
+        return QByteArray();
+
+    // Return data
+    return data;
+}
+
+/**
+ * @brief read_region
+ * @param device
+ * @param rect
+ * @return
+ *
+ * Reads the given @a rect of the image stored in the @a device (or the whole image if @a rect
+ * is not valid). Image formats that support clipping only decode the requested region.
+ */
+static QImage read_region(QIODevice* device, const QRect& rect)
+{
+    device->seek(0);
+    QImageReader reader(device);
+    if(rect.isValid())
+        reader.setClipRect(rect);
+
+    return normalized_image(reader.read());
+}
+
+/**
+ * @brief differential_image
+ * @param image
+ * @param pixels
+ * @return
+ *
+ * Returns a differential image in which the first @a pixels pixels of the given @a image,
+ * which are the pixels touched by the raster layout, are marked as modified.
+ */
+static DifferentialImage differential_image(const QImage& image, const qint64 pixels)
+{
+    DifferentialImage differential(image);
+    differential.addRun(0, pixels);
+    return differential;
+}
+
+/**
+ * @brief scatter_batch_bytes
+ * @param depth
+ * @param alpha
+ * @return
+ *
+ * Returns the number of payload bytes that fill a batch of (at most) SCATTER_BATCH_PIXELS
+ * pixels, rounded down to whole pixel groups
+ */
+static int scatter_batch_bytes(const int depth, const bool alpha)
+{
+    const int group = BitPlane::groupBytes(depth, alpha);
+    const int groupPixels = group * 8 / BitPlane::bitsPerPixel(depth, alpha);
+    return qMax(1, SCATTER_BATCH_PIXELS / groupPixels) * group;
+}
+
+/**
+ * @brief embed_scattered
+ * @param pixels
+ * @param layout
+ * @param pixel
+ * @param data
+ * @param bytes
+ * @param depth
+ * @param alpha
+ * @param indexes
+ * @param originals
+ *
+ * Writes the given @a bytes of @a data over the payload @a pixels given by the scatter
+ * @a layout, starting at the position of payload pixel @a pixel (which must be the first
+ * pixel of a pixel group).
+ *
+ * Pixels are processed in batches: the positions of a batch are generated together, the
+ * pixels are gathered in a contiguous buffer, the bit plane kernels write the data over the
+ * buffer and the pixels are written back. If @a indexes and @a originals are not null, the
+ * position and the original value of each modified pixel are stored in them.
+ */
+static void embed_scattered(QRgb* pixels, const ScatterLayout& layout, const qint64 pixel,
+                            const uchar* data, const int bytes, const int depth,
+                            const bool alpha, qint64* indexes, QRgb* originals)
+{
+    qint64 batchIndexes[SCATTER_BATCH_PIXELS];
+    QRgb batchPixels[SCATTER_BATCH_PIXELS];
+
+    qint64 first = pixel;
+    const int batchBytes = scatter_batch_bytes(depth, alpha);
+    for(int offset = 0; offset < bytes; offset += batchBytes) {
+        // Gather the pixels of the batch
+        const int count = qMin(batchBytes, bytes - offset);
+        const int n = BitPlane::pixelsForBytes(count, depth, alpha);
+        layout.map(first, n, batchIndexes);
+        for(int i = 0; i < n; ++i)
+            batchPixels[i] = pixels[batchIndexes[i]];
+
+        // Record original pixels
+        if(indexes && originals) {
+            const qint64 slot = first - pixel;
+            memcpy(indexes + slot, batchIndexes, static_cast<size_t>(n) * sizeof(qint64));
+            memcpy(originals + slot, batchPixels, static_cast<size_t>(n) * sizeof(QRgb));
+        }
+
+        // Write data & scatter the pixels back
+        BitPlane::embed(batchPixels, data + offset, count, depth, alpha);
+        for(int i = 0; i < n; ++i)
+            pixels[batchIndexes[i]] = batchPixels[i];
+
+        first += n;
+    }
+}
+
+/**
+ * @brief extract_scattered
+ * @param pixels
+ * @param layout
+ * @param pixel
+ * @param data
+ * @param bytes
+ * @param depth
+ * @param alpha
+ *
+ * Reads @a bytes of @a data from the payload @a pixels given by the scatter @a layout,
+ * starting at the position of payload pixel @a pixel, in the same way as @c embed_scattered().
+ */
+static void extract_scattered(const QRgb* pixels, const ScatterLayout& layout, const qint64 pixel,
+                              uchar* data, const int bytes, const int depth, const bool alpha)
+{
+    qint64 batchIndexes[SCATTER_BATCH_PIXELS];
+    QRgb batchPixels[SCATTER_BATCH_PIXELS];
+
+    qint64 first = pixel;
+    const int batchBytes = scatter_batch_bytes(depth, alpha);
+    for(int offset = 0; offset < bytes; offset += batchBytes) {
+        const int count = qMin(batchBytes, bytes - offset);
+        const int n = BitPlane::pixelsForBytes(count, depth, alpha);
+        layout.map(first, n, batchIndexes);
+        for(int i = 0; i < n; ++i)
+            batchPixels[i] = pixels[batchIndexes[i]];
+
+        BitPlane::extract(batchPixels, data + offset, count, depth, alpha);
+        first += n;
+    }
+}
+
+/**
+ * @brief run_bands
+ * @param bytes
+ * @param depth
+ * @param alpha
+ * @param threads
+ * @param function
+ *
+ * Splits a stream of @a bytes in up to @a threads bands and calls @a function with the byte
+ * offset, the byte count and the pixel offset of each band. Bands are aligned to the pixel
+ * groups of the given @a depth and @a alpha configuration, so that no pixel is shared
+ * between two bands and the result is the same regardless of the number of bands.
+ *
+ * The first band is processed on the calling thread, the rest on the global thread pool.
+ */
+template<typename Function>
+static void run_bands(const int bytes, const int depth, const bool alpha, const int threads,
+                      Function function)
+{
+    // Calculate number of bands
+    const int group = BitPlane::groupBytes(depth, alpha);
+    const int bands = qBound(1, qMin(threads, bytes / PARALLEL_BAND_BYTES), 256);
+    if(bands == 1) {
+        function(0, bytes, 0);
+        return;
+    }
+
+    // Calculate band size (multiple of the pixel group size)
+    int bandBytes = (bytes + bands - 1) / bands;
+    bandBytes = (bandBytes + group - 1) / group * group;
+
+    // Process bands in parallel
+    const int bitsPerPixel = BitPlane::bitsPerPixel(depth, alpha);
+    QVector<QFuture<void>> futures;
+    for(int offset = bandBytes; offset < bytes; offset += bandBytes) {
+        const int count = qMin(bandBytes, bytes - offset);
+        const qint64 pixel = static_cast<qint64>(offset) * 8 / bitsPerPixel;
+        futures.append(QtConcurrent::run([=]() {
+            function(offset, count, pixel);
+        }));
+    }
+
+    // Process first band on the calling thread & wait for the rest
+    function(0, qMin(bandBytes, bytes), 0);
+    for(int i = 0; i < futures.count(); ++i)
+        futures[i].waitForFinished();
+}
+
+/**
+ * @brief LsbCodec::LsbCodec
+ *
+ * Creates a codec that writes one bit per color channel, does not use the alpha channel and
+ * uses as many threads as there are CPU cores
+ */
+LsbCodec::LsbCodec() :
+    m_bitsPerChannel(1),
+    m_useAlphaChannel(false),
+    m_threadCount(0)
+{
+}
+
+/**
+ * @brief LsbCodec::scatterKey
+ * @return
+ *
+ * Returns the key used to scatter the payload over the cover, or an empty byte array if the
+ * payload is written in raster order
+ */
+QByteArray LsbCodec::scatterKey() const
+{
+    return m_scatterKey;
+}
+
+/**
+ * @brief LsbCodec::setScatterKey
+ * @param key
+ *
+ * Changes the @a key (e.g. the password shared by the peers) used to scatter the payload
+ * over the whole cover in a pseudo-random order, an empty @a key writes the payload in raster
+ * order. The layout used is stored in the image header, but images that use the scatter
+ * layout can only be decoded with the same key.
+ */
+void LsbCodec::setScatterKey(const QByteArray& key)
+{
+    m_scatterKey = key;
+}
+
+/**
+ * @brief LsbCodec::bitsPerChannel
+ * @return
+ *
+ * Returns the number of low bits of each color channel that are used to store data
+ */
+int LsbCodec::bitsPerChannel() const
+{
+    return m_bitsPerChannel;
+}
+
+/**
+ * @brief LsbCodec::useAlphaChannel
+ * @return
+ *
+ * Returns @c true if the codec shall also store data on the alpha channel of the cover
+ */
+bool LsbCodec::useAlphaChannel() const
+{
+    return m_useAlphaChannel;
+}
+
+/**
+ * @brief LsbCodec::setBitsPerChannel
+ * @param bits
+ *
+ * Changes the number of low @a bits (1 to 4) of each color channel that are used to store
+ * data. The value is stored in the image header, so the decoder detects it automatically.
+ */
+void LsbCodec::setBitsPerChannel(const int bits)
+{
+    m_bitsPerChannel = qBound(1, bits, 4);
+}
+
+/**
+ * @brief LsbCodec::enableAlphaChannel
+ * @param enabled
+ *
+ * If @a enabled is set to @c true, data will also be stored over the alpha channel of covers
+ * that have one.
+ */
+void LsbCodec::enableAlphaChannel(const bool enabled)
+{
+    m_useAlphaChannel = enabled;
+}
+
+/**
+ * @brief LsbCodec::threadCount
+ * @return
+ *
+ * Returns the maximum number of threads used to encode/decode large payloads
+ */
+int LsbCodec::threadCount() const
+{
+    if(m_threadCount <= 0)
+        return QThread::idealThreadCount();
+
+    return m_threadCount;
+}
+
+/**
+ * @brief LsbCodec::setThreadCount
+ * @param threads
+ *
+ * Changes the maximum number of @a threads used to encode/decode large payloads, a value of
+ * zero (the default) uses one thread per CPU core.
+ */
+void LsbCodec::setThreadCount(const int threads)
+{
+    m_threadCount = qMax(0, threads);
+}
+
+/**
+ * @brief LsbCodec::capacity
+ * @param size
+ * @param bitsPerChannel
+ * @param alpha
+ * @return
+ *
+ * Returns the maximum number of payload bytes that can be stored in a cover of the given
+ * @a size with @a bitsPerChannel bits per channel (and the alpha channel if @a alpha is set
+ * to @c true). This does not depend on the contents of the cover, so it can be used to check
+ * a payload before any image is loaded or generated.
+ */
+qint64 LsbCodec::capacity(const QSize& size, const int bitsPerChannel, const bool alpha)
+{
+    if(size.width() <= 0 || size.height() <= 0)
+        return 0;
+
+    const qint64 pixels = static_cast<qint64>(size.width()) * size.height();
+    return raster_capacity(pixels, qBound(1, bitsPerChannel, 4), alpha);
+}
+
+/**
+ * @brief LsbCodec::requiredCoverSize
+ * @param bytes
+ * @param bitsPerChannel
+ * @param alpha
+ * @return
+ *
+ * Returns the size of the smallest square cover that can hold a payload of the given number
+ * of @a bytes with @a bitsPerChannel bits per channel (and the alpha channel if @a alpha is
+ * set to @c true).
+ */
+QSize LsbCodec::requiredCoverSize(const qint64 bytes, const int bitsPerChannel, const bool alpha)
+{
+    // Get number of pixels needed for the header & data
+    const int depth = qBound(1, bitsPerChannel, 4);
+    const int bitsPerPixel = BitPlane::bitsPerPixel(depth, alpha);
+    const qint64 pixels = HEADER_PIXELS + (qMax<qint64>(0, bytes) * 8 + bitsPerPixel - 1) /
+                          bitsPerPixel;
+
+    // Get side of the square, correct rounding errors of the square root
+    int side = qCeil(qSqrt(static_cast<qreal>(pixels)));
+    while(capacity(QSize(side, side), depth, alpha) < bytes)
+        ++side;
+
+    return QSize(side, side);
+}
+
+/**
+ * @brief LsbCodec::legacyCapacity
+ * @param size
+ * @return
+ *
+ * Returns the maximum number of payload bytes that can be stored in a cover of the given
+ * @a size with the legacy diagonal layout (three pixels of the diagonal per byte, including
+ * the @c{$DATA_LENGTH$} header).
+ */
+qint64 LsbCodec::legacyCapacity(const QSize& size)
+{
+    const qint64 bytes = qMax(0, qMin(size.width(), size.height())) / 3;
+    return qMax<qint64>(0, bytes - 2 - QByteArray::number(bytes).length());
+}
+
+/**
+ * @brief LsbCodec::requiredLegacyCoverSize
+ * @param bytes
+ * @return
+ *
+ * Returns the size of the smallest square cover that can hold a payload of the given number
+ * of @a bytes with the legacy diagonal layout. Unlike the raster layout, the side of the
+ * cover grows linearly with the payload.
+ */
+QSize LsbCodec::requiredLegacyCoverSize(const qint64 bytes)
+{
+    const qint64 length = qMax<qint64>(0, bytes);
+    int side = static_cast<int>(3 * (length + 2 + QByteArray::number(length).length()));
+    while(legacyCapacity(QSize(side, side)) < length)
+        side += 3;
+
+    return QSize(side, side);
+}
+
+/**
+ * @brief LsbCodec::encodeLegacy
+ * @param cover
+ * @param payload
+ * @param differential
+ * @return
+ *
+ * Writes the given @a payload over a copy of the @a cover with the legacy diagonal layout,
+ * which is the only layout that older versions of the program can read. The payload starts
+ * with the @c{$DATA_LENGTH$} header and each byte is written over three pixels of the
+ * diagonal.
+ *
+ * Returns a null image if the @a payload does not fit, see @c legacyCapacity().
+ */
+QImage LsbCodec::encodeLegacy(const QImage& cover, const QByteArray& payload,
+                              DifferentialImage* differential)
+{
+    // Image is too small
+    if(legacyCapacity(cover.size()) < payload.length())
+        return QImage();
+
+    // Add the $DATA_LENGTH$ header
+    QByteArray data;
+    data.reserve(payload.length() + LEGACY_MAX_DIGITS + 2);
+    data.append('$');
+    data.append(QByteArray::number(payload.length()));
+    data.append('$');
+    data.append(payload);
+
+    // Get 32-bit copy of the cover
+    QImage composite = normalized_image(cover);
+    const qint64 step = composite.bytesPerLine() + static_cast<int>(sizeof(QRgb));
+    uchar* bits = composite.bits();
+    auto pixelAt = [bits, step](const int i) {
+        return reinterpret_cast<QRgb*>(bits + i * step);
+    };
+
+    // Write each byte over three pixels of the diagonal
+    for(int i = 0; i < data.length(); ++i) {
+        const uint byte = static_cast<uchar>(data.at(i));
+        QRgb* p1 = pixelAt(3 * i + 0);
+        QRgb* p2 = pixelAt(3 * i + 1);
+        QRgb* p3 = pixelAt(3 * i + 2);
+        *p1 = legacy_pixel(*p1, byte);
+        *p2 = legacy_pixel(*p2, byte >> 3);
+        *p3 = legacy_pixel(*p3, (byte >> 6) | 0x04);
+    }
+
+    // Mark modified pixels in the differential image
+    if(differential) {
+        *differential = DifferentialImage(composite);
+        for(int i = 0; i < 3 * data.length(); ++i)
+            differential->addRun(static_cast<qint64>(i) * composite.width() + i, 1);
+    }
+
+    return composite;
+}
+
+/**
+ * @brief LsbCodec::encode
+ * @param cover
+ * @param payload
+ * @param differential
+ * @return
+ *
+ * Writes the given @a payload over a copy of the @a cover image with the raster layout and
+ * returns the resulting image, the @a cover itself is not modified:
+ *
+ * 1) Pixels are used in raster order (left to right, top to bottom).
+ * 2) The first 43 pixels contain a fixed-size binary header with the format version, the
+ *    number of bits per channel, the data length and the CRC-32C of the data.
+ * 3) After the header is written, the @a payload is written over the following pixels,
+ *    using the low bits of the red, green and blue channels (and alpha, if enabled).
+ *
+ * If a scatter key is set, the payload pixels are not used in raster order: their positions
+ * are given by a keyed permutation of all the pixels that follow the header, so the payload
+ * is spread over the whole image.
+ *
+ * If @a differential is not null, it is set to a (sparse) image that only shows the pixels
+ * that have been modified.
+ *
+ * If the @a cover is too small to hold the @a payload, a null image is returned.
+ */
+QImage LsbCodec::encode(const QImage& cover, const QByteArray& payload,
+                        DifferentialImage* differential) const
+{
+    QImage composite = cover;
+    if(!encodeInPlace(&composite, payload, Q_NULLPTR, differential))
+        return QImage();
+
+    return composite;
+}
+
+/**
+ * @brief LsbCodec::encodeInPlace
+ * @param image
+ * @param payload
+ * @param undo
+ * @param differential
+ * @return
+ *
+ * Writes the given @a payload directly over the pixels of @a image, in the same way as
+ * @c encode(). Images that do not use a 32-bit format are converted first.
+ *
+ * The data of @a image is only copied if it is shared with another QImage, so a long-lived
+ * working image can be used for several messages without copying it each time. If @a undo is
+ * not null, the original value of the modified pixels is recorded in it, so that the image
+ * can be restored after it has been used.
+ *
+ * Returns @c false (and does not modify the image) if the @a payload does not fit.
+ */
+bool LsbCodec::encodeInPlace(QImage* image, const QByteArray& payload, UndoLog* undo,
+                             DifferentialImage* differential) const
+{
+    Q_ASSERT(image);
+
+    // Image is too small, reject the payload before touching any pixel
+    const bool alpha = m_useAlphaChannel && image->hasAlphaChannel();
+    if(capacity(image->size(), m_bitsPerChannel, alpha) < payload.length())
+        return false;
+
+    // Get 32-bit image
+    *image = normalized_image(*image);
+
+    // Configure header (alpha channel is only used if the image has one)
+    RasterHeader header;
+    header.length = payload.length();
+    header.depth = m_bitsPerChannel;
+    header.alpha = alpha;
+    header.layout = m_scatterKey.isEmpty() ? LAYOUT_RASTER : LAYOUT_SCATTER;
+    header.checksum = Checksum::crc32c(payload.constData(), payload.length());
+
+    // Record original value of the pixels that will be modified
+    const qint64 pixels = HEADER_PIXELS + BitPlane::pixelsForBytes(payload.length(),
+                                                                   header.depth,
+                                                                   header.alpha);
+    if(undo)
+        undo->record(*image, 0, header.layout == LAYOUT_RASTER ? pixels : HEADER_PIXELS);
+
+    // Write header & data to image using LSB (this detaches the image only if it is shared)
+    const QByteArray headerData = raster_header(header);
+    QRgb* imageBits = reinterpret_cast<QRgb*>(image->bits());
+    BitPlane::embed(imageBits,
+                    reinterpret_cast<const uchar*>(headerData.constData()),
+                    HEADER_SIZE);
+    const uchar* payloadBytes = reinterpret_cast<const uchar*>(payload.constData());
+    if(header.layout == LAYOUT_RASTER) {
+        run_bands(payload.length(), header.depth, header.alpha, threadCount(),
+        [=](const int offset, const int bytes, const qint64 pixel) {
+            BitPlane::embed(imageBits + HEADER_PIXELS + pixel,
+                            payloadBytes + offset,
+                            bytes,
+                            header.depth,
+                            header.alpha);
+        });
+
+        // Mark modified pixels in the differential image
+        if(differential)
+            *differential = differential_image(*image, pixels);
+
+        return true;
+    }
+
+    // Scatter the data over the pixels that follow the header
+    const ScatterLayout layout(m_scatterKey, pixel_count(*image) - HEADER_PIXELS);
+    QVector<qint64> indexes(undo ? static_cast<int>(pixels - HEADER_PIXELS) : 0);
+    QVector<QRgb> originals(indexes.count());
+    qint64* indexData = undo ? indexes.data() : Q_NULLPTR;
+    QRgb* originalData = undo ? originals.data() : Q_NULLPTR;
+    run_bands(payload.length(), header.depth, header.alpha, threadCount(),
+    [=, &layout](const int offset, const int bytes, const qint64 pixel) {
+        embed_scattered(imageBits + HEADER_PIXELS,
+                        layout,
+                        pixel,
+                        payloadBytes + offset,
+                        bytes,
+                        header.depth,
+                        header.alpha,
+                        indexData ? indexData + pixel : Q_NULLPTR,
+                        originalData ? originalData + pixel : Q_NULLPTR);
+    });
+
+    // Record original value of the scattered pixels
+    if(undo) {
+        for(int i = 0; i < indexes.count(); ++i)
+            indexes[i] += HEADER_PIXELS;
+
+        undo->record(indexes, originals);
+    }
+
+    // Mark modified pixels in the differential image (scattered pixels are not listed)
+    if(differential) {
+        *differential = differential_image(*image, HEADER_PIXELS);
+        differential->addScattered(layout, HEADER_PIXELS, pixels - HEADER_PIXELS);
+    }
+
+    return true;
+}
+
+/**
+ * @brief LsbCodec::decode
+ * @param image
+ * @param differential
+ * @return
+ *
+ * Decodes and returns the data contained in the given @a image. If the data is invalid, or
+ * the image is invalid, an empty byte array will be returned.
+ *
+ * Images that do not contain the raster layout header are decoded with the legacy diagonal
+ * layout, used by older versions of the program.
+ *
+ * If @a differential is not null, it is set to a (sparse) image that only shows the pixels
+ * that contain data (or to a null image if no data was found).
+ */
+QByteArray LsbCodec::decode(const QImage& image, DifferentialImage* differential) const
+{
+    // Get 32-bit image
+    const QImage source = normalized_image(image);
+    if(differential)
+        *differential = DifferentialImage();
+
+    // Image does not use the raster layout, decode it with the diagonal layout
+    RasterHeader header;
+    const QRgb* pixels = reinterpret_cast<const QRgb*>(source.constBits());
+    const HeaderStatus status = read_raster_header(pixels, pixel_count(source),
+                                                   source.hasAlphaChannel(), &header);
+    if(status == HeaderMissing)
+        return decode_diagonal(source, differential);
+
+    // Invalid header, or scattered data without a key, abort
+    if(status == HeaderInvalid)
+        return QByteArray();
+    if(header.layout == LAYOUT_SCATTER && m_scatterKey.isEmpty())
+        return QByteArray();
+
+    // Read data (the output buffer is allocated only once)
+    QByteArray data(header.length, 0);
+    uchar* dataBytes = reinterpret_cast<uchar*>(data.data());
+    const ScatterLayout layout(m_scatterKey, pixel_count(source) - HEADER_PIXELS);
+    run_bands(header.length, header.depth, header.alpha, threadCount(),
+    [=, &layout](const int offset, const int bytes, const qint64 pixel) {
+        if(header.layout == LAYOUT_SCATTER)
+            extract_scattered(pixels + HEADER_PIXELS,
+                              layout,
+                              pixel,
+                              dataBytes + offset,
+                              bytes,
+                              header.depth,
+                              header.alpha);
+        else
+            BitPlane::extract(pixels + HEADER_PIXELS + pixel,
+                              dataBytes + offset,
+                              bytes,
+                              header.depth,
+                              header.alpha);
+    });
+
+    // Data is corrupted (or the scatter key is wrong), abort
+    if(Checksum::crc32c(data.constData(), data.length()) != header.checksum)
+        return QByteArray();
+
+    // Regenerate data image
+    if(differential) {
+        const qint64 touched = BitPlane::pixelsForBytes(header.length,
+                                                        header.depth,
+                                                        header.alpha);
+        if(header.layout == LAYOUT_SCATTER) {
+            *differential = differential_image(source, HEADER_PIXELS);
+            differential->addScattered(layout, HEADER_PIXELS, touched);
+        }
+
+        else
+            *differential = differential_image(source, HEADER_PIXELS + touched);
+    }
+
+    // Return data
+    return data;
+}
+
+/**
+ * @brief LsbCodec::decodePng
+ * @param png
+ * @return
+ *
+ * Decodes and returns the data contained in the given @a png image without loading the whole
+ * image into memory: scan lines are inflated one at a time and decoding stops as soon as the
+ * payload declared in the header has been read, so memory usage does not depend on the size
+ * of the image.
+ *
+ * Interlaced images, images that use the legacy diagonal layout and images that use the
+ * scatter layout (the payload can be anywhere in the image) are loaded as a QImage and
+ * decoded with @c decode().
+ */
+QByteArray LsbCodec::decodePng(const QByteArray& png) const
+{
+    bool fallback = false;
+    PngRowReader reader(png);
+    const QByteArray data = decode_rows(reader, &fallback);
+    if(fallback)
+        return decode(QImage::fromData(png, "PNG"));
+
+    return data;
+}
+
+/**
+ * @brief LsbCodec::decodeFile
+ * @param fileName
+ * @return
+ *
+ * Decodes and returns the data contained in the image stored in the given file, only reading
+ * the region of the image that holds the data:
+ *
+ * - PNG images are read from the file one scan line at a time, up to the last row of the
+ *   payload (the rest of the file is never read).
+ * - Other images (and interlaced PNG images) are read with @c QImageReader::setClipRect(),
+ *   first the rows of the raster header and then the rows of the payload. Images that use
+ *   the legacy diagonal layout are limited to the top-left square of the image.
+ * - Images that use the scatter layout are always read in full.
+ */
+QByteArray LsbCodec::decodeFile(const QString& fileName) const
+{
+    // Open file
+    QFile file(fileName);
+    if(!file.open(QFile::ReadOnly))
+        return QByteArray();
+
+    // Read PNG images row by row
+    bool fallback = false;
+    {
+        PngRowReader reader(&file);
+        const QByteArray data = decode_rows(reader, &fallback);
+        if(!fallback)
+            return data;
+    }
+
+    // Get image size, decode the whole image if the format does not report it
+    file.seek(0);
+    const QSize size = QImageReader(&file).size();
+    if(size.width() <= 0 || size.height() <= 0)
+        return decode(read_region(&file, QRect()));
+
+    // Read the rows that contain the raster header
+    RasterHeader header;
+    HeaderStatus status = HeaderMissing;
+    const qint64 pixelCount = static_cast<qint64>(size.width()) * size.height();
+    if(pixelCount >= HEADER_PIXELS) {
+        const int rows = (HEADER_PIXELS + size.width() - 1) / size.width();
+        const QImage image = read_region(&file, QRect(0, 0, size.width(), rows));
+        if(pixel_count(image) < HEADER_PIXELS)
+            return QByteArray();
+
+        status = read_raster_header(reinterpret_cast<const QRgb*>(image.constBits()),
+                                    pixelCount, image.hasAlphaChannel(), &header);
+    }
+
+    // Invalid header, abort
+    if(status == HeaderInvalid)
+        return QByteArray();
+
+    // Scattered data can be anywhere in the image, read the whole image
+    if(status == HeaderValid && header.layout == LAYOUT_SCATTER)
+        return decode(read_region(&file, QRect()));
+
+    // Legacy images only contain data in the diagonal of the top-left square
+    if(status == HeaderMissing) {
+        const int cat = qMin(size.width(), size.height());
+        return decode_diagonal(read_region(&file, QRect(0, 0, cat, cat)), Q_NULLPTR);
+    }
+
+    // Read the rows that contain the header & data
+    const qint64 pixels = HEADER_PIXELS + BitPlane::pixelsForBytes(header.length,
+                                                                   header.depth,
+                                                                   header.alpha);
+    const qint64 rows = (pixels + size.width() - 1) / size.width();
+    return decode(read_region(&file, QRect(0, 0, size.width(),
+                                           static_cast<int>(qMin<qint64>(rows, size.height())))));
+}
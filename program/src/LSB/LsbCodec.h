@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2020 Alex Spataru <https://github.com/alex-spataru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef LSB_CODEC_H
+#define LSB_CODEC_H
+
+#include <QImage>
+#include <QByteArray>
+
+#include "DifferentialImage.h"
+
+class UndoLog;
+
+/*
+ * Implements the LSB-Write and LSB-Read algorithms without any shared state: each codec only
+ * holds its own configuration, and encode()/decode() never modify the images they receive.
+ *
+ * A codec object can be used from several threads at the same time, as long as it is not
+ * re-configured while encoding or decoding.
+ *
+ * Large payloads are split into bands of consecutive pixels that are processed in parallel,
+ * the output does not depend on the number of threads used.
+ *
+ * When a scatter key is set, the payload is spread over the cover with a keyed permutation of
+ * the pixel indexes that is computed on the fly (see ScatterLayout).
+ *
+ * The legacy diagonal layout is still decoded, and it is only written with encodeLegacy() for
+ * older clients, which cannot read the raster layout.
+ */
+class LsbCodec
+{
+public:
+    LsbCodec();
+
+    int bitsPerChannel() const;
+    bool useAlphaChannel() const;
+    void setBitsPerChannel(const int bits);
+    void enableAlphaChannel(const bool enabled);
+
+    int threadCount() const;
+    void setThreadCount(const int threads);
+
+    QByteArray scatterKey() const;
+    void setScatterKey(const QByteArray& key);
+
+    static qint64 capacity(const QSize& size, const int bitsPerChannel = 1,
+                           const bool alpha = false);
+    static QSize requiredCoverSize(const qint64 bytes, const int bitsPerChannel = 1,
+                                   const bool alpha = false);
+    static qint64 legacyCapacity(const QSize& size);
+    static QSize requiredLegacyCoverSize(const qint64 bytes);
+
+    QImage encode(const QImage& cover, const QByteArray& payload,
+                  DifferentialImage* differential = Q_NULLPTR) const;
+    bool encodeInPlace(QImage* image, const QByteArray& payload, UndoLog* undo = Q_NULLPTR,
+                       DifferentialImage* differential = Q_NULLPTR) const;
+    static QImage encodeLegacy(const QImage& cover, const QByteArray& payload,
+                               DifferentialImage* differential = Q_NULLPTR);
+    QByteArray decode(const QImage& image, DifferentialImage* differential = Q_NULLPTR) const;
+    QByteArray decodePng(const QByteArray& png) const;
+    QByteArray decodeFile(const QString& fileName) const;
+
+private:
+    int m_bitsPerChannel;
+    bool m_useAlphaChannel;
+    int m_threadCount;
+    QByteArray m_scatterKey;
+};
+
+#endif
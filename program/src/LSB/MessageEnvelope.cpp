@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2020 Alex Spataru <https://github.com/alex-spataru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "MessageEnvelope.h"
+
+#include <cstring>
+
+/*
+ * Header fields
+ */
+static const char ENVELOPE_MAGIC[4] = {'L', 'S', 'B', 'E'};
+static const quint8 ENVELOPE_VERSION = 1;
+static const int VERSION_OFFSET = 4;
+static const int FLAGS_OFFSET = 5;
+static const int CIPHER_OFFSET = 6;
+static const int CONTENT_TYPE_OFFSET = 7;
+
+/**
+ * @brief MessageEnvelope::MessageEnvelope
+ *
+ * Creates an envelope for unencrypted data of unknown type
+ */
+MessageEnvelope::MessageEnvelope() :
+    m_cipher(CipherNone),
+    m_contentType(ContentUnknown)
+{
+}
+
+/**
+ * @brief MessageEnvelope::MessageEnvelope
+ * @param cipher
+ * @param contentType
+ *
+ * Creates an envelope for a payload encrypted with the given @a cipher and encoded with the
+ * given @a contentType
+ */
+MessageEnvelope::MessageEnvelope(const Cipher cipher, const ContentType contentType) :
+    m_cipher(cipher),
+    m_contentType(contentType)
+{
+}
+
+/**
+ * @brief MessageEnvelope::isEncrypted
+ * @return
+ *
+ * Returns @c true if the payload is encrypted
+ */
+bool MessageEnvelope::isEncrypted() const
+{
+    return m_cipher != CipherNone;
+}
+
+/**
+ * @brief MessageEnvelope::cipher
+ * @return
+ *
+ * Returns the cipher used to encrypt the payload
+ */
+MessageEnvelope::Cipher MessageEnvelope::cipher() const
+{
+    return m_cipher;
+}
+
+/**
+ * @brief MessageEnvelope::contentType
+ * @return
+ *
+ * Returns the encoding of the (decrypted) payload
+ */
+MessageEnvelope::ContentType MessageEnvelope::contentType() const
+{
+    return m_contentType;
+}
+
+/**
+ * @brief MessageEnvelope::writeHeader
+ * @param header
+ *
+ * Writes the envelope header to the first @c HeaderSize bytes of @a header, which allows
+ * to build the payload after some reserved space and wrap it without copying it.
+ */
+void MessageEnvelope::writeHeader(char* header) const
+{
+    Q_ASSERT(header);
+
+    memcpy(header, ENVELOPE_MAGIC, sizeof(ENVELOPE_MAGIC));
+    header[VERSION_OFFSET] = static_cast<char>(ENVELOPE_VERSION);
+    header[FLAGS_OFFSET] = static_cast<char>(isEncrypted() ? Encrypted : 0);
+    header[CIPHER_OFFSET] = static_cast<char>(m_cipher);
+    header[CONTENT_TYPE_OFFSET] = static_cast<char>(m_contentType);
+}
+
+/**
+ * @brief MessageEnvelope::wrap
+ * @param payload
+ * @return
+ *
+ * Returns the envelope header followed by the given @a payload
+ */
+QByteArray MessageEnvelope::wrap(const QByteArray& payload) const
+{
+    QByteArray data(HeaderSize + payload.length(), Qt::Uninitialized);
+    writeHeader(data.data());
+    if(!payload.isEmpty()) {
+        memcpy(data.data() + HeaderSize, payload.constData(),
+               static_cast<size_t>(payload.length()));
+    }
+
+    return data;
+}
+
+/**
+ * @brief MessageEnvelope::unwrap
+ * @param data
+ * @param envelope
+ * @param payload
+ * @return
+ *
+ * Reads the envelope header of the given @a data and writes the fields to @a envelope and
+ * the rest of the data to @a payload. Returns @c false if @a data does not start with an
+ * envelope (e.g. messages sent by older clients), if the version is not supported or if the
+ * encrypted flag does not match the cipher.
+ */
+bool MessageEnvelope::unwrap(const QByteArray& data, MessageEnvelope* envelope,
+                             QByteArray* payload)
+{
+    Q_ASSERT(envelope);
+    Q_ASSERT(payload);
+
+    // Check magic & version
+    if(data.length() < HeaderSize)
+        return false;
+
+    const uchar* header = reinterpret_cast<const uchar*>(data.constData());
+    if(memcmp(header, ENVELOPE_MAGIC, sizeof(ENVELOPE_MAGIC)) != 0 ||
+            header[VERSION_OFFSET] != ENVELOPE_VERSION)
+        return false;
+
+    // Check fields
+    const bool encrypted = header[FLAGS_OFFSET] & Encrypted;
+    const uchar cipher = header[CIPHER_OFFSET];
+    if(cipher > CipherChaCha20Poly1305 || encrypted != (cipher != CipherNone))
+        return false;
+
+    // Get fields & payload
+    envelope->m_cipher = static_cast<Cipher>(cipher);
+    envelope->m_contentType = static_cast<ContentType>(header[CONTENT_TYPE_OFFSET]);
+    *payload = data.mid(HeaderSize);
+    return true;
+}
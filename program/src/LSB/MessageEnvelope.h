@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2020 Alex Spataru <https://github.com/alex-spataru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef MESSAGE_ENVELOPE_H
+#define MESSAGE_ENVELOPE_H
+
+#include <QtGlobal>
+#include <QByteArray>
+
+/*
+ * Small versioned header written in front of each message before it is embedded in an
+ * image, it tells the receiver how the payload is encrypted and how it is encoded:
+ *
+ *     | Magic "LSBE" (4) | Version (1) | Flags (1) | Cipher (1) | Content type (1) | Payload |
+ *
+ * The receiver dispatches directly to the right decryption & parsing path, instead of trying
+ * to parse the payload first and decrypting it if that fails. Older clients send messages
+ * without an envelope, so data that does not start with the magic bytes must be handled as
+ * a legacy message.
+ */
+class MessageEnvelope
+{
+public:
+    enum {
+        HeaderSize = 8
+    };
+
+    enum Flag {
+        Encrypted = 0x01
+    };
+
+    enum Cipher {
+        CipherNone = 0,
+        CipherLegacy = 1,
+        CipherChaCha20Poly1305 = 2
+    };
+
+    enum ContentType {
+        ContentUnknown = 0,
+        ContentJson = 1,
+        ContentCbor = 2
+    };
+
+    MessageEnvelope();
+    MessageEnvelope(const Cipher cipher, const ContentType contentType);
+
+    bool isEncrypted() const;
+    Cipher cipher() const;
+    ContentType contentType() const;
+
+    void writeHeader(char* header) const;
+    QByteArray wrap(const QByteArray& payload) const;
+    static bool unwrap(const QByteArray& data, MessageEnvelope* envelope, QByteArray* payload);
+
+private:
+    Cipher m_cipher;
+    ContentType m_contentType;
+};
+
+#endif
@@ -0,0 +1,307 @@
+/*
+ * Copyright (c) 2020 Alex Spataru <https://github.com/alex-spataru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "NoiseGenerator.h"
+#include "CpuFeatures.h"
+
+#include <cstring>
+
+#if defined(LSB_X86)
+    #include <immintrin.h>
+#endif
+
+/*
+ * Number of generators that run in parallel & number of pixels produced by each step
+ */
+static const int LANES = 4;
+static const int BLOCK_PIXELS = LANES * 2;
+
+/*
+ * Width of the range of each color channel, channels go from 0x20 to 0x20 + range - 1
+ * (same colors used by previous versions of the program).
+ */
+static const quint32 RED_RANGE = 0xbd;
+static const quint32 GREEN_RANGE = 0x70;
+static const quint32 BLUE_RANGE = 0xdf;
+static const quint32 COLOR_BASE = 0xff202020;
+
+/*
+ * Function signature of the fill kernels, each block contains eight pixels
+ */
+typedef void (*FillKernel)(quint64 (*)[LANES], QRgb*, const qint64);
+
+/**
+ * @brief rotl
+ * @param x
+ * @param k
+ * @return
+ *
+ * Rotates the bits of @a x to the left by @a k positions
+ */
+static inline quint64 rotl(const quint64 x, const int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+/**
+ * @brief splitmix64
+ * @param x
+ * @return
+ *
+ * Advances the given SplitMix64 state and returns the next value, used to expand a 64-bit
+ * seed into the state of the xoshiro256** generators.
+ */
+static inline quint64 splitmix64(quint64& x)
+{
+    quint64 z = (x += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+/**
+ * @brief noise_pixel
+ * @param word
+ * @return
+ *
+ * Maps the three low bytes of a random @a word to the color range of each channel (with a
+ * multiply & shift, which the SIMD kernels reproduce exactly) and returns an opaque pixel.
+ */
+static inline QRgb noise_pixel(const quint32 word)
+{
+    const quint32 r = (((word >> 16) & 0xff) * RED_RANGE) >> 8;
+    const quint32 g = (((word >> 8) & 0xff) * GREEN_RANGE) >> 8;
+    const quint32 b = ((word & 0xff) * BLUE_RANGE) >> 8;
+    return COLOR_BASE + ((r << 16) | (g << 8) | b);
+}
+
+/**
+ * @brief fill_scalar
+ * @param state
+ * @param pixels
+ * @param blocks
+ *
+ * Portable fill kernel, each lane outputs 64 bits per step (two pixels)
+ */
+static void fill_scalar(quint64 (*state)[LANES], QRgb* pixels, const qint64 blocks)
+{
+    for(qint64 i = 0; i < blocks; ++i, pixels += BLOCK_PIXELS) {
+        for(int l = 0; l < LANES; ++l) {
+            const quint64 result = rotl(state[1][l] * 5, 7) * 9;
+            const quint64 t = state[1][l] << 17;
+            state[2][l] ^= state[0][l];
+            state[3][l] ^= state[1][l];
+            state[1][l] ^= state[2][l];
+            state[0][l] ^= state[3][l];
+            state[2][l] ^= t;
+            state[3][l] = rotl(state[3][l], 45);
+
+            pixels[l * 2 + 0] = noise_pixel(static_cast<quint32>(result));
+            pixels[l * 2 + 1] = noise_pixel(static_cast<quint32>(result >> 32));
+        }
+    }
+}
+
+#if defined(LSB_X86)
+/**
+ * @brief fill_sse2
+ * @param state
+ * @param pixels
+ * @param blocks
+ *
+ * SSE2 fill kernel, lanes 0-1 and 2-3 are stored in two registers. The 64-bit multiplications
+ * by 5 and 9 are implemented with shifts and additions.
+ */
+LSB_TARGET("sse2") static void fill_sse2(quint64 (*state)[LANES], QRgb* pixels,
+                                         const qint64 blocks)
+{
+    // Load generator state
+    __m128i s[4][2];
+    for(int w = 0; w < 4; ++w) {
+        s[w][0] = _mm_load_si128(reinterpret_cast<const __m128i*>(state[w]));
+        s[w][1] = _mm_load_si128(reinterpret_cast<const __m128i*>(state[w] + 2));
+    }
+
+    // Color mapping constants
+    const __m128i lowMask = _mm_set1_epi32(0x00ff00ff);
+    const __m128i greenMask = _mm_set1_epi32(0x000000ff);
+    const __m128i rbRange = _mm_set1_epi32(static_cast<int>(RED_RANGE << 16 | BLUE_RANGE));
+    const __m128i gRange = _mm_set1_epi32(static_cast<int>(GREEN_RANGE));
+    const __m128i base = _mm_set1_epi32(static_cast<int>(COLOR_BASE));
+
+    // Generate pixels
+    for(qint64 i = 0; i < blocks; ++i, pixels += BLOCK_PIXELS) {
+        for(int h = 0; h < 2; ++h) {
+            // result = rotl(s1 * 5, 7) * 9
+            __m128i x = _mm_add_epi64(_mm_slli_epi64(s[1][h], 2), s[1][h]);
+            x = _mm_or_si128(_mm_slli_epi64(x, 7), _mm_srli_epi64(x, 57));
+            x = _mm_add_epi64(_mm_slli_epi64(x, 3), x);
+
+            // Advance state
+            const __m128i t = _mm_slli_epi64(s[1][h], 17);
+            s[2][h] = _mm_xor_si128(s[2][h], s[0][h]);
+            s[3][h] = _mm_xor_si128(s[3][h], s[1][h]);
+            s[1][h] = _mm_xor_si128(s[1][h], s[2][h]);
+            s[0][h] = _mm_xor_si128(s[0][h], s[3][h]);
+            s[2][h] = _mm_xor_si128(s[2][h], t);
+            s[3][h] = _mm_or_si128(_mm_slli_epi64(s[3][h], 45), _mm_srli_epi64(s[3][h], 19));
+
+            // Map random bytes to colors
+            __m128i rb = _mm_and_si128(x, lowMask);
+            rb = _mm_srli_epi16(_mm_mullo_epi16(rb, rbRange), 8);
+            __m128i g = _mm_and_si128(_mm_srli_epi32(x, 8), greenMask);
+            g = _mm_slli_epi32(_mm_srli_epi16(_mm_mullo_epi16(g, gRange), 8), 8);
+            const __m128i color = _mm_add_epi32(_mm_or_si128(rb, g), base);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + h * 4), color);
+        }
+    }
+
+    // Store generator state
+    for(int w = 0; w < 4; ++w) {
+        _mm_store_si128(reinterpret_cast<__m128i*>(state[w]), s[w][0]);
+        _mm_store_si128(reinterpret_cast<__m128i*>(state[w] + 2), s[w][1]);
+    }
+}
+
+/**
+ * @brief fill_avx2
+ * @param state
+ * @param pixels
+ * @param blocks
+ *
+ * AVX2 fill kernel, all four lanes are stored in a single register
+ */
+LSB_TARGET("avx2") static void fill_avx2(quint64 (*state)[LANES], QRgb* pixels,
+                                         const qint64 blocks)
+{
+    // Load generator state
+    __m256i s[4];
+    for(int w = 0; w < 4; ++w)
+        s[w] = _mm256_load_si256(reinterpret_cast<const __m256i*>(state[w]));
+
+    // Color mapping constants
+    const __m256i lowMask = _mm256_set1_epi32(0x00ff00ff);
+    const __m256i greenMask = _mm256_set1_epi32(0x000000ff);
+    const __m256i rbRange = _mm256_set1_epi32(static_cast<int>(RED_RANGE << 16 | BLUE_RANGE));
+    const __m256i gRange = _mm256_set1_epi32(static_cast<int>(GREEN_RANGE));
+    const __m256i base = _mm256_set1_epi32(static_cast<int>(COLOR_BASE));
+
+    // Generate pixels
+    for(qint64 i = 0; i < blocks; ++i, pixels += BLOCK_PIXELS) {
+        // result = rotl(s1 * 5, 7) * 9
+        __m256i x = _mm256_add_epi64(_mm256_slli_epi64(s[1], 2), s[1]);
+        x = _mm256_or_si256(_mm256_slli_epi64(x, 7), _mm256_srli_epi64(x, 57));
+        x = _mm256_add_epi64(_mm256_slli_epi64(x, 3), x);
+
+        // Advance state
+        const __m256i t = _mm256_slli_epi64(s[1], 17);
+        s[2] = _mm256_xor_si256(s[2], s[0]);
+        s[3] = _mm256_xor_si256(s[3], s[1]);
+        s[1] = _mm256_xor_si256(s[1], s[2]);
+        s[0] = _mm256_xor_si256(s[0], s[3]);
+        s[2] = _mm256_xor_si256(s[2], t);
+        s[3] = _mm256_or_si256(_mm256_slli_epi64(s[3], 45), _mm256_srli_epi64(s[3], 19));
+
+        // Map random bytes to colors
+        __m256i rb = _mm256_and_si256(x, lowMask);
+        rb = _mm256_srli_epi16(_mm256_mullo_epi16(rb, rbRange), 8);
+        __m256i g = _mm256_and_si256(_mm256_srli_epi32(x, 8), greenMask);
+        g = _mm256_slli_epi32(_mm256_srli_epi16(_mm256_mullo_epi16(g, gRange), 8), 8);
+        const __m256i color = _mm256_add_epi32(_mm256_or_si256(rb, g), base);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels), color);
+    }
+
+    // Store generator state
+    for(int w = 0; w < 4; ++w)
+        _mm256_store_si256(reinterpret_cast<__m256i*>(state[w]), s[w]);
+}
+#endif
+
+/**
+ * @brief fill_kernel
+ * @return
+ *
+ * Returns the fastest fill kernel supported by the current CPU
+ */
+static FillKernel fill_kernel()
+{
+#if defined(LSB_X86)
+    if(CpuFeatures::hasAVX2())
+        return fill_avx2;
+    if(CpuFeatures::hasSSE2())
+        return fill_sse2;
+#endif
+
+    return fill_scalar;
+}
+
+/**
+ * @brief NoiseGenerator::NoiseGenerator
+ * @param seed
+ *
+ * Creates a generator initialized with the given @a seed
+ */
+NoiseGenerator::NoiseGenerator(const quint64 seed)
+{
+    this->seed(seed);
+}
+
+/**
+ * @brief NoiseGenerator::seed
+ * @param seed
+ *
+ * Re-initializes the state of the generator from the given @a seed, generators with the same
+ * seed produce the same sequence of pixels.
+ */
+void NoiseGenerator::seed(const quint64 seed)
+{
+    quint64 x = seed;
+    for(int l = 0; l < LANES; ++l)
+        for(int w = 0; w < 4; ++w)
+            m_state[w][l] = splitmix64(x);
+}
+
+/**
+ * @brief NoiseGenerator::fill
+ * @param pixels
+ * @param count
+ *
+ * Writes @a count random pixels to the given array. Pixels are generated in blocks of eight,
+ * if @a count is not a multiple of eight, the rest of the last block is discarded.
+ */
+void NoiseGenerator::fill(QRgb* pixels, const qint64 count)
+{
+    Q_ASSERT(pixels || count == 0);
+
+    // Generate full blocks
+    static const FillKernel kernel = fill_kernel();
+    const qint64 blocks = count / BLOCK_PIXELS;
+    kernel(m_state, pixels, blocks);
+
+    // Generate last (partial) block
+    const int tail = static_cast<int>(count - blocks * BLOCK_PIXELS);
+    if(tail > 0) {
+        QRgb block[BLOCK_PIXELS];
+        kernel(m_state, block, 1);
+        memcpy(pixels + blocks * BLOCK_PIXELS, block, static_cast<size_t>(tail) * sizeof(QRgb));
+    }
+}
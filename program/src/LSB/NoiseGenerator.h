@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2020 Alex Spataru <https://github.com/alex-spataru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef NOISE_GENERATOR_H
+#define NOISE_GENERATOR_H
+
+#include <QRgb>
+#include <QtGlobal>
+
+/*
+ * Fills 32-bit pixels with random opaque colors using four interleaved xoshiro256**
+ * generators, eight pixels are produced per step (AVX2/SSE2 when available).
+ *
+ * The generator is not suitable for cryptography, its only purpose is to produce cover
+ * images quickly. All code paths produce the same pixels for a given seed, so covers
+ * generated with a fixed seed are reproducible across machines.
+ */
+class NoiseGenerator
+{
+public:
+    explicit NoiseGenerator(const quint64 seed = 0);
+
+    void seed(const quint64 seed);
+    void fill(QRgb* pixels, const qint64 count);
+
+private:
+    alignas(32) quint64 m_state[4][4];
+};
+
+#endif
@@ -0,0 +1,303 @@
+/*
+ * Copyright (c) 2020 Alex Spataru <https://github.com/alex-spataru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "PngRowReader.h"
+
+#include <QIODevice>
+
+#include <png.h>
+#include <cstring>
+
+/**
+ * @brief png_error_handler
+ * @param png
+ * @param message
+ *
+ * Called by libpng when the image data is invalid, returns to the last @c setjmp() point
+ * without printing anything (invalid images are expected when receiving data).
+ */
+static void png_error_handler(png_structp png, png_const_charp message)
+{
+    Q_UNUSED(message)
+    png_longjmp(png, 1);
+}
+
+/**
+ * @brief png_warning_handler
+ * @param png
+ * @param message
+ *
+ * Ignores libpng warnings
+ */
+static void png_warning_handler(png_structp png, png_const_charp message)
+{
+    Q_UNUSED(png)
+    Q_UNUSED(message)
+}
+
+/**
+ * @brief PngRowReader::PngRowReader
+ * @param data
+ *
+ * Parses the header of the PNG image contained in the given @a data and configures libpng to
+ * produce 32-bit rows, no pixel data is decoded until @c readRow() is called.
+ */
+PngRowReader::PngRowReader(const QByteArray& data) :
+    m_png(Q_NULLPTR),
+    m_info(Q_NULLPTR),
+    m_valid(false),
+    m_width(0),
+    m_height(0),
+    m_currentRow(0),
+    m_alpha(false),
+    m_data(data),
+    m_position(0),
+    m_device(Q_NULLPTR)
+{
+    open(m_data.left(8));
+}
+
+/**
+ * @brief PngRowReader::PngRowReader
+ * @param device
+ *
+ * Parses the header of the PNG image read from the given (open) @a device, the rest of the
+ * image is read from the device as the rows are decoded.
+ */
+PngRowReader::PngRowReader(QIODevice* device) :
+    m_png(Q_NULLPTR),
+    m_info(Q_NULLPTR),
+    m_valid(false),
+    m_width(0),
+    m_height(0),
+    m_currentRow(0),
+    m_alpha(false),
+    m_position(0),
+    m_device(device)
+{
+    Q_ASSERT(device);
+    open(m_device->peek(8));
+}
+
+/**
+ * @brief PngRowReader::open
+ * @param signature
+ *
+ * Checks the PNG @a signature, reads the image header and configures libpng to produce
+ * 32-bit rows
+ */
+void PngRowReader::open(const QByteArray& signature)
+{
+    // Check PNG signature
+    if(signature.length() < 8 ||
+       png_sig_cmp(reinterpret_cast<png_const_bytep>(signature.constData()), 0, 8) != 0)
+        return;
+
+    // Create libpng structures
+    m_png = png_create_read_struct(PNG_LIBPNG_VER_STRING,
+                                   Q_NULLPTR,
+                                   &png_error_handler,
+                                   &png_warning_handler);
+    if(!m_png)
+        return;
+
+    m_info = png_create_info_struct(m_png);
+    if(!m_info)
+        return;
+
+    // libpng reports errors by jumping here
+    if(setjmp(png_jmpbuf(m_png)))
+        return;
+
+    // Read image header
+    png_set_read_fn(m_png, this, &PngRowReader::readData);
+    png_read_info(m_png, m_info);
+
+    // Interlaced images cannot be read in raster order
+    if(png_get_interlace_type(m_png, m_info) != PNG_INTERLACE_NONE)
+        return;
+
+    // Convert palette, grayscale & 16-bit images to 8-bit RGB
+    const int colorType = png_get_color_type(m_png, m_info);
+    const int bitDepth = png_get_bit_depth(m_png, m_info);
+    if(colorType == PNG_COLOR_TYPE_PALETTE)
+        png_set_palette_to_rgb(m_png);
+    if(colorType == PNG_COLOR_TYPE_GRAY && bitDepth < 8)
+        png_set_expand_gray_1_2_4_to_8(m_png);
+    if(colorType == PNG_COLOR_TYPE_GRAY || colorType == PNG_COLOR_TYPE_GRAY_ALPHA)
+        png_set_gray_to_rgb(m_png);
+    if(bitDepth == 16)
+        png_set_scale_16(m_png);
+
+    // Obtain alpha channel (tRNS chunk or RGBA/GA color types)
+    m_alpha = (colorType & PNG_COLOR_MASK_ALPHA) != 0;
+    if(png_get_valid(m_png, m_info, PNG_INFO_tRNS)) {
+        png_set_tRNS_to_alpha(m_png);
+        m_alpha = true;
+    }
+
+    // Write pixels as 0xAARRGGBB words, like QImage does
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+    if(m_alpha)
+        png_set_swap_alpha(m_png);
+    else
+        png_set_filler(m_png, 0xff, PNG_FILLER_BEFORE);
+#else
+    png_set_bgr(m_png);
+    if(!m_alpha)
+        png_set_filler(m_png, 0xff, PNG_FILLER_AFTER);
+#endif
+
+    // Apply transformations & validate row size
+    png_read_update_info(m_png, m_info);
+    if(png_get_rowbytes(m_png, m_info) != png_get_image_width(m_png, m_info) * sizeof(QRgb))
+        return;
+
+    // Image is valid
+    m_width = static_cast<int>(png_get_image_width(m_png, m_info));
+    m_height = static_cast<int>(png_get_image_height(m_png, m_info));
+    m_valid = m_width > 0 && m_height > 0;
+}
+
+/**
+ * @brief PngRowReader::~PngRowReader
+ *
+ * Releases the libpng structures, rows that have not been read are never decoded
+ */
+PngRowReader::~PngRowReader()
+{
+    if(m_png)
+        png_destroy_read_struct(&m_png, m_info ? &m_info : Q_NULLPTR, Q_NULLPTR);
+}
+
+/**
+ * @brief PngRowReader::isValid
+ * @return
+ *
+ * Returns @c true if the data contains a non-interlaced PNG image that can be read row by row
+ */
+bool PngRowReader::isValid() const
+{
+    return m_valid;
+}
+
+/**
+ * @brief PngRowReader::width
+ * @return
+ *
+ * Returns the width of the image (in pixels)
+ */
+int PngRowReader::width() const
+{
+    return m_width;
+}
+
+/**
+ * @brief PngRowReader::height
+ * @return
+ *
+ * Returns the height of the image (in pixels)
+ */
+int PngRowReader::height() const
+{
+    return m_height;
+}
+
+/**
+ * @brief PngRowReader::currentRow
+ * @return
+ *
+ * Returns the index of the next row that will be returned by @c readRow()
+ */
+int PngRowReader::currentRow() const
+{
+    return m_currentRow;
+}
+
+/**
+ * @brief PngRowReader::hasAlphaChannel
+ * @return
+ *
+ * Returns @c true if the image has an alpha channel (or a transparent color), in which case
+ * QImage would load it with the ARGB32 format.
+ */
+bool PngRowReader::hasAlphaChannel() const
+{
+    return m_alpha;
+}
+
+/**
+ * @brief PngRowReader::readRow
+ * @param row
+ * @return
+ *
+ * Decodes the next scan line of the image into @a row, which must have room for @c width()
+ * pixels. Only the compressed data needed to decode the row is inflated.
+ *
+ * Returns @c false if all rows have been read or if the image data is corrupted.
+ */
+bool PngRowReader::readRow(QRgb* row)
+{
+    Q_ASSERT(row);
+
+    // No more rows to read
+    if(!m_valid || m_currentRow >= m_height)
+        return false;
+
+    // Invalid image data, stop reading
+    if(setjmp(png_jmpbuf(m_png))) {
+        m_valid = false;
+        return false;
+    }
+
+    // Read row
+    png_read_row(m_png, reinterpret_cast<png_bytep>(row), Q_NULLPTR);
+    ++m_currentRow;
+    return true;
+}
+
+/**
+ * @brief PngRowReader::readData
+ * @param png
+ * @param data
+ * @param length
+ *
+ * Feeds libpng with the next @a length bytes of the image data, the data is read directly
+ * from the byte array (or from the device) given in the constructor.
+ */
+void PngRowReader::readData(png_struct_def* png, uchar* data, size_t length)
+{
+    PngRowReader* reader = static_cast<PngRowReader*>(png_get_io_ptr(png));
+    if(reader->m_device) {
+        const qint64 bytes = static_cast<qint64>(length);
+        if(reader->m_device->read(reinterpret_cast<char*>(data), bytes) != bytes)
+            png_error(png, "Unexpected end of PNG data");
+
+        return;
+    }
+
+    if(static_cast<qint64>(length) > reader->m_data.length() - reader->m_position)
+        png_error(png, "Unexpected end of PNG data");
+
+    memcpy(data, reader->m_data.constData() + reader->m_position, length);
+    reader->m_position += static_cast<qint64>(length);
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2020 Alex Spataru <https://github.com/alex-spataru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef PNG_ROW_READER_H
+#define PNG_ROW_READER_H
+
+#include <QRgb>
+#include <QByteArray>
+
+class QIODevice;
+struct png_info_def;
+struct png_struct_def;
+
+/*
+ * Reads a PNG image one scan line at a time with libpng, so that only the compressed data, a
+ * single decoded row and the zlib window are kept in memory. Rows are converted to the pixel
+ * layout of QImage::Format_RGB32/ARGB32 (non-premultiplied).
+ *
+ * When reading from a device (e.g. a file), the compressed data is also read on demand, so
+ * the rows after the last row that is read are never loaded into memory.
+ *
+ * Interlaced images cannot be read in raster order without decoding the whole image, so they
+ * are reported as invalid and callers shall fall back to QImage.
+ */
+class PngRowReader
+{
+public:
+    explicit PngRowReader(const QByteArray& data);
+    explicit PngRowReader(QIODevice* device);
+    ~PngRowReader();
+
+    bool isValid() const;
+    int width() const;
+    int height() const;
+    int currentRow() const;
+    bool hasAlphaChannel() const;
+
+    bool readRow(QRgb* row);
+
+private:
+    Q_DISABLE_COPY(PngRowReader)
+
+    void open(const QByteArray& signature);
+    static void readData(png_struct_def* png, uchar* data, size_t length);
+
+    png_struct_def* m_png;
+    png_info_def* m_info;
+    bool m_valid;
+    int m_width;
+    int m_height;
+    int m_currentRow;
+    bool m_alpha;
+    QByteArray m_data;
+    qint64 m_position;
+    QIODevice* m_device;
+};
+
+#endif
@@ -0,0 +1,647 @@
+/*
+ * Copyright (c) 2020 Alex Spataru <https://github.com/alex-spataru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "PngWriter.h"
+
+#include <QThread>
+#include <QVector>
+#include <QFuture>
+#include <QThreadPool>
+#include <QtConcurrent>
+
+#include <png.h>
+#include <zlib.h>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+/*
+ * Images with at least two stripes of filtered data are compressed in parallel, each stripe is
+ * deflated on its own with the last 32 KB of the previous stripe as preset dictionary
+ */
+static const int STRIPE_BYTES = 256 * 1024;
+static const int DICTIONARY_BYTES = 32 * 1024;
+
+/*
+ * PNG file signature
+ */
+static const uchar PNG_SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+/*
+ * Compression settings used by each profile
+ */
+struct CompressionSettings {
+    int level;
+    int memLevel;
+    int strategy;
+    int filters;
+};
+
+/**
+ * @brief compression_settings
+ * @param profile
+ * @return
+ *
+ * Returns the zlib/libpng settings used by the given compression @a profile
+ */
+static CompressionSettings compression_settings(const PngWriter::Profile profile)
+{
+    CompressionSettings settings;
+    switch(profile) {
+    case PngWriter::ProfileSmallest:
+        settings.level = 9;
+        settings.memLevel = 9;
+        settings.strategy = Z_FILTERED;
+        settings.filters = PNG_ALL_FILTERS;
+        break;
+    case PngWriter::ProfileBalanced:
+        settings.level = 6;
+        settings.memLevel = 8;
+        settings.strategy = Z_FILTERED;
+        settings.filters = PNG_FILTER_SUB | PNG_FILTER_UP | PNG_FILTER_PAETH;
+        break;
+    default:
+        settings.level = 1;
+        settings.memLevel = 8;
+        settings.strategy = Z_RLE;
+        settings.filters = PNG_FILTER_SUB;
+        break;
+    }
+
+    return settings;
+}
+
+/**
+ * @brief write_data
+ * @param png
+ * @param data
+ * @param length
+ *
+ * Appends the data produced by libpng to the output byte array
+ */
+static void write_data(png_structp png, png_bytep data, size_t length)
+{
+    QByteArray* output = static_cast<QByteArray*>(png_get_io_ptr(png));
+    output->append(reinterpret_cast<const char*>(data), static_cast<int>(length));
+}
+
+/**
+ * @brief flush_data
+ * @param png
+ *
+ * Nothing to flush, data is written to memory
+ */
+static void flush_data(png_structp png)
+{
+    Q_UNUSED(png)
+}
+
+/**
+ * @brief png_error_handler
+ * @param png
+ * @param message
+ *
+ * Called by libpng when the image cannot be written, returns to the @c setjmp() point
+ */
+static void png_error_handler(png_structp png, png_const_charp message)
+{
+    Q_UNUSED(message)
+    png_longjmp(png, 1);
+}
+
+/**
+ * @brief png_warning_handler
+ * @param png
+ * @param message
+ *
+ * Ignores libpng warnings
+ */
+static void png_warning_handler(png_structp png, png_const_charp message)
+{
+    Q_UNUSED(png)
+    Q_UNUSED(message)
+}
+
+/*
+ * Compressed data of a row stripe & checksum of its uncompressed (filtered) data
+ */
+struct Stripe {
+    QByteArray data;
+    uLong adler;
+    qint64 length;
+};
+
+/**
+ * @brief pack_row
+ * @param line
+ * @param width
+ * @param alpha
+ * @param output
+ *
+ * Converts a line of 0xAARRGGBB pixels to the RGB or RGBA byte order used by PNG
+ */
+static void pack_row(const QRgb* line, const int width, const bool alpha, uchar* output)
+{
+    for(int x = 0; x < width; ++x) {
+        const QRgb pixel = line[x];
+        *output++ = static_cast<uchar>(qRed(pixel));
+        *output++ = static_cast<uchar>(qGreen(pixel));
+        *output++ = static_cast<uchar>(qBlue(pixel));
+        if(alpha)
+            *output++ = static_cast<uchar>(qAlpha(pixel));
+    }
+}
+
+/**
+ * @brief paeth_predictor
+ * @param a
+ * @param b
+ * @param c
+ * @return
+ *
+ * Returns the neighbour (left, above or upper-left) closest to the linear prediction
+ */
+static inline int paeth_predictor(const int a, const int b, const int c)
+{
+    const int p = a + b - c;
+    const int pa = std::abs(p - a);
+    const int pb = std::abs(p - b);
+    const int pc = std::abs(p - c);
+    if(pa <= pb && pa <= pc)
+        return a;
+    if(pb <= pc)
+        return b;
+
+    return c;
+}
+
+/**
+ * @brief apply_filter
+ * @param type
+ * @param row
+ * @param prior
+ * @param length
+ * @param bpp
+ * @param output
+ * @return
+ *
+ * Writes the filter @a type byte followed by the filtered @a row to @a output and returns the
+ * sum of the filtered bytes as signed values, which is the heuristic used by libpng to choose
+ * between filters.
+ */
+static quint64 apply_filter(const int type, const uchar* row, const uchar* prior,
+                            const int length, const int bpp, uchar* output)
+{
+    quint64 sum = 0;
+    output[0] = static_cast<uchar>(type);
+    for(int i = 0; i < length; ++i) {
+        const int a = i >= bpp ? row[i - bpp] : 0;
+        const int b = prior[i];
+        const int c = i >= bpp ? prior[i - bpp] : 0;
+
+        int predictor = 0;
+        switch(type) {
+        case 1:
+            predictor = a;
+            break;
+        case 2:
+            predictor = b;
+            break;
+        case 3:
+            predictor = (a + b) / 2;
+            break;
+        case 4:
+            predictor = paeth_predictor(a, b, c);
+            break;
+        default:
+            break;
+        }
+
+        const uchar value = static_cast<uchar>(row[i] - predictor);
+        output[i + 1] = value;
+        sum += static_cast<quint64>(std::abs(static_cast<signed char>(value)));
+    }
+
+    return sum;
+}
+
+/**
+ * @brief filter_row
+ * @param row
+ * @param prior
+ * @param length
+ * @param bpp
+ * @param filters
+ * @param output
+ * @param scratch
+ *
+ * Filters the given @a row with the filter (among the enabled @a filters) that yields the
+ * smallest sum of absolute values and writes the filter type & filtered data to @a output.
+ */
+static void filter_row(const uchar* row, const uchar* prior, const int length, const int bpp,
+                       const int filters, uchar* output, uchar* scratch)
+{
+    // Single filter, no need to try the others
+    int count = 0;
+    int single = 0;
+    for(int type = 0; type < 5; ++type) {
+        if(filters & (PNG_FILTER_NONE << type)) {
+            single = type;
+            ++count;
+        }
+    }
+
+    if(count <= 1) {
+        apply_filter(single, row, prior, length, bpp, output);
+        return;
+    }
+
+    // Try each filter & keep the best one in the output buffer
+    bool first = true;
+    quint64 best = 0;
+    for(int type = 0; type < 5; ++type) {
+        if(!(filters & (PNG_FILTER_NONE << type)))
+            continue;
+
+        const quint64 sum = apply_filter(type, row, prior, length, bpp, first ? output : scratch);
+        if(first || sum < best) {
+            if(!first)
+                std::memcpy(output, scratch, static_cast<size_t>(length) + 1);
+
+            best = sum;
+            first = false;
+        }
+    }
+}
+
+/**
+ * @brief compress_stripe
+ * @param image
+ * @param settings
+ * @param firstRow
+ * @param rows
+ * @param last
+ * @param stripe
+ *
+ * Filters & deflates the given range of rows of the @a image to a raw deflate stream, which
+ * ends with a sync flush (or with the final block for the @a last stripe), so that the output
+ * of all stripes can be concatenated into a single stream.
+ *
+ * The rows that precede the stripe are also filtered to prime the compressor with the same
+ * 32 KB dictionary that a sequential encoder would have had at this point of the image.
+ */
+static void compress_stripe(const QImage& image, const CompressionSettings& settings,
+                            const int firstRow, const int rows, const bool last, Stripe* stripe)
+{
+    // Get row sizes
+    const bool alpha = image.hasAlphaChannel();
+    const int bpp = alpha ? 4 : 3;
+    const int length = image.width() * bpp;
+    const int rowBytes = length + 1;
+
+    // Get rows needed for the preset dictionary
+    int dictionaryRows = 0;
+    if(firstRow > 0)
+        dictionaryRows = qMin(firstRow, (DICTIONARY_BYTES + rowBytes - 1) / rowBytes);
+
+    // Filter dictionary & stripe rows
+    const int startRow = firstRow - dictionaryRows;
+    QByteArray filtered((dictionaryRows + rows) * rowBytes, 0);
+    QByteArray scratch(rowBytes, 0);
+    QByteArray prior(length, 0);
+    QByteArray row(length, 0);
+    if(startRow > 0)
+        pack_row(reinterpret_cast<const QRgb*>(image.constScanLine(startRow - 1)),
+                 image.width(), alpha, reinterpret_cast<uchar*>(prior.data()));
+
+    uchar* output = reinterpret_cast<uchar*>(filtered.data());
+    for(int y = startRow; y < firstRow + rows; ++y) {
+        pack_row(reinterpret_cast<const QRgb*>(image.constScanLine(y)),
+                 image.width(), alpha, reinterpret_cast<uchar*>(row.data()));
+        filter_row(reinterpret_cast<const uchar*>(row.constData()),
+                   reinterpret_cast<const uchar*>(prior.constData()),
+                   length, bpp, settings.filters, output,
+                   reinterpret_cast<uchar*>(scratch.data()));
+
+        qSwap(row, prior);
+        output += rowBytes;
+    }
+
+    // Calculate checksum of the stripe data
+    const uchar* data = reinterpret_cast<const uchar*>(filtered.constData());
+    const qint64 dictionaryBytes = static_cast<qint64>(dictionaryRows) * rowBytes;
+    stripe->length = static_cast<qint64>(rows) * rowBytes;
+    stripe->adler = adler32(adler32(0, Q_NULLPTR, 0), data + dictionaryBytes,
+                            static_cast<uInt>(stripe->length));
+
+    // Initialize raw deflate stream (the zlib header & trailer are written by the caller)
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    if(deflateInit2(&stream, settings.level, Z_DEFLATED, -MAX_WBITS,
+                    settings.memLevel, settings.strategy) != Z_OK)
+        return;
+
+    // Prime the compressor with the end of the previous stripe
+    if(dictionaryBytes > 0) {
+        const qint64 size = qMin<qint64>(dictionaryBytes, DICTIONARY_BYTES);
+        deflateSetDictionary(&stream, data + dictionaryBytes - size, static_cast<uInt>(size));
+    }
+
+    // Deflate stripe data
+    const int flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+    const uLong bound = deflateBound(&stream, static_cast<uLong>(stripe->length));
+    stripe->data.resize(static_cast<int>(bound) + 64);
+    stream.next_in = const_cast<Bytef*>(data + dictionaryBytes);
+    stream.avail_in = static_cast<uInt>(stripe->length);
+    forever {
+        stream.next_out = reinterpret_cast<Bytef*>(stripe->data.data()) + stream.total_out;
+        stream.avail_out = static_cast<uInt>(stripe->data.size()) -
+                           static_cast<uInt>(stream.total_out);
+
+        const int result = deflate(&stream, flush);
+        if(result == Z_STREAM_ERROR) {
+            stripe->data.clear();
+            break;
+        }
+
+        if(stream.avail_out != 0 && (!last || result == Z_STREAM_END)) {
+            stripe->data.resize(static_cast<int>(stream.total_out));
+            break;
+        }
+
+        stripe->data.resize(stripe->data.size() + STRIPE_BYTES);
+    }
+
+    deflateEnd(&stream);
+}
+
+/**
+ * @brief write_chunk
+ * @param output
+ * @param type
+ * @param data
+ * @param length
+ *
+ * Appends a PNG chunk with the given @a type and @a data to the @a output
+ */
+static void write_chunk(QByteArray* output, const char* type, const char* data, const int length)
+{
+    // Write length & type
+    uchar header[8];
+    header[0] = static_cast<uchar>(length >> 24);
+    header[1] = static_cast<uchar>(length >> 16);
+    header[2] = static_cast<uchar>(length >> 8);
+    header[3] = static_cast<uchar>(length);
+    std::memcpy(header + 4, type, 4);
+    output->append(reinterpret_cast<const char*>(header), 8);
+
+    // Write data & CRC of type + data
+    uLong crc = crc32(0, header + 4, 4);
+    if(length > 0) {
+        output->append(data, length);
+        crc = crc32(crc, reinterpret_cast<const Bytef*>(data), static_cast<uInt>(length));
+    }
+
+    uchar trailer[4];
+    trailer[0] = static_cast<uchar>(crc >> 24);
+    trailer[1] = static_cast<uchar>(crc >> 16);
+    trailer[2] = static_cast<uchar>(crc >> 8);
+    trailer[3] = static_cast<uchar>(crc);
+    output->append(reinterpret_cast<const char*>(trailer), 4);
+}
+
+/**
+ * @brief write_striped
+ * @param image
+ * @param settings
+ * @param stripeRows
+ * @param threads
+ * @return
+ *
+ * Encodes the given 32-bit @a image in PNG format by compressing stripes of @a stripeRows rows
+ * in parallel (pigz-style). The deflate streams of the stripes are joined by sync flushes and
+ * their checksums are combined, so that the output is a single standard zlib stream, split
+ * in one IDAT chunk per stripe.
+ *
+ * Stripe boundaries do not depend on the number of threads, so the output is always the same.
+ */
+static QByteArray write_striped(const QImage& image, const CompressionSettings& settings,
+                                const int stripeRows, const int threads)
+{
+    // Compress stripes in parallel
+    const int count = (image.height() + stripeRows - 1) / stripeRows;
+    QVector<Stripe> stripes(count);
+    Stripe* results = stripes.data();
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+    QVector<QFuture<void>> futures;
+    for(int i = 1; i < count; ++i) {
+        const int rows = qMin(stripeRows, image.height() - i * stripeRows);
+        futures.append(QtConcurrent::run(&pool, [=, &image, &settings]() {
+            compress_stripe(image, settings, i * stripeRows, rows, i == count - 1, results + i);
+        }));
+    }
+
+    // Process first stripe on the calling thread & wait for the rest
+    compress_stripe(image, settings, 0, qMin(stripeRows, image.height()), count == 1, results);
+    for(int i = 0; i < futures.count(); ++i)
+        futures[i].waitForFinished();
+
+    // Combine checksums & check for errors
+    uLong adler = stripes[0].adler;
+    qint64 size = 0;
+    for(int i = 0; i < count; ++i) {
+        if(stripes[i].data.isEmpty())
+            return QByteArray();
+
+        if(i > 0)
+            adler = adler32_combine(adler, stripes[i].adler,
+                                    static_cast<z_off_t>(stripes[i].length));
+
+        size += stripes[i].data.size() + 12;
+    }
+
+    // Write signature
+    QByteArray output;
+    output.reserve(static_cast<int>(qMin<qint64>(size + 64, INT_MAX)));
+    output.append(reinterpret_cast<const char*>(PNG_SIGNATURE), 8);
+
+    // Write image header (8-bit RGB or RGBA, no interlacing)
+    uchar ihdr[13];
+    const quint32 width = static_cast<quint32>(image.width());
+    const quint32 height = static_cast<quint32>(image.height());
+    for(int i = 0; i < 4; ++i) {
+        ihdr[i] = static_cast<uchar>(width >> (24 - i * 8));
+        ihdr[i + 4] = static_cast<uchar>(height >> (24 - i * 8));
+    }
+    ihdr[8] = 8;
+    ihdr[9] = image.hasAlphaChannel() ? PNG_COLOR_TYPE_RGB_ALPHA : PNG_COLOR_TYPE_RGB;
+    ihdr[10] = PNG_COMPRESSION_TYPE_BASE;
+    ihdr[11] = PNG_FILTER_TYPE_BASE;
+    ihdr[12] = PNG_INTERLACE_NONE;
+    write_chunk(&output, "IHDR", reinterpret_cast<const char*>(ihdr), 13);
+
+    // Add zlib header (32 KB window, compression level hint) to the first stripe
+    static const uchar LEVEL_FLAGS[4] = {0x01, 0x5e, 0x9c, 0xda};
+    int hint = 3;
+    if(settings.level < 2)
+        hint = 0;
+    else if(settings.level < 6)
+        hint = 1;
+    else if(settings.level == 6)
+        hint = 2;
+
+    const char zlibHeader[2] = {0x78, static_cast<char>(LEVEL_FLAGS[hint])};
+    stripes[0].data.prepend(QByteArray(zlibHeader, 2));
+
+    // Add zlib trailer (checksum of the whole stream) to the last stripe
+    const char trailer[4] = {
+        static_cast<char>(adler >> 24), static_cast<char>(adler >> 16),
+        static_cast<char>(adler >> 8), static_cast<char>(adler)
+    };
+    stripes[count - 1].data.append(trailer, 4);
+
+    // Write one IDAT chunk per stripe & end of image
+    for(int i = 0; i < count; ++i)
+        write_chunk(&output, "IDAT", stripes[i].data.constData(), stripes[i].data.size());
+
+    write_chunk(&output, "IEND", Q_NULLPTR, 0);
+    return output;
+}
+
+/**
+ * @brief PngWriter::profileName
+ * @param profile
+ * @return
+ *
+ * Returns the name of the given compression @a profile
+ */
+QString PngWriter::profileName(const Profile profile)
+{
+    switch(profile) {
+    case ProfileSmallest:
+        return "smallest";
+    case ProfileBalanced:
+        return "balanced";
+    default:
+        return "fastest";
+    }
+}
+
+/**
+ * @brief PngWriter::write
+ * @param image
+ * @param profile
+ * @param threads
+ * @return
+ *
+ * Returns the given @a image encoded in PNG format with the given compression @a profile, or
+ * an empty byte array if the image is empty or if there is an error.
+ *
+ * Large images are split in row stripes that are compressed in parallel with up to
+ * @a threads threads (or as many threads as there are CPU cores if @a threads is 0).
+ */
+QByteArray PngWriter::write(const QImage& image, const Profile profile, const int threads)
+{
+    // Empty image, nothing to write
+    QByteArray output;
+    if(image.width() <= 0 || image.height() <= 0)
+        return output;
+
+    // Get 32-bit image (scan lines are written directly from its pixels)
+    QImage source = image;
+    const bool alpha = image.hasAlphaChannel();
+    if(alpha && image.format() != QImage::Format_ARGB32)
+        source = image.convertToFormat(QImage::Format_ARGB32);
+    else if(!alpha && image.format() != QImage::Format_RGB32)
+        source = image.convertToFormat(QImage::Format_RGB32);
+
+    // Compress large images in stripes
+    const int rowBytes = source.width() * (alpha ? 4 : 3) + 1;
+    const int stripeRows = qMax(1, STRIPE_BYTES / rowBytes);
+    if(source.height() >= stripeRows * 2)
+        return write_striped(source, compression_settings(profile), stripeRows,
+                             threads > 0 ? threads : QThread::idealThreadCount());
+
+    // Create libpng structures
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING,
+                                              Q_NULLPTR,
+                                              &png_error_handler,
+                                              &png_warning_handler);
+    if(!png)
+        return output;
+
+    png_infop info = png_create_info_struct(png);
+    if(!info) {
+        png_destroy_write_struct(&png, Q_NULLPTR);
+        return output;
+    }
+
+    // libpng reports errors by jumping here
+    if(setjmp(png_jmpbuf(png))) {
+        png_destroy_write_struct(&png, &info);
+        return QByteArray();
+    }
+
+    // Raw pixel data is the worst case for the output size
+    output.reserve(source.width() * source.height() * (alpha ? 4 : 3) + 1024);
+
+    // Configure compression
+    const CompressionSettings settings = compression_settings(profile);
+    png_set_write_fn(png, &output, &write_data, &flush_data);
+    png_set_compression_level(png, settings.level);
+    png_set_compression_mem_level(png, settings.memLevel);
+    png_set_compression_strategy(png, settings.strategy);
+    png_set_filter(png, PNG_FILTER_TYPE_BASE, settings.filters);
+
+    // Write header
+    png_set_IHDR(png, info,
+                 static_cast<png_uint_32>(source.width()),
+                 static_cast<png_uint_32>(source.height()),
+                 8,
+                 alpha ? PNG_COLOR_TYPE_RGB_ALPHA : PNG_COLOR_TYPE_RGB,
+                 PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_BASE,
+                 PNG_FILTER_TYPE_BASE);
+    png_write_info(png, info);
+
+    // Read pixels as 0xAARRGGBB words, like QImage stores them
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+    if(alpha)
+        png_set_swap_alpha(png);
+    else
+        png_set_filler(png, 0, PNG_FILLER_BEFORE);
+#else
+    png_set_bgr(png);
+    if(!alpha)
+        png_set_filler(png, 0, PNG_FILLER_AFTER);
+#endif
+
+    // Write pixel data
+    for(int y = 0; y < source.height(); ++y)
+        png_write_row(png, const_cast<png_bytep>(source.constScanLine(y)));
+
+    // Finish PNG stream
+    png_write_end(png, info);
+    png_destroy_write_struct(&png, &info);
+    return output;
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2020 Alex Spataru <https://github.com/alex-spataru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef PNG_WRITER_H
+#define PNG_WRITER_H
+
+#include <QImage>
+#include <QByteArray>
+
+/*
+ * Exports images in PNG format with libpng, using named compression profiles that select
+ * the zlib level, the zlib strategy and the PNG row filters:
+ *
+ * - Fastest:  level 1, "sub" filter, run-length encoding only
+ * - Balanced: level 6, "sub", "up" and "paeth" filters (adaptive)
+ * - Smallest: level 9, all filters (adaptive)
+ *
+ * Images with an alpha channel are written as RGBA, other images as RGB. Large images are
+ * compressed in row stripes on several threads, the output is still a single PNG stream.
+ */
+class PngWriter
+{
+public:
+    enum Profile {
+        ProfileFastest,
+        ProfileBalanced,
+        ProfileSmallest
+    };
+
+    static QString profileName(const Profile profile);
+    static QByteArray write(const QImage& image, const Profile profile, const int threads = 0);
+};
+
+#endif
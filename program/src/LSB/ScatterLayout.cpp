@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2020 Alex Spataru <https://github.com/alex-spataru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "ScatterLayout.h"
+
+#include <QtEndian>
+#include <QCryptographicHash>
+
+#include <cstring>
+
+/**
+ * @brief round_function
+ * @param value
+ * @param key
+ * @return
+ *
+ * Mixes the given half-block @a value (at most 31 bits) with a round @a key. A single
+ * multiplication is enough, since the high half of the product depends on every bit of the
+ * input and the network only needs to shuffle pixels, not to resist cryptanalysis (messages
+ * are protected by the crypto module, not by the layout).
+ */
+static inline quint64 round_function(const quint64 value, const quint64 key)
+{
+    const quint64 z = (value ^ key) * 0x9e3779b97f4a7c15ull;
+    return (z >> 32) ^ (z >> 17);
+}
+
+/**
+ * @brief permute
+ * @param value
+ * @param leftBits
+ * @param rightBits
+ * @param keys
+ * @param rounds
+ * @return
+ *
+ * Applies a Feistel network with the given number of @a rounds (and round @a keys) to a
+ * @a value made of a left half of @a leftBits bits and a right half of @a rightBits bits.
+ * When the halves have different sizes, each round updates the left and the right half
+ * alternately instead of swapping them, which is equivalent (the number of rounds is even).
+ */
+static inline quint64 permute(const quint64 value, const int leftBits, const int rightBits,
+                              const quint64* keys, const int rounds)
+{
+    const quint64 leftMask = (Q_UINT64_C(1) << leftBits) - 1;
+    const quint64 rightMask = (Q_UINT64_C(1) << rightBits) - 1;
+
+    quint64 left = value >> rightBits;
+    quint64 right = value & rightMask;
+    for(int i = 0; i < rounds; i += 2) {
+        left ^= round_function(right, keys[i]) & leftMask;
+        right ^= round_function(left, keys[i + 1]) & rightMask;
+    }
+
+    return (left << rightBits) | right;
+}
+
+/**
+ * @brief unpermute
+ * @param value
+ * @param leftBits
+ * @param rightBits
+ * @param keys
+ * @param rounds
+ * @return
+ *
+ * Inverse of @c permute(), the rounds are applied in reverse order
+ */
+static inline quint64 unpermute(const quint64 value, const int leftBits, const int rightBits,
+                                const quint64* keys, const int rounds)
+{
+    const quint64 leftMask = (Q_UINT64_C(1) << leftBits) - 1;
+    const quint64 rightMask = (Q_UINT64_C(1) << rightBits) - 1;
+
+    quint64 left = value >> rightBits;
+    quint64 right = value & rightMask;
+    for(int i = rounds - 2; i >= 0; i -= 2) {
+        right ^= round_function(left, keys[i + 1]) & rightMask;
+        left ^= round_function(right, keys[i]) & leftMask;
+    }
+
+    return (left << rightBits) | right;
+}
+
+/**
+ * @brief ScatterLayout::ScatterLayout
+ * @param key
+ * @param size
+ *
+ * Creates the permutation of the indexes [0, @a size) for the given @a key (e.g. the
+ * password), the round keys are derived from the SHA-256 hash of the key.
+ */
+ScatterLayout::ScatterLayout(const QByteArray& key, const qint64 size) :
+    m_size(qMax<qint64>(0, size))
+{
+    // Get smallest domain (2^bits) that contains all indexes, split it in two halves
+    int bits = 2;
+    while(bits < 62 && (Q_INT64_C(1) << bits) < m_size)
+        ++bits;
+
+    m_leftBits = bits / 2;
+    m_rightBits = bits - m_leftBits;
+
+    // Derive round keys
+    const QByteArray hash = QCryptographicHash::hash(key, QCryptographicHash::Sha256);
+    for(int i = 0; i < Rounds; ++i)
+        m_keys[i] = qFromLittleEndian<quint64>(hash.constData() + i * 8);
+}
+
+/**
+ * @brief ScatterLayout::size
+ * @return
+ *
+ * Returns the number of indexes of the permutation
+ */
+qint64 ScatterLayout::size() const
+{
+    return m_size;
+}
+
+/**
+ * @brief ScatterLayout::map
+ * @param index
+ * @return
+ *
+ * Returns the position of the given @a index in the permutation
+ */
+qint64 ScatterLayout::map(const qint64 index) const
+{
+    Q_ASSERT(index >= 0 && index < m_size);
+
+    // Walk until the value falls inside the range (less than two steps per index on average,
+    // since the domain is less than two times larger than the range)
+    quint64 value = static_cast<quint64>(index);
+    do
+        value = permute(value, m_leftBits, m_rightBits, m_keys, Rounds);
+    while(value >= static_cast<quint64>(m_size));
+
+    return static_cast<qint64>(value);
+}
+
+/**
+ * @brief ScatterLayout::inverse
+ * @param position
+ * @return
+ *
+ * Returns the index that is mapped to the given @a position, the network is walked backwards
+ * in the same way as @c map() walks it forwards.
+ */
+qint64 ScatterLayout::inverse(const qint64 position) const
+{
+    Q_ASSERT(position >= 0 && position < m_size);
+
+    quint64 value = static_cast<quint64>(position);
+    do
+        value = unpermute(value, m_leftBits, m_rightBits, m_keys, Rounds);
+    while(value >= static_cast<quint64>(m_size));
+
+    return static_cast<qint64>(value);
+}
+
+/**
+ * @brief ScatterLayout::map
+ * @param first
+ * @param count
+ * @param indexes
+ *
+ * Writes the positions of @a count consecutive indexes, starting at @a first, to the given
+ * @a indexes array. Generating indexes in batches lets callers gather & scatter pixels
+ * around the (vectorized) bit plane kernels.
+ *
+ * The network is first applied once to every index of the batch (independent operations
+ * without branches, which the CPU can overlap), and then the few values that fall outside of
+ * the range are walked until they fall inside it.
+ */
+void ScatterLayout::map(const qint64 first, const int count, qint64* indexes) const
+{
+    Q_ASSERT(first >= 0 && first + count <= m_size);
+
+    // Copy the parameters, so that they stay in registers while writing the output
+    quint64 keys[Rounds];
+    memcpy(keys, m_keys, sizeof(keys));
+    const qint64 size = m_size;
+    const int leftBits = m_leftBits;
+    const int rightBits = m_rightBits;
+
+    // Apply the network once to each index
+    for(int i = 0; i < count; ++i) {
+        const quint64 value = static_cast<quint64>(first + i);
+        indexes[i] = static_cast<qint64>(permute(value, leftBits, rightBits, keys, Rounds));
+    }
+
+    // Walk the values that fall outside of the range
+    for(int i = 0; i < count; ++i) {
+        while(indexes[i] >= size) {
+            const quint64 value = static_cast<quint64>(indexes[i]);
+            indexes[i] = static_cast<qint64>(permute(value, leftBits, rightBits, keys, Rounds));
+        }
+    }
+}
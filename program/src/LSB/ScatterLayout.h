@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2020 Alex Spataru <https://github.com/alex-spataru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef SCATTER_LAYOUT_H
+#define SCATTER_LAYOUT_H
+
+#include <QtGlobal>
+#include <QByteArray>
+
+/*
+ * Keyed pseudo-random permutation of the indexes [0, size), used to spread the payload over
+ * the whole cover image in an order that depends on a password.
+ *
+ * The permutation is a Feistel network over the smallest power-of-two domain that contains
+ * all indexes, values that fall outside of the range are walked through the network again
+ * (cycle-walking) until they fall inside it. No index table is ever built, so the memory used
+ * does not depend on the size of the image.
+ */
+class ScatterLayout
+{
+public:
+    ScatterLayout(const QByteArray& key, const qint64 size);
+
+    qint64 size() const;
+    qint64 map(const qint64 index) const;
+    qint64 inverse(const qint64 position) const;
+    void map(const qint64 first, const int count, qint64* indexes) const;
+
+private:
+    enum { Rounds = 4 };
+
+    qint64 m_size;
+    int m_leftBits;
+    int m_rightBits;
+    quint64 m_keys[Rounds];
+};
+
+#endif
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2020 Alex Spataru <https://github.com/alex-spataru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "UndoLog.h"
+
+#include <cstring>
+
+/**
+ * @brief UndoLog::clear
+ *
+ * Removes all the recorded pixels
+ */
+void UndoLog::clear()
+{
+    m_runs.clear();
+    m_scatteredIndexes.clear();
+    m_scatteredPixels.clear();
+}
+
+/**
+ * @brief UndoLog::isEmpty
+ * @return
+ *
+ * Returns @c true if no pixels have been recorded
+ */
+bool UndoLog::isEmpty() const
+{
+    return m_runs.isEmpty() && m_scatteredIndexes.isEmpty();
+}
+
+/**
+ * @brief UndoLog::pixelCount
+ * @return
+ *
+ * Returns the number of recorded pixels
+ */
+qint64 UndoLog::pixelCount() const
+{
+    qint64 count = m_scatteredPixels.count();
+    for(int i = 0; i < m_runs.count(); ++i)
+        count += m_runs.at(i).pixels.count();
+
+    return count;
+}
+
+/**
+ * @brief UndoLog::record
+ * @param image
+ * @param first
+ * @param count
+ *
+ * Saves the current value of @a count consecutive pixels (in raster order) of the given
+ * 32-bit @a image, starting at index @a first. This must be done before modifying them.
+ */
+void UndoLog::record(const QImage& image, const qint64 first, const qint64 count)
+{
+    Q_ASSERT(image.depth() == 32);
+    Q_ASSERT(first >= 0 && first + count <= static_cast<qint64>(image.width()) * image.height());
+
+    if(count <= 0)
+        return;
+
+    Run run;
+    run.first = first;
+    run.pixels.resize(static_cast<int>(count));
+    const QRgb* pixels = reinterpret_cast<const QRgb*>(image.constBits());
+    memcpy(run.pixels.data(), pixels + first, static_cast<size_t>(count) * sizeof(QRgb));
+    m_runs.append(run);
+}
+
+/**
+ * @brief UndoLog::record
+ * @param indexes
+ * @param pixels
+ *
+ * Saves the original value of pixels that are not consecutive (e.g. pixels modified by the
+ * scatter layout), where @a pixels holds the value of the pixel found at each raster index of
+ * @a indexes. Scattered pixels are restored before the runs.
+ */
+void UndoLog::record(const QVector<qint64>& indexes, const QVector<QRgb>& pixels)
+{
+    Q_ASSERT(indexes.count() == pixels.count());
+
+    m_scatteredIndexes += indexes;
+    m_scatteredPixels += pixels;
+}
+
+/**
+ * @brief UndoLog::restore
+ * @param image
+ *
+ * Writes the recorded pixels back to the given @a image (which must be the image that was
+ * recorded), scattered pixels are restored first and then the runs, in reverse order.
+ *
+ * @note The image is only detached if its data is shared with another QImage
+ */
+void UndoLog::restore(QImage* image) const
+{
+    Q_ASSERT(image);
+
+    if(isEmpty())
+        return;
+
+    QRgb* pixels = reinterpret_cast<QRgb*>(image->bits());
+    for(int i = m_scatteredIndexes.count() - 1; i >= 0; --i)
+        pixels[m_scatteredIndexes.at(i)] = m_scatteredPixels.at(i);
+
+    for(int i = m_runs.count() - 1; i >= 0; --i) {
+        const Run& run = m_runs.at(i);
+        memcpy(pixels + run.first, run.pixels.constData(),
+               static_cast<size_t>(run.pixels.count()) * sizeof(QRgb));
+    }
+}
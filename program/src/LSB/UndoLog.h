@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2020 Alex Spataru <https://github.com/alex-spataru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef UNDO_LOG_H
+#define UNDO_LOG_H
+
+#include <QImage>
+#include <QVector>
+
+/*
+ * Stores the original values of the pixels modified when writing data directly over a cover
+ * image, so that the cover can be restored afterwards. The memory used depends on the
+ * number of modified pixels, not on the size of the cover.
+ */
+class UndoLog
+{
+public:
+    void clear();
+    bool isEmpty() const;
+    qint64 pixelCount() const;
+
+    void record(const QImage& image, const qint64 first, const qint64 count);
+    void record(const QVector<qint64>& indexes, const QVector<QRgb>& pixels);
+    void restore(QImage* image) const;
+
+private:
+    struct Run {
+        qint64 first;
+        QVector<QRgb> pixels;
+    };
+
+    QVector<Run> m_runs;
+    QVector<qint64> m_scatteredIndexes;
+    QVector<QRgb> m_scatteredPixels;
+};
+
+#endif
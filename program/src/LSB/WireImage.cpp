@@ -0,0 +1,394 @@
+/*
+ * Copyright (c) 2020 Alex Spataru <https://github.com/alex-spataru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "WireImage.h"
+
+#include <QtEndian>
+
+#include <climits>
+#include <cstring>
+
+/*
+ * Container header definitions
+ */
+static const char* HEADER_MAGIC = "LSBW";
+static const int HEADER_MAGIC_SIZE = 4;
+static const int HEADER_SIZE = 16;
+static const int HEADER_VERSION = 1;
+static const int FLAG_ALPHA = 0x01;
+
+/*
+ * Pixel encodings
+ */
+static const int ENCODING_RAW = 0;
+static const int ENCODING_QOI = 1;
+
+/*
+ * QOI operations (see https://qoiformat.org/qoi-specification.pdf)
+ */
+static const uchar QOI_OP_INDEX = 0x00;
+static const uchar QOI_OP_DIFF = 0x40;
+static const uchar QOI_OP_LUMA = 0x80;
+static const uchar QOI_OP_RUN = 0xc0;
+static const uchar QOI_OP_RGB = 0xfe;
+static const uchar QOI_OP_RGBA = 0xff;
+static const uchar QOI_MASK = 0xc0;
+static const int QOI_MAX_RUN = 62;
+
+/*
+ * Number of rows encoded with QOI before checking if the output is smaller than raw pixels
+ */
+static const int QOI_PROBE_ROWS = 8;
+
+/**
+ * @brief qoi_hash
+ * @param pixel
+ * @return
+ *
+ * Returns the position of the given @a pixel in the QOI color index
+ */
+static inline int qoi_hash(const QRgb pixel)
+{
+    return (qRed(pixel) * 3 + qGreen(pixel) * 5 + qBlue(pixel) * 7 + qAlpha(pixel) * 11) % 64;
+}
+
+/**
+ * @brief encode_qoi
+ * @param image
+ * @param output
+ * @return
+ *
+ * Writes the pixels of the given 32-bit @a image with the QOI operations to @a output and
+ * returns the number of bytes written. Returns -1 if the output becomes larger than the raw
+ * pixel data, in which case the caller should store the raw pixels instead.
+ *
+ * The @a output buffer must be able to hold the raw pixel data plus five bytes per pixel of
+ * the first @c QOI_PROBE_ROWS rows.
+ */
+static qint64 encode_qoi(const QImage& image, uchar* output)
+{
+    const bool alpha = image.hasAlphaChannel();
+    const qint64 rawRowBytes = static_cast<qint64>(image.width()) * (alpha ? 4 : 3);
+
+    int run = 0;
+    qint64 bytes = 0;
+    QRgb index[64];
+    QRgb previous = qRgba(0, 0, 0, 255);
+    std::memset(index, 0, sizeof(index));
+    for(int y = 0; y < image.height(); ++y) {
+        const QRgb* line = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+        for(int x = 0; x < image.width(); ++x) {
+            // Ignore alpha value of RGB images
+            const QRgb pixel = alpha ? line[x] : (line[x] | 0xff000000);
+
+            // Repeated pixel
+            if(pixel == previous) {
+                if(++run == QOI_MAX_RUN) {
+                    output[bytes++] = static_cast<uchar>(QOI_OP_RUN | (run - 1));
+                    run = 0;
+                }
+
+                continue;
+            }
+
+            // End of run
+            if(run > 0) {
+                output[bytes++] = static_cast<uchar>(QOI_OP_RUN | (run - 1));
+                run = 0;
+            }
+
+            // Recently seen color
+            const int hash = qoi_hash(pixel);
+            if(index[hash] == pixel)
+                output[bytes++] = static_cast<uchar>(QOI_OP_INDEX | hash);
+
+            // Difference from previous pixel
+            else if(qAlpha(pixel) == qAlpha(previous)) {
+                const int dr = static_cast<signed char>(qRed(pixel) - qRed(previous));
+                const int dg = static_cast<signed char>(qGreen(pixel) - qGreen(previous));
+                const int db = static_cast<signed char>(qBlue(pixel) - qBlue(previous));
+                const int drg = dr - dg;
+                const int dbg = db - dg;
+
+                if(dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+                    output[bytes++] = static_cast<uchar>(QOI_OP_DIFF | (dr + 2) << 4 |
+                                                         (dg + 2) << 2 | (db + 2));
+
+                else if(dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7) {
+                    output[bytes++] = static_cast<uchar>(QOI_OP_LUMA | (dg + 32));
+                    output[bytes++] = static_cast<uchar>((drg + 8) << 4 | (dbg + 8));
+                }
+
+                else {
+                    output[bytes++] = QOI_OP_RGB;
+                    output[bytes++] = static_cast<uchar>(qRed(pixel));
+                    output[bytes++] = static_cast<uchar>(qGreen(pixel));
+                    output[bytes++] = static_cast<uchar>(qBlue(pixel));
+                }
+            }
+
+            // New alpha value
+            else {
+                output[bytes++] = QOI_OP_RGBA;
+                output[bytes++] = static_cast<uchar>(qRed(pixel));
+                output[bytes++] = static_cast<uchar>(qGreen(pixel));
+                output[bytes++] = static_cast<uchar>(qBlue(pixel));
+                output[bytes++] = static_cast<uchar>(qAlpha(pixel));
+            }
+
+            index[hash] = pixel;
+            previous = pixel;
+        }
+
+        // Give up if the QOI operations are larger than the raw pixels
+        if(y + 1 >= QOI_PROBE_ROWS && bytes > rawRowBytes * (y + 1))
+            return -1;
+    }
+
+    // Write last run
+    if(run > 0)
+        output[bytes++] = static_cast<uchar>(QOI_OP_RUN | (run - 1));
+
+    return bytes;
+}
+
+/**
+ * @brief decode_qoi
+ * @param data
+ * @param size
+ * @param image
+ * @return
+ *
+ * Reads the pixels of the @a image from the given QOI operations, returns @c false if the
+ * data is truncated.
+ */
+static bool decode_qoi(const uchar* data, const qint64 size, QImage* image)
+{
+    int run = 0;
+    qint64 position = 0;
+    QRgb index[64];
+    QRgb pixel = qRgba(0, 0, 0, 255);
+    std::memset(index, 0, sizeof(index));
+    for(int y = 0; y < image->height(); ++y) {
+        QRgb* line = reinterpret_cast<QRgb*>(image->scanLine(y));
+        for(int x = 0; x < image->width(); ++x) {
+            // Repeat previous pixel
+            if(run > 0) {
+                --run;
+                line[x] = pixel;
+                continue;
+            }
+
+            // Read operation
+            if(position >= size)
+                return false;
+
+            const uchar op = data[position++];
+            if(op == QOI_OP_RGB) {
+                if(position + 3 > size)
+                    return false;
+
+                pixel = qRgba(data[position], data[position + 1], data[position + 2],
+                              qAlpha(pixel));
+                position += 3;
+            }
+
+            else if(op == QOI_OP_RGBA) {
+                if(position + 4 > size)
+                    return false;
+
+                pixel = qRgba(data[position], data[position + 1], data[position + 2],
+                              data[position + 3]);
+                position += 4;
+            }
+
+            else if((op & QOI_MASK) == QOI_OP_INDEX)
+                pixel = index[op];
+
+            else if((op & QOI_MASK) == QOI_OP_DIFF) {
+                pixel = qRgba(qRed(pixel) + ((op >> 4) & 0x03) - 2,
+                              qGreen(pixel) + ((op >> 2) & 0x03) - 2,
+                              qBlue(pixel) + (op & 0x03) - 2,
+                              qAlpha(pixel));
+            }
+
+            else if((op & QOI_MASK) == QOI_OP_LUMA) {
+                if(position >= size)
+                    return false;
+
+                const int dg = (op & 0x3f) - 32;
+                const uchar diff = data[position++];
+                pixel = qRgba(qRed(pixel) + dg - 8 + (diff >> 4),
+                              qGreen(pixel) + dg,
+                              qBlue(pixel) + dg - 8 + (diff & 0x0f),
+                              qAlpha(pixel));
+            }
+
+            else
+                run = op & 0x3f;
+
+            index[qoi_hash(pixel)] = pixel;
+            line[x] = pixel;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief WireImage::isWireImage
+ * @param data
+ * @return
+ *
+ * Returns @c true if the given @a data starts with the header of a wire image
+ */
+bool WireImage::isWireImage(const QByteArray& data)
+{
+    return data.size() >= HEADER_SIZE &&
+           std::memcmp(data.constData(), HEADER_MAGIC, HEADER_MAGIC_SIZE) == 0 &&
+           static_cast<uchar>(data.at(HEADER_MAGIC_SIZE)) == HEADER_VERSION;
+}
+
+/**
+ * @brief WireImage::read
+ * @param data
+ * @return
+ *
+ * Returns the image stored in the given wire image @a data, or a null image if the data is
+ * not a valid wire image.
+ */
+QImage WireImage::read(const QByteArray& data)
+{
+    // Check header
+    if(!isWireImage(data))
+        return QImage();
+
+    // Read header
+    const bool alpha = data.at(5) & FLAG_ALPHA;
+    const int encoding = static_cast<uchar>(data.at(6));
+    const quint32 width = qFromLittleEndian<quint32>(data.constData() + 8);
+    const quint32 height = qFromLittleEndian<quint32>(data.constData() + 12);
+    if(width == 0 || height == 0 || width > INT_MAX / 4 || height > INT_MAX / 4)
+        return QImage();
+
+    // Check that the pixel data can describe an image of the given size, so that a corrupted
+    // header does not allocate a huge image
+    const uchar* pixels = reinterpret_cast<const uchar*>(data.constData()) + HEADER_SIZE;
+    const qint64 size = data.size() - HEADER_SIZE;
+    const qint64 pixelCount = static_cast<qint64>(width) * height;
+    const int bpp = alpha ? 4 : 3;
+    if(encoding == ENCODING_RAW && size != pixelCount * bpp)
+        return QImage();
+    else if(encoding == ENCODING_QOI && pixelCount > size * QOI_MAX_RUN)
+        return QImage();
+    else if(encoding != ENCODING_RAW && encoding != ENCODING_QOI)
+        return QImage();
+
+    // Create image
+    QImage image(static_cast<int>(width), static_cast<int>(height),
+                 alpha ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+    if(image.isNull())
+        return QImage();
+
+    // Read QOI operations
+    if(encoding == ENCODING_QOI) {
+        if(!decode_qoi(pixels, size, &image))
+            return QImage();
+
+        return image;
+    }
+
+    // Read raw pixels
+    for(int y = 0; y < image.height(); ++y) {
+        QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(y));
+        for(int x = 0; x < image.width(); ++x, pixels += bpp)
+            line[x] = qRgba(pixels[0], pixels[1], pixels[2], alpha ? pixels[3] : 0xff);
+    }
+
+    return image;
+}
+
+/**
+ * @brief WireImage::write
+ * @param image
+ * @return
+ *
+ * Returns the given @a image stored in a wire image container, or an empty byte array if the
+ * image is empty.
+ */
+QByteArray WireImage::write(const QImage& image)
+{
+    // Empty image, nothing to write
+    if(image.width() <= 0 || image.height() <= 0)
+        return QByteArray();
+
+    // Get 32-bit image
+    QImage source = image;
+    const bool alpha = image.hasAlphaChannel();
+    if(alpha && image.format() != QImage::Format_ARGB32)
+        source = image.convertToFormat(QImage::Format_ARGB32);
+    else if(!alpha && image.format() != QImage::Format_RGB32)
+        source = image.convertToFormat(QImage::Format_RGB32);
+
+    // Allocate space for the raw pixels (and for the worst case of the QOI probe rows)
+    const int bpp = alpha ? 4 : 3;
+    const qint64 rawBytes = static_cast<qint64>(source.width()) * source.height() * bpp;
+    const qint64 probeBytes = static_cast<qint64>(source.width()) * QOI_PROBE_ROWS * 5;
+    const qint64 capacity = HEADER_SIZE + rawBytes + probeBytes;
+    if(capacity > INT_MAX)
+        return QByteArray();
+
+    QByteArray data(static_cast<int>(capacity), 0);
+    uchar* output = reinterpret_cast<uchar*>(data.data());
+
+    // Write header
+    std::memcpy(output, HEADER_MAGIC, HEADER_MAGIC_SIZE);
+    output[4] = HEADER_VERSION;
+    output[5] = alpha ? FLAG_ALPHA : 0;
+    output[6] = ENCODING_QOI;
+    qToLittleEndian<quint32>(static_cast<quint32>(source.width()), output + 8);
+    qToLittleEndian<quint32>(static_cast<quint32>(source.height()), output + 12);
+
+    // Try to compress the image with the QOI operations
+    const qint64 bytes = encode_qoi(source, output + HEADER_SIZE);
+    if(bytes >= 0 && bytes <= rawBytes) {
+        data.resize(static_cast<int>(HEADER_SIZE + bytes));
+        return data;
+    }
+
+    // Write raw pixels
+    output[6] = ENCODING_RAW;
+    uchar* pixels = output + HEADER_SIZE;
+    for(int y = 0; y < source.height(); ++y) {
+        const QRgb* line = reinterpret_cast<const QRgb*>(source.constScanLine(y));
+        for(int x = 0; x < source.width(); ++x) {
+            *pixels++ = static_cast<uchar>(qRed(line[x]));
+            *pixels++ = static_cast<uchar>(qGreen(line[x]));
+            *pixels++ = static_cast<uchar>(qBlue(line[x]));
+            if(alpha)
+                *pixels++ = static_cast<uchar>(qAlpha(line[x]));
+        }
+    }
+
+    data.resize(static_cast<int>(HEADER_SIZE + rawBytes));
+    return data;
+}
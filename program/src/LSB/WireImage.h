@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2020 Alex Spataru <https://github.com/alex-spataru>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef WIRE_IMAGE_H
+#define WIRE_IMAGE_H
+
+#include <QImage>
+#include <QByteArray>
+
+/*
+ * Compact lossless image container used to send LSB images between LSB-Chat peers, which is
+ * much cheaper to write and read than PNG. The container starts with a 16-byte header:
+ *
+ * - Magic ("LSBW") & version (1 byte)
+ * - Flags (bit 0: alpha channel) & pixel encoding (1 byte each), one reserved byte
+ * - Width & height (32-bit, little endian)
+ *
+ * Pixels are stored with the QOI operations (runs, color index, small differences), or as
+ * plain RGB/RGBA bytes when the QOI operations do not compress the image (e.g. random noise).
+ */
+class WireImage
+{
+public:
+    static bool isWireImage(const QByteArray& data);
+    static QImage read(const QByteArray& data);
+    static QByteArray write(const QImage& image);
+};
+
+#endif
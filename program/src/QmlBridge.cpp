@@ -21,13 +21,14 @@
  */
 
 #include "QmlBridge.h"
-#include "LSB/Crypto.h"
+#include "LSB/AeadStream.h"
+#include "LSB/ChatMessage.h"
+#include "LSB/MessageEnvelope.h"
 
 #include <QDir>
 #include <QUrl>
 #include <QFileDialog>
 #include <QMessageBox>
-#include <QJsonObject>
 #include <QRandomGenerator>
 #include <QDesktopServices>
 
@@ -36,34 +37,6 @@
  */
 static qint64 MAX_TRANSFER_SIZE = 1 * 1024;
 
-/**
- * @brief GET_JSON_DATA
- * @param type
- * @param filename
- * @param base64
- * @param encrypted
- * @return
- *
- * Generates a binary JSON representation of the given data
- */
-static QByteArray GET_JSON_DATA(const QString& type,
-                                const QString& filename,
-                                const QByteArray& data)
-{
-    // Create base64 string
-    QString base64 = QString::fromUtf8(data.toBase64());
-
-    // Generate JSON object
-    QJsonObject jsonObject;
-    jsonObject.insert("MessageType", type);
-    jsonObject.insert("Length", QJsonValue(base64.length()));
-    jsonObject.insert("FileName", filename);
-    jsonObject.insert("Base64", QJsonValue(base64));
-
-    // Return byte array
-    return QJsonDocument(jsonObject).toJson(QJsonDocument::Compact);
-}
-
 /**
  * @brief QmlBridge::QmlBridge
  *
@@ -211,21 +184,28 @@ void QmlBridge::sendFile()
     QFileInfo fileInfo(path);
     QString fileName = fileInfo.fileName();
 
-    // Generate JSON data
-    QByteArray json = GET_JSON_DATA("File", fileName, fileData);
+    // Generate message container, leaving room for the envelope in front of it
+    const int reserved = envelopeSize();
+    MessageEnvelope::ContentType contentType;
+    QByteArray payload = encodeMessage(ChatMessage(ChatMessage::File, fileName, fileData),
+                                       reserved, &contentType);
+
+    // Check that the data fits in the image before encrypting or encoding anything
+    if(!checkCapacity(messageSize(payload.length(), reserved)))
+        return;
 
-    // Encrypt file (if required) and encode it with Base64
-    bool encryptionOk;
+    // Encrypt file (if required)
     bool allowSendingData;
-    QByteArray data = encryptData(json, &encryptionOk, &allowSendingData);
+    MessageEnvelope::Cipher cipher;
+    encryptData(&payload, reserved, &cipher, &allowSendingData);
 
     // Abort if user denied sending data
     if(!allowSendingData)
         return;
 
     // Load data intro image and send it
-    QImage lsbImage = LSB::encodeData(data);
-    m_comms.sendBinaryData(LSB::imageToBinaryData(lsbImage));
+    wrapMessage(&payload, reserved, cipher, contentType);
+    sendImageData(payload);
 
     // Generate message
     QUrl url = QUrl::fromLocalFile(path);
@@ -235,7 +215,7 @@ void QmlBridge::sendFile()
 
     // Emit signal
     emit lsbImageChanged();
-    emit newMessage(getUserName(), message, encryptionOk);
+    emit newMessage(getUserName(), message, cipher != MessageEnvelope::CipherNone);
 }
 
 /**
@@ -284,8 +264,8 @@ void QmlBridge::saveImages()
 /**
  * @brief QmlBridge::extractInformation
  *
- * Lets the user select any PNG image. Afterwards, the PNG image is loaded into memory and sent
- * for data decoding to the LSB module.
+ * Lets the user select any PNG image. Afterwards, the LSB module decodes the data contained in
+ * the image, reading only the rows of the image that contain the data.
  */
 void QmlBridge::extractInformation()
 {
@@ -299,18 +279,17 @@ void QmlBridge::extractInformation()
     if(filePath.isEmpty())
         return;
 
-    // Read image data
-    QFile file(filePath);
-    if (file.open(QFile::ReadOnly)) {
-        handleMessages("LSB Reader (Local)", file.readAll());
-        file.close();
-    }
-
     // Error opening file
-    else
+    if(!QFileInfo(filePath).isReadable()) {
         QMessageBox::warning(Q_NULLPTR,
                              tr("Error loading image"),
                              tr("Cannot open file for reading, wrong permisions?"));
+        return;
+    }
+
+    // Decode image data, only the region of the image that contains the data is read
+    updateScatterKey();
+    readMessage("LSB Reader (Local)", LSB::decodeFile(filePath));
 }
 
 /**
@@ -363,36 +342,45 @@ void QmlBridge::sendMessage(const QString& text)
         return;
     }
 
-    // Generate JSON data
-    QByteArray json = GET_JSON_DATA("Text", "", text.toUtf8());
+    // Generate message container, leaving room for the envelope in front of it
+    const int reserved = envelopeSize();
+    MessageEnvelope::ContentType contentType;
+    QByteArray payload = encodeMessage(ChatMessage(ChatMessage::Text, "", text.toUtf8()),
+                                       reserved, &contentType);
 
-    // Encrypt the text (if required) and encode it with Base64
-    bool encryptionOk;
+    // Check that the data fits in the image before encrypting or encoding anything
+    if(!checkCapacity(messageSize(payload.length(), reserved)))
+        return;
+
+    // Encrypt the text (if required)
     bool allowSendingData;
-    QByteArray data = encryptData(json, &encryptionOk, &allowSendingData);
+    MessageEnvelope::Cipher cipher;
+    encryptData(&payload, reserved, &cipher, &allowSendingData);
 
     // Abort if user denied sending data
     if(!allowSendingData)
         return;
 
-    // Generate JSON binary data, load data into image and send image data
-    QImage lsbImage = LSB::encodeData(data);
-    m_comms.sendBinaryData(LSB::imageToBinaryData(lsbImage));
+    // Load data into image and send image data
+    wrapMessage(&payload, reserved, cipher, contentType);
+    sendImageData(payload);
 
     // Emit signal
     emit lsbImageChanged();
-    emit newMessage(getUserName(), text, encryptionOk);
+    emit newMessage(getUserName(), text, cipher != MessageEnvelope::CipherNone);
 }
 
 /**
  * @brief QmlBridge::setPassword
  * @param password
  *
- * Changes the password to be used for encrypting/decrypting messages and files.
+ * Changes the password to be used for encrypting/decrypting messages and files, the key
+ * schedule of the password is built here once and reused by every message.
  */
 void QmlBridge::setPassword(const QString& password)
 {
     m_password = password;
+    m_cryptoContext = CryptoContext(password.toUtf8());
     emit passwordChanged();
 }
 
@@ -464,15 +452,6 @@ void QmlBridge::handleParticipantLeft(const QString& name)
  *
  * Decodes the information contained in the given @a data packet using the LSB-Read algorithm,
  * and proceedes to interpret the information inside the JSON container.
- *
- * If the JSON container is invalid, the function tries to use the Crypto module to decrypt
- * the JSON container. If the container is still invalid, the function aborts the operation.
- *
- * If the container is valid, the function proceedes to extract the Base64-encoded message/file
- * from the container and display it in the UI.
- *
- * @note If the container corresponds to a file-type message, then the file is saved on the
- *       downloads directory of the user interface.
  */
 void QmlBridge::handleMessages(const QString& name, const QByteArray& data)
 {
@@ -480,69 +459,238 @@ void QmlBridge::handleMessages(const QString& name, const QByteArray& data)
     if(data.isEmpty())
         return;
 
-    // Decode LSB and obtain JSON document
-    QByteArray jsonData = LSB::decodeData(data);
-    QJsonDocument document = QJsonDocument::fromJson(jsonData);
+    // Decode LSB and read the JSON document
+    updateScatterKey();
+    readMessage(name, LSB::decodeData(data));
+}
 
-    // JSON is invalid, try to decipher it
-    bool encrypted = false;
-    if (document.isEmpty()) {
-        // Run decipher algorithm
-        CryptoError error;
-        jsonData = Crypto::decryptData(jsonData, getPassword().toUtf8(), &error);
+/**
+ * @brief QmlBridge::readMessage
+ * @param name
+ * @param data
+ *
+ * Interprets the message container (CBOR or JSON) obtained with the LSB-Read algorithm.
+ *
+ * The message envelope tells which cipher was used to encrypt the container and how it is
+ * encoded, so the container is decrypted (if needed) and parsed exactly once. Sealed
+ * (ChaCha20-Poly1305) data is authenticated first, a wrong key is detected without
+ * decrypting anything.
+ *
+ * Messages sent by older clients have no envelope: if the data is not a JSON document, the
+ * function tries to use the legacy cipher to decrypt it. If the container is still invalid,
+ * the function aborts the operation (plain JSON documents that are not valid messages are
+ * silently discarded).
+ *
+ * If the container is valid, the function proceedes to extract the message/file from the
+ * container and display it in the UI.
+ *
+ * @note If the container corresponds to a file-type message, then the file is saved on the
+ *       downloads directory of the user interface.
+ */
+void QmlBridge::readMessage(const QString& name, const QByteArray& data)
+{
+    // Read envelope & decrypt the payload with the cipher it names
+    bool encrypted;
+    QByteArray payload;
+    ChatMessage message;
+    MessageEnvelope envelope;
+    if(MessageEnvelope::unwrap(data, &envelope, &payload)) {
+        CryptoError error = kNoError;
+        if(envelope.cipher() == MessageEnvelope::CipherChaCha20Poly1305)
+            payload = Crypto::openData(payload, m_cryptoContext, &error);
+        else if(envelope.cipher() == MessageEnvelope::CipherLegacy)
+            Crypto::decryptInPlace(payload.data(), payload.length(), m_cryptoContext, &error);
+
+        // Parse the payload once
+        if(error == kNoError && envelope.contentType() == MessageEnvelope::ContentCbor)
+            message = ChatMessage::fromCbor(payload);
+        else if(error == kNoError && envelope.contentType() == MessageEnvelope::ContentJson)
+            message = ChatMessage::fromJson(payload);
+
+        encrypted = envelope.isEncrypted();
+    }
 
-        // Load JSON again if no error was found
-        if (error == kNoError)
-            document = QJsonDocument::fromJson(jsonData);
+    // Message without envelope (older clients), try to decipher it if it is not JSON
+    else {
+        bool isJson;
+        message = ChatMessage::fromJson(data, &isJson);
+        encrypted = !isJson;
+        if(encrypted) {
+            CryptoError error;
+            payload = data;
+            Crypto::decryptInPlace(payload.data(), payload.length(), m_cryptoContext, &error);
+            if(error == kNoError)
+                message = ChatMessage::fromJson(payload);
+        }
+    }
 
-        // Abort if JSON is invalid
-        if (document.isEmpty()) {
+    // Abort if message is invalid
+    if(!message.isValid()) {
+        if(encrypted)
             emit newMessage(name, tr("[Decipher error, set appropiate key]"), true);
-            return;
-        }
 
-        // Set encrypted flag to true
-        encrypted = true;
+        return;
     }
 
     // Update the LSB image
     emit lsbImageChanged();
 
-    // Get data from JSON object
-    const int length = document.object().value("Length").toInt();
-    const QString fileName = document.object().value("FileName").toString();
-    const QString messageType = document.object().value("MessageType").toString();
-    const QString base64 = document.object().value("Base64").toString();
-
-    // Cancel if size does not match
-    if(length != base64.length() || base64.isEmpty())
-        return;
-
-    // Convert from Base64 to normal data
-    QByteArray msgData = QByteArray::fromBase64(base64.toUtf8());
-
     // Data is a message -> display it on the chat room
-    if(messageType == "Text")
-        emit newMessage(name, QString::fromUtf8(msgData), encrypted);
+    if(message.type() == ChatMessage::Text)
+        emit newMessage(name, QString::fromUtf8(message.data()), encrypted);
 
     // Data is a file -> save it to downloads and generate message
-    else if(messageType == "File") {
+    else if(message.type() == ChatMessage::File) {
         // Try to save the file
         bool ok;
-        QString filePath = saveFile(fileName, msgData, &ok);
+        const QString fileName = message.fileName();
+        QString filePath = saveFile(fileName, message.data(), &ok);
         QUrl url = QUrl::fromLocalFile(filePath);
 
         // File saved correctly, generate message with link to file
         if(ok) {
-            QString message = tr("Sent file \"%1\", <a href=\"%2\">click here to open it</a>.")
-                              .arg(fileName)
-                              .arg(url.toString());
+            QString text = tr("Sent file \"%1\", <a href=\"%2\">click here to open it</a>.")
+                           .arg(fileName)
+                           .arg(url.toString());
 
-            emit newMessage(name, message, encrypted);
+            emit newMessage(name, text, encrypted);
         }
     }
 }
 
+/**
+ * @brief QmlBridge::useSealedCrypto
+ * @return
+ *
+ * Returns @c true if outgoing data shall be sealed with ChaCha20-Poly1305, which requires
+ * a password and that all connected peers are able to open sealed messages (sealed data is
+ * always sent inside a message envelope).
+ */
+bool QmlBridge::useSealedCrypto() const
+{
+    return m_cryptoEnabled && !m_password.isEmpty() && useEnvelopes() &&
+           !m_comms.hasLegacyCryptoPeers();
+}
+
+/**
+ * @brief QmlBridge::useEnvelopes
+ * @return
+ *
+ * Returns @c true if all connected peers are able to read messages with an envelope
+ */
+bool QmlBridge::useEnvelopes() const
+{
+    return !m_comms.hasBareMessagePeers();
+}
+
+/**
+ * @brief QmlBridge::checkCapacity
+ * @param bytes
+ * @return
+ *
+ * Returns @c true if the given number of @a bytes can be written to the current LSB image,
+ * otherwise, the user is notified and @c false is returned.
+ *
+ * @note The check is done before encrypting the data, so @a bytes must already include the
+ *       overhead of the encryption & the envelope (see @c messageSize()).
+ */
+bool QmlBridge::checkCapacity(const qint64 bytes)
+{
+    // Older clients only read the legacy layout, which holds much less data
+    if(m_comms.hasPngImagePeers() && bytes > LSB::legacyCapacity()) {
+        QMessageBox::warning(Q_NULLPTR,
+                             tr("Image too small"),
+                             tr("The data does not fit in an image that older clients can "
+                                "read, please select a larger image or send a smaller file"));
+        return false;
+    }
+
+    if(bytes <= LSB::capacity())
+        return true;
+
+    QMessageBox::warning(Q_NULLPTR,
+                         tr("Image too small"),
+                         tr("The image is too small to fit the requested data, please select "
+                            "a larger image or use auto-generated images"));
+    return false;
+}
+
+/**
+ * @brief QmlBridge::envelopeSize
+ * @return
+ *
+ * Returns the number of bytes reserved in front of outgoing messages for the message envelope
+ * (zero if any peer is an older client, which expects the bare message)
+ */
+int QmlBridge::envelopeSize() const
+{
+    return useEnvelopes() ? MessageEnvelope::HeaderSize : 0;
+}
+
+/**
+ * @brief QmlBridge::messageSize
+ * @param bytes
+ * @param reserved
+ * @return
+ *
+ * Returns the size of a message container of @a bytes (including the @a reserved bytes of
+ * the envelope) after being encrypted by @c encryptData()
+ */
+qint64 QmlBridge::messageSize(const qint64 bytes, const int reserved) const
+{
+    if(useSealedCrypto())
+        return reserved + AeadStream::sealedSize(bytes - reserved);
+
+    return bytes;
+}
+
+/**
+ * @brief QmlBridge::encodeMessage
+ * @param message
+ * @param reserved
+ * @param contentType
+ * @return
+ *
+ * Encodes the given @a message in CBOR after @a reserved bytes of room for the envelope (only
+ * messages with an envelope can be CBOR-encoded), otherwise, the JSON container is used for
+ * older clients. The format used is written to @a contentType.
+ */
+QByteArray QmlBridge::encodeMessage(const ChatMessage& message, const int reserved,
+                                    MessageEnvelope::ContentType* contentType) const
+{
+    Q_ASSERT(contentType);
+
+    if(reserved > 0) {
+        *contentType = MessageEnvelope::ContentCbor;
+        return message.toCbor(reserved);
+    }
+
+    *contentType = MessageEnvelope::ContentJson;
+    return message.toJson();
+}
+
+/**
+ * @brief QmlBridge::wrapMessage
+ * @param data
+ * @param reserved
+ * @param cipher
+ * @param contentType
+ *
+ * Writes the message envelope in the @a reserved bytes at the front of the given @a data,
+ * so the (encrypted) container is never copied. If no room was reserved, the data is sent
+ * as-is (older clients).
+ */
+void QmlBridge::wrapMessage(QByteArray* data, const int reserved,
+                            const MessageEnvelope::Cipher cipher,
+                            const MessageEnvelope::ContentType contentType) const
+{
+    Q_ASSERT(data);
+    Q_ASSERT(reserved == 0 || reserved == MessageEnvelope::HeaderSize);
+
+    if(reserved > 0)
+        MessageEnvelope(cipher, contentType).writeHeader(data->data());
+}
+
 /**
  * @brief QmlBridge::saveFile
  * @param name
@@ -587,33 +735,46 @@ QString QmlBridge::saveFile(const QString& name, const QByteArray& data, bool* o
 }
 
 /**
- * @brief QmlBridge::encodeData
+ * @brief QmlBridge::encryptData
  * @param data
- * @param cryptoOk
+ * @param reserved
+ * @param cipher
  * @param continueSending
- * @return
  *
- * Encrypts the given @a data (only if the crypto module is enabled).
+ * Encrypts the given @a data (only if the crypto module is enabled). The data is sealed with
+ * ChaCha20-Poly1305 when every peer supports it, otherwise, the legacy cipher is applied in
+ * place. The first @a reserved bytes (the room for the envelope) are never encrypted, and the
+ * buffer is not modified if the data cannot be encrypted.
  *
  * If an error occurs while trying to encrypt the data, the function will ask the user if he/she
  * wants to continue senting the data. If the user decides to continue sending the data, the value
  * of @a continueSending is set to @c true. Otherwise, the value of @a continueSending is set to
  * @c false.
  *
- * If no encryption error occurs, or the crypto module is disabled, then the values of @a cryptoOk
- * and @a continueSending are set to @c true.
+ * The cipher that was used is written to @a cipher (@c MessageEnvelope::CipherNone if the data
+ * was not encrypted), so that it can be recorded in the message envelope.
  */
-QByteArray QmlBridge::encryptData(const QByteArray& data, bool* cryptoOk, bool* continueSending)
+void QmlBridge::encryptData(QByteArray* data, const int reserved,
+                            MessageEnvelope::Cipher* cipher, bool* continueSending)
 {
     // Check arguments
-    Q_ASSERT(cryptoOk);
+    Q_ASSERT(data);
+    Q_ASSERT(cipher);
     Q_ASSERT(continueSending);
 
     // Try to encrypt the data, if an error occurs, ask the user what to do
     if(getCryptoEnabled()) {
         // Try to encrypt the data
         CryptoError error;
-        QByteArray encryptedData = Crypto::encryptData(data, getPassword().toUtf8(), &error);
+        const bool sealed = useSealedCrypto();
+        if(sealed) {
+            *data = Crypto::sealData(*data, m_cryptoContext, &error, reserved);
+        }
+
+        else {
+            Crypto::encryptInPlace(data->data() + reserved, data->length() - reserved,
+                                   m_cryptoContext, &error);
+        }
 
         // Password empty, ask user if he/she wants to contine
         if(error == kPasswordEmpty) {
@@ -623,48 +784,95 @@ QByteArray QmlBridge::encryptData(const QByteArray& data, bool* cryptoOk, bool*
                                                "encrypted, do you want to continue?"),
                                             QMessageBox::Yes | QMessageBox::No);
             if(ret == QMessageBox::No) {
-                *cryptoOk = false;
+                *cipher = MessageEnvelope::CipherNone;
                 *continueSending = false;
             }
 
             else {
-                *cryptoOk = false;
-                encryptedData = data;
+                *cipher = MessageEnvelope::CipherNone;
                 *continueSending = true;
             }
         }
 
         // Unknown error
-        else if(error == kUnknownError) {
+        else if(error != kNoError) {
             int ret = QMessageBox::question(Q_NULLPTR,
                                             tr("Encryption error"),
                                             tr("There was an error while encrypting the data. " \
                                                "Would you like to send the unencrypted data?"),
                                             QMessageBox::Yes | QMessageBox::No);
             if(ret == QMessageBox::No) {
-                *cryptoOk = false;
+                *cipher = MessageEnvelope::CipherNone;
                 *continueSending = false;
             }
 
             else {
-                *cryptoOk = false;
-                encryptedData = data;
+                *cipher = MessageEnvelope::CipherNone;
                 *continueSending = true;
             }
         }
 
-        // Encryption ok, set encryption flag to true
+        // Encryption ok, report the cipher used
         else {
-            *cryptoOk = true;
+            *cipher = sealed ? MessageEnvelope::CipherChaCha20Poly1305 :
+                      MessageEnvelope::CipherLegacy;
             *continueSending = true;
         }
 
-        // Return obtained data
-        return encryptedData;
+        return;
     }
 
     // Encryption disabled, send original data
-    *cryptoOk = false;
+    *cipher = MessageEnvelope::CipherNone;
     *continueSending = true;
-    return data;
+}
+
+/**
+ * @brief QmlBridge::updateScatterKey
+ *
+ * Uses a key derived from the password to scatter the data over the LSB images while the
+ * crypto module is enabled, so that only peers that know the password can find the data in
+ * the images.
+ *
+ * @note This function is called before encoding/decoding an image (and not each time that
+ *       the password changes), since the key derivation is deliberately slow.
+ */
+void QmlBridge::updateScatterKey()
+{
+    if(m_cryptoEnabled && !m_password.isEmpty())
+        LSB::setScatterKey(m_cryptoContext.scatterKey());
+    else
+        LSB::setScatterKey(QByteArray());
+}
+
+/**
+ * @brief QmlBridge::sendImageData
+ * @param data
+ *
+ * Writes the given @a data into an image with the LSB-Write algorithm and sends the image to
+ * all peers. Peers that support the wire image container receive it instead of a PNG image,
+ * which saves the PNG encoding & decoding time on both ends.
+ *
+ * Older clients (which do not announce any capability) only read PNG images that use the
+ * legacy diagonal layout, so a separate image is written for them.
+ */
+void QmlBridge::sendImageData(const QByteArray& data)
+{
+    // Write PNG image with the legacy layout for older clients
+    QByteArray png;
+    if(m_comms.hasPngImagePeers()) {
+        png = LSB::imageToBinaryData(LSB::encodeLegacyData(data));
+
+        // All peers are older clients
+        if(!m_comms.hasWireImagePeers()) {
+            m_comms.sendBinaryData(png);
+            return;
+        }
+    }
+
+    // Use the current password to scatter the data & send wire image to newer clients (the
+    // user interface shows this image, since it is written last)
+    updateScatterKey();
+    const QByteArray wireImage = LSB::encodeToBinaryData(data, LSB::WireFormat);
+    m_comms.sendBinaryData(png, wireImage);
 }
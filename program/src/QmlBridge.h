@@ -26,6 +26,9 @@
 #include <QQuickImageProvider>
 
 #include "LSB/LSB.h"
+#include "LSB/ChatMessage.h"
+#include "LSB/Crypto.h"
+#include "LSB/MessageEnvelope.h"
 #include "Comms/NetworkComms.h"
 
 class QmlBridge : public QObject
@@ -76,14 +79,28 @@ private slots:
     void handleMessages(const QString& name, const QByteArray& data);
 
 private:
+    int envelopeSize() const;
+    bool useEnvelopes() const;
+    bool useSealedCrypto() const;
+    bool checkCapacity(const qint64 bytes);
+    qint64 messageSize(const qint64 bytes, const int reserved) const;
+    QByteArray encodeMessage(const ChatMessage& message, const int reserved,
+                             MessageEnvelope::ContentType* contentType) const;
+    void wrapMessage(QByteArray* data, const int reserved, const MessageEnvelope::Cipher cipher,
+                     const MessageEnvelope::ContentType contentType) const;
+    void readMessage(const QString& name, const QByteArray& data);
     QString saveFile(const QString& name, const QByteArray& data, bool* ok);
-    QByteArray encryptData(const QByteArray& data, bool* ok, bool* continueSending);
+    void encryptData(QByteArray* data, const int reserved, MessageEnvelope::Cipher* cipher,
+                     bool* continueSending);
+    void sendImageData(const QByteArray& data);
+    void updateScatterKey();
 
 private:
     QImage m_userImage;
     QString m_password;
     QStringList m_peers;
     bool m_cryptoEnabled;
+    CryptoContext m_cryptoContext;
     NetworkComms m_comms;
     QElapsedTimer m_elapsedTimer;
     QStringList m_availableImages;
@@ -103,11 +120,11 @@ public:
 
         // Show composite image
         if(id == "composite")
-            return QPixmap::fromImage(LSB::currentCompositeImage()).scaled(requestedSize);
+            return QPixmap::fromImage(LSB::currentCompositeImage(requestedSize));
 
         // Show LSB data image
         else if(id == "data")
-            return QPixmap::fromImage(LSB::currentImageData()).scaled(requestedSize);
+            return QPixmap::fromImage(LSB::currentImageData(requestedSize));
 
         // Generate empty pixmap
         QPixmap pixmap(requestedSize);
@@ -1,9 +1,159 @@
 #include <QtTest>
+#include <QRandomGenerator>
+#include <QtMath>
 #include <QByteArray>
 #include <QCoreApplication>
 
+#include <climits>
+#include <algorithm>
+
 #include "LSB/LSB.h"
+#include "LSB/LsbCodec.h"
+#include "LSB/UndoLog.h"
 #include "LSB/Crypto.h"
+#include "LSB/AeadStream.h"
+#include "LSB/BitPlane.h"
+#include "LSB/Checksum.h"
+#include "LSB/PngWriter.h"
+#include "LSB/WireImage.h"
+#include "LSB/CoverPool.h"
+#include "LSB/ScatterLayout.h"
+#include "LSB/ChaCha20Poly1305.h"
+#include "LSB/MessageEnvelope.h"
+#include "LSB/ChatMessage.h"
+
+/*
+ * Reference implementation of the original per-pixel LSB-Write algorithm, used to validate
+ * the output of the LSB module and as a baseline for the benchmarks.
+ */
+static QImage LEGACY_ENCODE(const QImage& cover, const QByteArray& data)
+{
+    // Generate data header
+    QByteArray injection;
+    injection.append("$");
+    injection.append(QString::number(data.length()));
+    injection.append("$");
+    injection.append(data);
+
+    // Generate black differential image pixel by pixel
+    QImage composite = cover;
+    const int cat = qMin(composite.width(), composite.height());
+    QImage differential(QSize(cat, cat), QImage::Format_RGB32);
+    for(int i = 0; i < cat; ++i)
+        for(int j = 0; j < cat; ++j)
+            differential.setPixel(j, i, qRgb(0, 0, 0));
+
+    // Write each byte over three pixels of the diagonal
+    for(int i = 0, byte = 0; i + 2 < cat && byte < injection.length(); i += 3, ++byte) {
+        const int value = static_cast<uchar>(injection.at(byte));
+        for(int p = 0; p < 3; ++p) {
+            const QRgb pixel = composite.pixel(i + p, i + p);
+            const int r = (qRed(pixel)   & ~1) | ((value >> (p * 3 + 0)) & 1);
+            const int g = (qGreen(pixel) & ~1) | ((value >> (p * 3 + 1)) & 1);
+            const int b = (qBlue(pixel)  & ~1) | (p == 2 ? 1 : (value >> (p * 3 + 2)) & 1);
+            composite.setPixel(i + p, i + p, qRgb(r, g, b));
+            differential.setPixel(i + p, i + p, qRgb(r, g, b));
+        }
+    }
+
+    // Return composite image
+    return composite;
+}
+
+/*
+ * Per-pixel implementation of the raster layout (one bit per channel, without scatter key)
+ * that uses QImage::pixel() & QImage::setPixel() like the original engine, used to validate
+ * the output of the scan line engine and as a baseline for the benchmarks.
+ */
+static QImage RASTER_ENCODE(const QImage& cover, const QByteArray& data)
+{
+    // Generate raster layout header (magic, version, layout, flags, length & checksum)
+    const quint32 checksum = Checksum::crc32c(data.constData(), data.length());
+    QByteArray header("LSBC");
+    header.append(static_cast<char>(2));
+    header.append(static_cast<char>(1));
+    header.append(static_cast<char>(0));
+    header.append(static_cast<char>(0));
+    for(int i = 0; i < 4; ++i)
+        header.append(static_cast<char>(static_cast<quint32>(data.length()) >> (8 * i)));
+    for(int i = 0; i < 4; ++i)
+        header.append(static_cast<char>(checksum >> (8 * i)));
+
+    // Write each bit over the LSB of the red, green & blue channels, pixel by pixel
+    QImage composite = cover;
+    auto write = [&composite](const QByteArray& bytes, const int firstPixel) {
+        const int bits = bytes.length() * 8;
+        for(int bit = 0; bit < bits; bit += 3) {
+            const int index = firstPixel + bit / 3;
+            const int x = index % composite.width();
+            const int y = index / composite.width();
+            const QRgb pixel = composite.pixel(x, y);
+            int channels[3] = {qRed(pixel), qGreen(pixel), qBlue(pixel)};
+            for(int c = 0; c < 3 && bit + c < bits; ++c) {
+                const int value = (bytes.at((bit + c) / 8) >> ((bit + c) % 8)) & 1;
+                channels[c] = (channels[c] & ~1) | value;
+            }
+
+            composite.setPixel(x, y, qRgba(channels[0], channels[1], channels[2],
+                                           qAlpha(pixel)));
+        }
+    };
+
+    // Header uses the first 43 pixels, data starts right after it
+    write(header, 0);
+    write(data, 43);
+    return composite;
+}
+
+/*
+ * Reference implementation of the original two-pass Caesar + XOR cypher, used to check that
+ * the vectorized kernels keep the same output (including the Caesar shift, which has always
+ * been the larger of the key length and 93).
+ */
+static QByteArray LEGACY_CRYPT(const QByteArray& data, const QByteArray& key, const bool encrypt)
+{
+    const int shift = qMax(key.length(), 93);
+    QByteArray output = data;
+    for(int i = 0; i < output.length(); ++i) {
+        int byte = static_cast<signed char>(output.at(i));
+        if(!encrypt)
+            byte = static_cast<signed char>(byte ^ key.at(i % key.length()));
+
+        if(byte >= 33 && byte <= 126) {
+            byte = encrypt ? byte + shift : byte - shift;
+            if(encrypt && byte > 126)
+                byte -= 94;
+            else if(!encrypt && byte < 33)
+                byte += 94;
+        }
+
+        output[i] = encrypt ? static_cast<char>(byte ^ key.at(i % key.length())) :
+                    static_cast<char>(byte);
+    }
+
+    return output;
+}
+
+/*
+ * Generates a photo-like image (smooth gradients with some sensor noise), which unlike the
+ * auto-generated covers can be compressed by the PNG encoder.
+ */
+static QImage PHOTO_IMAGE(const int size)
+{
+    QImage image(size, size, QImage::Format_RGB32);
+    for(int y = 0; y < size; ++y) {
+        QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(y));
+        for(int x = 0; x < size; ++x) {
+            const int noise = static_cast<int>(QRandomGenerator::global()->bounded(4));
+            const int r = (x * 255) / size;
+            const int g = (y * 255) / size;
+            const int b = ((x + y) * 127) / size;
+            line[x] = qRgb(qMin(r + noise, 255), qMin(g + noise, 255), qMin(b + noise, 255));
+        }
+    }
+
+    return image;
+}
 
 class Tests : public QObject
 {
@@ -32,6 +182,1120 @@ private slots:
         QVERIFY(data == decoded);
     }
 
+    void testLSBLegacyLayout()
+    {
+        // Encode data with the legacy diagonal layout
+        const QImage cover = LSB::generateImage(512, true);
+        const QByteArray data = "The quick brown fox jumped over the lazy dog";
+        const QImage legacyImage = LEGACY_ENCODE(cover, data);
+
+        // Images generated by older versions must still be readable
+        QVERIFY(LSB::decodeData(legacyImage) == data);
+
+        // Images written for older clients must be identical to the original output
+        QVERIFY(LsbCodec::encodeLegacy(cover, data) == legacyImage);
+        QVERIFY(LsbCodec::encodeLegacy(cover, QByteArray(171, 'x')).isNull());
+        QVERIFY(LsbCodec::legacyCapacity(cover.size()) == 165);
+
+        // Generated covers are just large enough to hold the data
+        LSB::enableGeneratedImages(true);
+        const QImage generated = LSB::encodeLegacyData(data);
+        QVERIFY(generated.size() == LsbCodec::requiredLegacyCoverSize(data.length()));
+        QVERIFY(LSB::decodeData(generated) == data);
+    }
+
+    void testLSBRasterLayout()
+    {
+        // Generate payload
+        QByteArray data(64 * 1024, 0);
+        for(int i = 0; i < data.length(); ++i)
+            data[i] = static_cast<char>(QRandomGenerator::global()->generate());
+
+        // Encode data over a generated image
+        LSB::enableGeneratedImages(true);
+        const QImage lsbImage = LSB::encodeData(data);
+
+        // Cover size must grow with the square root of the payload size
+        const int pixels = 43 + (data.length() * 8 + 2) / 3;
+        QVERIFY(lsbImage.width() * lsbImage.height() >= pixels);
+        QVERIFY(lsbImage.width() <= qCeil(qSqrt(pixels)));
+
+        // Decode data from image
+        QVERIFY(LSB::decodeData(lsbImage) == data);
+    }
+
+    void testLSBBitsPerChannel()
+    {
+        // Generate payload
+        QByteArray data(4096, 0);
+        for(int i = 0; i < data.length(); ++i)
+            data[i] = static_cast<char>(QRandomGenerator::global()->generate());
+
+        // Generated images, using more bits must reduce the image size
+        LSB::enableGeneratedImages(true);
+        int previousSize = INT_MAX;
+        for(int bits = 1; bits <= 4; ++bits) {
+            LSB::setBitsPerChannel(bits);
+            const QImage lsbImage = LSB::encodeData(data);
+            QVERIFY(lsbImage.width() < previousSize);
+            QVERIFY(LSB::decodeData(lsbImage) == data);
+            previousSize = lsbImage.width();
+        }
+
+        // Source image with alpha channel
+        QImage cover(128, 128, QImage::Format_ARGB32);
+        cover.fill(qRgba(0x40, 0x80, 0xc0, 0xff));
+        LSB::enableGeneratedImages(false);
+        LSB::enableAlphaChannel(true);
+        LSB::setSourceImage(cover);
+        for(int bits = 1; bits <= 4; ++bits) {
+            LSB::setBitsPerChannel(bits);
+            const QImage lsbImage = LSB::encodeData(data);
+            QVERIFY(lsbImage.size() == cover.size());
+            QVERIFY(LSB::decodeData(lsbImage) == data);
+        }
+
+        // Restore default configuration
+        LSB::setBitsPerChannel(1);
+        LSB::enableAlphaChannel(false);
+        LSB::enableGeneratedImages(true);
+    }
+
+    void testLsbCodec()
+    {
+        // Create two codecs with different configurations
+        LsbCodec codecA;
+        LsbCodec codecB;
+        codecB.setBitsPerChannel(3);
+
+        // Encode different payloads over the same cover
+        const QImage cover = LSB::generateImage(128, true);
+        const QImage coverCopy = cover.copy();
+        const QByteArray dataA = "The quick brown fox jumped over the lazy dog";
+        const QByteArray dataB = "Lorem ipsum dolor sit amet";
+        DifferentialImage differential;
+        const QImage imageA = codecA.encode(cover, dataA, &differential);
+        const QImage imageB = codecB.encode(cover, dataB);
+
+        // Cover must not be modified & configurations must not leak between codecs
+        QVERIFY(cover == coverCopy);
+        QVERIFY(!differential.isNull());
+        QVERIFY(codecA.decode(imageB) == dataB);
+        QVERIFY(codecB.decode(imageA) == dataA);
+
+        // Covers that are too small must be rejected
+        QVERIFY(codecA.encode(LSB::generateImage(8, true), dataA).isNull());
+        QVERIFY(LsbCodec::requiredCoverSize(dataA.length()).width() <= 16);
+
+        // Output must not depend on the number of threads
+        QByteArray large(1024 * 1024 + 7, 0);
+        for(int i = 0; i < large.length(); ++i)
+            large[i] = static_cast<char>(QRandomGenerator::global()->generate());
+        const QSize largeSize = LsbCodec::requiredCoverSize(large.length());
+        const QImage largeCover = LSB::generateImage(largeSize.width(), true);
+        codecA.setBitsPerChannel(3);
+        codecA.setThreadCount(1);
+        codecB.setThreadCount(8);
+        const QImage serial = codecA.encode(largeCover, large);
+        QVERIFY(codecB.encode(largeCover, large) == serial);
+        QVERIFY(codecB.decode(serial) == large);
+    }
+
+    void testLsbCodecScatterLayout()
+    {
+        // Permutation must be a bijection over any range
+        for(const qint64 size : {qint64(1), qint64(2), qint64(1000), qint64(4097)}) {
+            const ScatterLayout layout("password", size);
+            QVector<qint64> indexes(int(size));
+            layout.map(0, indexes.count(), indexes.data());
+            for(int i = 0; i < indexes.count(); ++i)
+                QVERIFY(layout.inverse(indexes.at(i)) == i);
+
+            std::sort(indexes.begin(), indexes.end());
+            for(int i = 0; i < indexes.count(); ++i)
+                QVERIFY(indexes.at(i) == i);
+        }
+
+        // Scattered data can only be read with the same key
+        QByteArray data(300 * 1024 + 5, 0);
+        for(int i = 0; i < data.length(); ++i)
+            data[i] = static_cast<char>(QRandomGenerator::global()->generate());
+        LsbCodec writer;
+        LsbCodec reader;
+        writer.setScatterKey("password");
+        const QImage cover = LSB::generateImage(1024, true);
+        DifferentialImage differential;
+        const QImage image = writer.encode(cover, data, &differential);
+        QVERIFY(writer.decode(image) == data);
+        QVERIFY(reader.decode(image).isEmpty());
+        reader.setScatterKey("Password");
+        QVERIFY(reader.decode(image).isEmpty());
+        QVERIFY(differential.pixelCount() == 43 + BitPlane::pixelsForBytes(data.length()));
+
+        // Differential image shows the header & the scattered pixels (and nothing else)
+        const ScatterLayout layout("password", 1024 * 1024 - 43);
+        QVector<bool> touched(1024 * 1024, false);
+        for(int i = 0; i < 43; ++i)
+            touched[i] = true;
+        for(int i = 0; i < BitPlane::pixelsForBytes(data.length()); ++i)
+            touched[int(43 + layout.map(i))] = true;
+
+        bool match = true;
+        const QImage full = differential.toImage();
+        for(int i = 0; i < touched.count(); ++i) {
+            const QRgb expected = touched.at(i) ? image.pixel(i % 1024, i / 1024) : qRgb(0, 0, 0);
+            match &= full.pixel(i % 1024, i / 1024) == expected;
+        }
+
+        QVERIFY(match);
+
+        // Output must not depend on the number of threads, undo restores scattered pixels
+        writer.setBitsPerChannel(2);
+        writer.setThreadCount(1);
+        reader.setScatterKey("password");
+        reader.setBitsPerChannel(2);
+        reader.setThreadCount(8);
+        UndoLog undo;
+        QImage working = cover.copy();
+        QVERIFY(reader.encodeInPlace(&working, data, &undo));
+        QVERIFY(working == writer.encode(cover, data));
+        undo.restore(&working);
+        QVERIFY(working == cover);
+    }
+
+    void testLsbCodecCapacity()
+    {
+        for(int bits = 1; bits <= 4; ++bits) {
+            // Payloads up to the capacity fit, larger payloads are rejected
+            LsbCodec codec;
+            codec.setBitsPerChannel(bits);
+            const QImage cover = LSB::generateImage(37, true);
+            const qint64 capacity = LsbCodec::capacity(cover.size(), bits);
+            QVERIFY(capacity > 0);
+            QVERIFY(!codec.encode(cover, QByteArray(int(capacity), 'x')).isNull());
+            QVERIFY(codec.encode(cover, QByteArray(int(capacity) + 1, 'x')).isNull());
+
+            // Required cover is the smallest square that fits the payload
+            for(const qint64 bytes : {qint64(0), qint64(1), qint64(1000), capacity}) {
+                const QSize size = LsbCodec::requiredCoverSize(bytes, bits);
+                QVERIFY(LsbCodec::capacity(size, bits) >= bytes);
+                QVERIFY(LsbCodec::capacity(size - QSize(1, 1), bits) < bytes || bytes == 0);
+            }
+        }
+
+        // LSB module rejects oversized payloads without encoding anything
+        LSB::enableGeneratedImages(false);
+        LSB::setSourceImage(LSB::generateImage(20, true));
+        QVERIFY(LSB::capacity() == LsbCodec::capacity(QSize(20, 20), LSB::bitsPerChannel()));
+        QVERIFY(LSB::encodeToBinaryData(QByteArray(int(LSB::capacity()) + 1, 'x')).isEmpty());
+        LSB::enableGeneratedImages(true);
+        QVERIFY(LSB::capacity() > 1024 * 1024);
+    }
+
+    void testDifferentialImage()
+    {
+        // Encode data over a generated image
+        LsbCodec codec;
+        DifferentialImage differential;
+        const QByteArray data = "The quick brown fox jumped over the lazy dog";
+        const QImage lsbImage = codec.encode(LSB::generateImage(64, true), data, &differential);
+        QVERIFY(differential.size() == lsbImage.size());
+
+        // Only the touched pixels must be shown at full size
+        const QImage full = differential.toImage();
+        const qint64 touched = differential.pixelCount();
+        QVERIFY(touched > 0 && touched < 64 * 64);
+        for(int i = 0; i < 64 * 64; ++i) {
+            const QRgb pixel = full.pixel(i % 64, i / 64);
+            QVERIFY(pixel == (i < touched ? lsbImage.pixel(i % 64, i / 64) : qRgb(0, 0, 0)));
+        }
+
+        // Preview must be built directly at the requested size
+        const QImage preview = differential.toImage(QSize(16, 16));
+        QVERIFY(preview.size() == QSize(16, 16));
+        QVERIFY(preview.pixel(0, 0) == lsbImage.pixel(0, 0));
+        QVERIFY(preview.pixel(15, 15) == qRgb(0, 0, 0));
+    }
+
+    void testLSBPngStream()
+    {
+        // Generate payload
+        QByteArray data(16 * 1024, 0);
+        for(int i = 0; i < data.length(); ++i)
+            data[i] = static_cast<char>(QRandomGenerator::global()->generate());
+
+        // Encode data over a cover with alpha channel & export it as PNG
+        LsbCodec codec;
+        codec.setBitsPerChannel(2);
+        codec.enableAlphaChannel(true);
+        QImage cover(256, 256, QImage::Format_ARGB32);
+        cover.fill(qRgba(0x40, 0x80, 0xc0, 0xf0));
+        const QByteArray png = LSB::imageToBinaryData(codec.encode(cover, data));
+
+        // Decode data row by row, truncated images must be rejected
+        QVERIFY(codec.decodePng(png) == data);
+        QVERIFY(codec.decodePng(png.left(png.length() / 2)).isEmpty());
+
+        // Images with the legacy layout are still decoded
+        const QByteArray text = "The quick brown fox jumped over the lazy dog";
+        const QImage legacyImage = LEGACY_ENCODE(LSB::generateImage(512, true), text);
+        QVERIFY(codec.decodePng(LSB::imageToBinaryData(legacyImage)) == text);
+    }
+
+    void testLSBDecodeFile()
+    {
+        QByteArray data(10000, 0);
+        for(int i = 0; i < data.length(); ++i)
+            data[i] = static_cast<char>(QRandomGenerator::global()->generate());
+
+        // PNG images are read row by row, other formats with clip rects
+        LsbCodec codec;
+        const QImage composite = codec.encode(LSB::generateImage(512, true), data);
+        const QImage legacy = LEGACY_ENCODE(LSB::generateImage(300, true), data.left(90));
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        QVERIFY(composite.save(dir.filePath("raster.png"), "PNG"));
+        QVERIFY(composite.save(dir.filePath("raster.bmp"), "BMP"));
+        QVERIFY(legacy.save(dir.filePath("legacy.png"), "PNG"));
+        QVERIFY(legacy.save(dir.filePath("legacy.bmp"), "BMP"));
+        QVERIFY(codec.decodeFile(dir.filePath("raster.png")) == data);
+        QVERIFY(codec.decodeFile(dir.filePath("raster.bmp")) == data);
+        QVERIFY(codec.decodeFile(dir.filePath("legacy.png")) == data.left(90));
+        QVERIFY(codec.decodeFile(dir.filePath("legacy.bmp")) == data.left(90));
+        QVERIFY(codec.decodeFile(dir.filePath("missing.png")).isEmpty());
+
+        // LSB module only reads a preview, or loads the composite image when it is requested
+        QVERIFY(LSB::decodeFile(dir.filePath("raster.png")) == data);
+        const QImage preview = LSB::currentCompositeImage(QSize(64, 64));
+        QVERIFY(preview.size() == QSize(64, 64));
+        QVERIFY(preview.pixel(63, 63) == composite.pixel(504, 504));
+        QVERIFY(LSB::currentCompositeImage() == composite);
+        QVERIFY(LSB::decodeFile(dir.filePath("raster.bmp")) == data);
+        QVERIFY(LSB::currentCompositeImage(QSize(64, 64)).size() == QSize(64, 64));
+
+        // Same for received PNG images (the preview keeps the aspect ratio)
+        QVERIFY(LSB::decodeData(LSB::imageToBinaryData(composite)) == data);
+        QVERIFY(LSB::currentCompositeImage(QSize(64, 32)).size() == QSize(64, 64));
+        QVERIFY(LSB::currentCompositeImage(QSize(64, 64)).pixel(1, 1) == composite.pixel(8, 8));
+        QVERIFY(LSB::currentCompositeImage() == composite);
+    }
+
+    void testLSBInPlaceEncoding()
+    {
+        // Encode data directly over a working image
+        LsbCodec codec;
+        UndoLog undo;
+        const QByteArray data = "The quick brown fox jumped over the lazy dog";
+        const QImage cover = LSB::generateImage(256, true);
+        QImage image = cover.copy();
+        const uchar* bits = image.constBits();
+        QVERIFY(codec.encodeInPlace(&image, data, &undo));
+        QVERIFY(codec.decode(image) == data);
+
+        // Only the modified pixels are recorded & the image must not be copied
+        QVERIFY(undo.pixelCount() < 256 * 256);
+        undo.restore(&image);
+        QVERIFY(image == cover);
+        QVERIFY(image.constBits() == bits);
+
+        // Consecutive messages over the same source image
+        LSB::enableGeneratedImages(false);
+        LSB::setSourceImage(cover);
+        QVERIFY(LSB::decodeData(LSB::encodeToBinaryData(data)) == data);
+        QVERIFY(LSB::decodeData(LSB::encodeToBinaryData("Lorem ipsum")) == "Lorem ipsum");
+
+        // Composite image is the working image (not decoded from the export)
+        const QByteArray png = LSB::encodeToBinaryData(data);
+        QVERIFY(codec.decode(LSB::currentCompositeImage()) == data);
+        QVERIFY(LSB::currentCompositeImage(QSize(64, 64)).size() == QSize(64, 64));
+        QVERIFY(LSB::currentImageData().pixel(0, 0) == LSB::currentCompositeImage().pixel(0, 0));
+        QVERIFY(codec.decode(QImage::fromData(png, "PNG")) == data);
+
+        // Pixels of the previous message are restored before writing the next one
+        QVERIFY(!LSB::encodeToBinaryData("Lorem ipsum").isEmpty());
+        const int last = 43 + BitPlane::pixelsForBytes(data.length()) - 1;
+        const QImage composite = LSB::currentCompositeImage();
+        QVERIFY(composite.pixel(last % 256, last / 256) == cover.pixel(last % 256, last / 256));
+        QVERIFY(codec.decode(composite) == "Lorem ipsum");
+        LSB::enableGeneratedImages(true);
+    }
+
+    void testLSBChecksum()
+    {
+        // Validate CRC-32C against the standard check value
+        const QByteArray check = "123456789";
+        QVERIFY(Checksum::crc32c(check.constData(), check.length()) == 0xe3069283);
+
+        // Checksums must be chainable
+        const quint32 crc = Checksum::crc32c(check.constData(), 4);
+        QVERIFY(Checksum::crc32c(check.constData() + 4, 5, crc) == 0xe3069283);
+
+        // Encode data over a generated image
+        const QByteArray data = "The quick brown fox jumped over the lazy dog";
+        LSB::enableGeneratedImages(true);
+        QImage lsbImage = LSB::encodeData(data);
+        QVERIFY(LSB::decodeData(lsbImage) == data);
+
+        // Corrupt the last pixel of the payload, data must be rejected
+        const int pixel = 43 + (data.length() * 8 - 1) / 3;
+        const int x = pixel % lsbImage.width();
+        const int y = pixel / lsbImage.width();
+        lsbImage.setPixel(x, y, lsbImage.pixel(x, y) ^ 0x010101);
+        QVERIFY(LSB::decodeData(lsbImage).isEmpty());
+
+        // Images without data must be rejected
+        QVERIFY(LSB::decodeData(LSB::generateImage(256, true)).isEmpty());
+    }
+
+    void testGenerateImage()
+    {
+        // Images generated with the same seed must be equal
+        LSB::setRandomSeed(0x5eed);
+        const QImage first = LSB::generateImage(333, true);
+        LSB::setRandomSeed(0x5eed);
+        QVERIFY(LSB::generateImage(333, true) == first);
+        QVERIFY(LSB::generateImage(333, true) != first);
+
+        // Validate color ranges
+        for(int y = 0; y < first.height(); ++y) {
+            for(int x = 0; x < first.width(); ++x) {
+                const QRgb pixel = first.pixel(x, y);
+                QVERIFY(qRed(pixel) >= 0x20 && qRed(pixel) < 0xdd);
+                QVERIFY(qGreen(pixel) >= 0x20 && qGreen(pixel) < 0x90);
+                QVERIFY(qBlue(pixel) >= 0x20 && qBlue(pixel) < 0xff);
+            }
+        }
+    }
+
+    void testCoverPool()
+    {
+        // Covers are generated in the background
+        CoverPool pool;
+        pool.reserve();
+        QImage cover;
+        QTRY_VERIFY((cover = pool.take(100)).width() > 0);
+
+        // Covers must be cropped to the requested size
+        QVERIFY(cover.size() == QSize(100, 100));
+
+        // Sizes above the largest standard size cannot be served
+        QVERIFY(pool.take(4096).isNull());
+    }
+
+    void benchmarkGenerateImage()
+    {
+        LSB::setRandomSeed(0x5eed);
+        QBENCHMARK {
+            LSB::generateImage(4096, true);
+        }
+    }
+
+    void testBitPlaneKernels()
+    {
+        const BitPlane::Kernel kernels[] = {
+            BitPlane::KernelScalar, BitPlane::KernelSSE2, BitPlane::KernelAVX2
+        };
+
+        for(int bytes = 0; bytes < 100; ++bytes) {
+            // Generate random data & pixels
+            QByteArray data(bytes, 0);
+            QVector<QRgb> pixels(BitPlane::pixelsForBytes(bytes) + 8);
+            for(int i = 0; i < data.length(); ++i)
+                data[i] = static_cast<char>(QRandomGenerator::global()->generate());
+            for(int i = 0; i < pixels.length(); ++i)
+                pixels[i] = QRandomGenerator::global()->generate();
+
+            // Obtain output of the scalar kernel
+            QVector<QRgb> reference = pixels;
+            const uchar* input = reinterpret_cast<const uchar*>(data.constData());
+            BitPlane::embed(BitPlane::KernelScalar, reference.data(), input, bytes);
+
+            // Check that every kernel produces the same output & reads the original data
+            for(const BitPlane::Kernel kernel : kernels) {
+                if(!BitPlane::kernelSupported(kernel))
+                    continue;
+
+                QVector<QRgb> output = pixels;
+                BitPlane::embed(kernel, output.data(), input, bytes);
+                QVERIFY(output == reference);
+
+                QByteArray decoded(bytes, 0);
+                BitPlane::extract(kernel, output.constData(),
+                                  reinterpret_cast<uchar*>(decoded.data()), bytes);
+                QVERIFY(decoded == data);
+            }
+        }
+    }
+
+    void benchmarkLSBEncode_data()
+    {
+        QTest::addColumn<int>("payloadSize");
+        QTest::addColumn<bool>("diagonal");
+        QTest::addColumn<bool>("perPixel");
+
+        QTest::newRow("1 KB, raster, per-pixel") << 1024 << false << true;
+        QTest::newRow("1 KB, raster, scan line") << 1024 << false << false;
+        QTest::newRow("64 KB, raster, per-pixel") << 64 * 1024 << false << true;
+        QTest::newRow("64 KB, raster, scan line") << 64 * 1024 << false << false;
+        QTest::newRow("1 MB, raster, per-pixel") << 1024 * 1024 << false << true;
+        QTest::newRow("1 MB, raster, scan line") << 1024 * 1024 << false << false;
+        QTest::newRow("1 KB, diagonal, per-pixel") << 1024 << true << true;
+        QTest::newRow("1 KB, diagonal, scan line") << 1024 << true << false;
+    }
+
+    void benchmarkLSBEncode()
+    {
+        QFETCH(int, payloadSize);
+        QFETCH(bool, diagonal);
+        QFETCH(bool, perPixel);
+
+        // Both engines write the same layout over the same cover (the diagonal layout needs a
+        // square cover with three pixels per byte, so it is only measured with 1 KB)
+        const QSize coverSize = diagonal ? LsbCodec::requiredLegacyCoverSize(payloadSize) :
+                                LsbCodec::requiredCoverSize(payloadSize);
+
+        // Generate payload & cover image
+        QByteArray data(payloadSize, 0);
+        for(int i = 0; i < data.length(); ++i)
+            data[i] = static_cast<char>(QRandomGenerator::global()->generate());
+        const QImage cover = LSB::generateImage(coverSize.width(), true);
+        LSB::enableGeneratedImages(false);
+        LSB::setSourceImage(cover);
+
+        // Measure encoding time of the per-pixel engine or the scan line engine
+        QImage lsbImage;
+        QBENCHMARK {
+            if(diagonal)
+                lsbImage = perPixel ? LEGACY_ENCODE(cover, data) :
+                           LsbCodec::encodeLegacy(cover, data);
+            else
+                lsbImage = perPixel ? RASTER_ENCODE(cover, data) : LSB::encodeData(data);
+        }
+
+        // Validate output, both engines must produce the same image
+        if(diagonal)
+            QVERIFY(lsbImage == LEGACY_ENCODE(cover, data));
+        else
+            QVERIFY(lsbImage == RASTER_ENCODE(cover, data));
+        QVERIFY(LSB::decodeData(lsbImage) == data);
+        LSB::enableGeneratedImages(true);
+    }
+
+    void benchmarkLsbCodecThreads_data()
+    {
+        QTest::addColumn<int>("threads");
+
+        QTest::newRow("1 thread") << 1;
+        QTest::newRow("2 threads") << 2;
+        QTest::newRow("4 threads") << 4;
+        QTest::newRow("All cores") << QThread::idealThreadCount();
+    }
+
+    void benchmarkLsbCodecThreads()
+    {
+        // The cover alone uses 1 GB of memory, only run when explicitly requested
+        if(!qEnvironmentVariableIsSet("LSB_LARGE_BENCHMARKS"))
+            QSKIP("Set LSB_LARGE_BENCHMARKS to run the 50 MB payload benchmark");
+
+        QFETCH(int, threads);
+
+        // Generate 50 MB payload & 16k x 16k cover image
+        QByteArray data(50 * 1024 * 1024, 0);
+        for(int i = 0; i < data.length(); ++i)
+            data[i] = static_cast<char>(QRandomGenerator::global()->generate());
+        QImage cover(16384, 16384, QImage::Format_RGB32);
+        cover.fill(qRgb(0x40, 0x80, 0xc0));
+
+        // Measure encoding & decoding time
+        LsbCodec codec;
+        codec.setThreadCount(threads);
+        QImage lsbImage;
+        QByteArray decoded;
+        QBENCHMARK {
+            lsbImage = codec.encode(cover, data);
+            decoded = codec.decode(lsbImage);
+        }
+
+        // Validate output
+        QVERIFY(decoded == data);
+    }
+
+    void benchmarkCryptoThreads_data()
+    {
+        QTest::addColumn<bool>("sealed");
+        QTest::addColumn<int>("threads");
+
+        const int threads[] = {1, 2, 4, QThread::idealThreadCount()};
+        for(int count : threads) {
+            QTest::newRow(qPrintable(QString("Legacy, %1 threads").arg(count))) << false << count;
+            QTest::newRow(qPrintable(QString("Sealed, %1 threads").arg(count))) << true << count;
+        }
+    }
+
+    void benchmarkCryptoThreads()
+    {
+        // Each row keeps ~300 MB alive, only run when explicitly requested
+        if(!qEnvironmentVariableIsSet("LSB_LARGE_BENCHMARKS"))
+            QSKIP("Set LSB_LARGE_BENCHMARKS to run the 100 MB payload benchmark");
+
+        QFETCH(bool, sealed);
+        QFETCH(int, threads);
+
+        // Generate 100 MB payload
+        QByteArray data(100 * 1024 * 1024, 0);
+        QRandomGenerator::global()->fillRange(reinterpret_cast<quint32*>(data.data()),
+                                              data.length() / sizeof(quint32));
+
+        // Measure encryption & decryption time (key is derived before the benchmark)
+        CryptoError error;
+        QByteArray output;
+        const CryptoContext context("1234567890abcdefghijklmnopqrstuvwxyz!#$%&/()=?");
+        context.sealKey();
+        Crypto::setThreadCount(threads);
+        QBENCHMARK {
+            if(sealed) {
+                output = Crypto::openData(Crypto::sealData(data, context, &error), context,
+                                          &error);
+            }
+
+            else {
+                output = QByteArray(data.constData(), data.length());
+                Crypto::encryptInPlace(output.data(), output.length(), context, &error);
+                Crypto::decryptInPlace(output.data(), output.length(), context, &error);
+            }
+        }
+
+        // Validate output
+        Crypto::setThreadCount(0);
+        QVERIFY(output == data);
+    }
+
+    void benchmarkPngProfiles_data()
+    {
+        QTest::addColumn<bool>("generated");
+        QTest::addColumn<int>("profile");
+
+        QTest::newRow("Generated cover, fastest") << true << int(PngWriter::ProfileFastest);
+        QTest::newRow("Generated cover, balanced") << true << int(PngWriter::ProfileBalanced);
+        QTest::newRow("Generated cover, smallest") << true << int(PngWriter::ProfileSmallest);
+        QTest::newRow("Photo, fastest") << false << int(PngWriter::ProfileFastest);
+        QTest::newRow("Photo, balanced") << false << int(PngWriter::ProfileBalanced);
+        QTest::newRow("Photo, smallest") << false << int(PngWriter::ProfileSmallest);
+    }
+
+    void benchmarkPngProfiles()
+    {
+        QFETCH(bool, generated);
+        QFETCH(int, profile);
+
+        // Generate 1024x1024 image
+        const QImage image = generated ? LSB::generateImage(1024, true) : PHOTO_IMAGE(1024);
+
+        // Measure PNG export time
+        QByteArray png;
+        QBENCHMARK {
+            png = PngWriter::write(image, static_cast<PngWriter::Profile>(profile));
+        }
+
+        // Report output size & validate that the image is preserved
+        qInfo() << PngWriter::profileName(static_cast<PngWriter::Profile>(profile))
+                << "profile:" << png.size() << "bytes";
+        QVERIFY(QImage::fromData(png, "PNG").convertToFormat(QImage::Format_RGB32) == image);
+    }
+
+    void testPngWriterStripes()
+    {
+        // Large enough to be split in several stripes
+        QImage image = PHOTO_IMAGE(1200);
+        QImage alpha = image.convertToFormat(QImage::Format_ARGB32);
+        alpha.setPixel(10, 900, qRgba(1, 2, 3, 4));
+
+        // Output must not depend on the number of threads & must decode to the same image
+        for(int i = PngWriter::ProfileFastest; i <= PngWriter::ProfileSmallest; ++i) {
+            const PngWriter::Profile p = static_cast<PngWriter::Profile>(i);
+            const QByteArray png = PngWriter::write(image, p, 1);
+            QVERIFY(!png.isEmpty());
+            QVERIFY(PngWriter::write(image, p, 4) == png);
+            QVERIFY(QImage::fromData(png, "PNG").convertToFormat(QImage::Format_RGB32) == image);
+
+            const QByteArray alphaPng = PngWriter::write(alpha, p, 3);
+            const QImage decoded = QImage::fromData(alphaPng, "PNG");
+            QVERIFY(decoded.convertToFormat(QImage::Format_ARGB32) == alpha);
+        }
+    }
+
+    void testWireImage()
+    {
+        // Generated covers are stored as raw pixels, photos with the QOI operations
+        const QImage images[] = {
+            LSB::generateImage(300, true),
+            PHOTO_IMAGE(300),
+            PHOTO_IMAGE(300).convertToFormat(QImage::Format_ARGB32)
+        };
+
+        for(const QImage& image : images) {
+            const QByteArray data = WireImage::write(image);
+            QVERIFY(WireImage::isWireImage(data));
+            QVERIFY(WireImage::read(data) == image);
+
+            // Truncated data must be rejected
+            QVERIFY(WireImage::read(data.left(data.size() - 1)).isNull());
+            QVERIFY(WireImage::read(data.left(16)).isNull());
+        }
+
+        // LSB images can be sent in either format
+        const QByteArray payload = "Hello, wire image!";
+        const QByteArray wireImage = LSB::encodeToBinaryData(payload, LSB::WireFormat);
+        const QByteArray png = LSB::convertBinaryData(wireImage, LSB::PngFormat);
+        QVERIFY(!WireImage::isWireImage(png));
+        QVERIFY(LSB::decodeData(wireImage) == payload);
+        QVERIFY(LSB::decodeData(png) == payload);
+    }
+
+    void benchmarkWireImage_data()
+    {
+        QTest::addColumn<bool>("generated");
+        QTest::addColumn<bool>("wire");
+
+        QTest::newRow("Generated cover, PNG") << true << false;
+        QTest::newRow("Generated cover, wire image") << true << true;
+        QTest::newRow("Photo, PNG") << false << false;
+        QTest::newRow("Photo, wire image") << false << true;
+    }
+
+    void benchmarkWireImage()
+    {
+        QFETCH(bool, generated);
+        QFETCH(bool, wire);
+
+        // Measure the time needed to send & receive a 1024x1024 image
+        const QImage image = generated ? LSB::generateImage(1024, true) : PHOTO_IMAGE(1024);
+        QImage received;
+        QBENCHMARK {
+            if(wire)
+                received = WireImage::read(WireImage::write(image));
+            else
+                received = QImage::fromData(PngWriter::write(image, PngWriter::ProfileFastest));
+        }
+
+        QVERIFY(received.convertToFormat(QImage::Format_RGB32) == image);
+    }
+
+    void benchmarkPngWriterThreads_data()
+    {
+        QTest::addColumn<int>("threads");
+
+        QTest::newRow("1 thread") << 1;
+        QTest::newRow("2 threads") << 2;
+        QTest::newRow("4 threads") << 4;
+        QTest::newRow("All cores") << QThread::idealThreadCount();
+    }
+
+    void benchmarkPngWriterThreads()
+    {
+        QFETCH(int, threads);
+
+        // Measure PNG export time of a 4096x4096 image
+        const QImage image = PHOTO_IMAGE(4096);
+        QByteArray png;
+        QBENCHMARK {
+            png = PngWriter::write(image, PngWriter::ProfileBalanced, threads);
+        }
+
+        QVERIFY(!png.isEmpty());
+    }
+
+    void testCryptoKernels()
+    {
+        const Crypto::Kernel kernels[] = {
+            Crypto::KernelScalar, Crypto::KernelSSE2, Crypto::KernelAVX2
+        };
+
+        for(const int keyLength : {1, 3, 17, 32, 92, 93, 94, 95, 255, 256, 300}) {
+            // Generate random key (without null bytes) & data
+            QByteArray key(keyLength, 0);
+            for(int i = 0; i < key.length(); ++i)
+                key[i] = static_cast<char>(QRandomGenerator::global()->bounded(1, 256));
+
+            for(int bytes = 0; bytes < 140; bytes += 3) {
+                QByteArray data(bytes, 0);
+                for(int i = 0; i < data.length(); ++i)
+                    data[i] = static_cast<char>(QRandomGenerator::global()->generate());
+
+                // Every kernel must match the original implementation, also in place
+                const QByteArray encrypted = LEGACY_CRYPT(data, key, true);
+                const QByteArray decrypted = LEGACY_CRYPT(data, key, false);
+                for(const Crypto::Kernel kernel : kernels) {
+                    if(!Crypto::kernelSupported(kernel))
+                        continue;
+
+                    QByteArray output(bytes, 0);
+                    Crypto::encrypt(kernel, data.constData(), output.data(), bytes, key);
+                    QVERIFY(output == encrypted);
+                    Crypto::decrypt(kernel, data.constData(), output.data(), bytes, key);
+                    QVERIFY(output == decrypted);
+
+                    QByteArray inPlace(data.constData(), bytes);
+                    char* buffer = inPlace.data();
+                    Crypto::encrypt(kernel, buffer, buffer, bytes, key);
+                    QVERIFY(inPlace == encrypted);
+                }
+            }
+        }
+    }
+
+    void testCryptoInPlace()
+    {
+        // Generate data
+        const QByteArray key = "1234567890abcdefghijklmnopqrstuvwxyz!#$%&/()=?";
+        QByteArray data(1000, 0);
+        for(int i = 0; i < data.length(); ++i)
+            data[i] = static_cast<char>(QRandomGenerator::global()->generate());
+
+        // Encrypt the buffer in parts of different sizes, result must match encryptData()
+        CryptoError error;
+        const QByteArray expected = Crypto::encryptData(data, key, &error);
+        QByteArray buffer(data.constData(), data.length());
+        char* bytes = buffer.data();
+        for(qint64 offset = 0, part = 1; offset < buffer.length(); offset += part, part += 7) {
+            const qint64 length = qMin<qint64>(part, buffer.length() - offset);
+            Crypto::encryptInPlace(bytes + offset, length, key, &error, offset);
+            QVERIFY(error == kNoError);
+        }
+        QVERIFY(buffer == expected);
+        QVERIFY(buffer.constData() == bytes);
+
+        // Decrypt at once, empty keys must not modify the buffer
+        Crypto::decryptInPlace(bytes, buffer.length(), "", &error);
+        QVERIFY(error == kPasswordEmpty);
+        QVERIFY(buffer == expected);
+        Crypto::decryptInPlace(bytes, buffer.length(), key, &error);
+        QVERIFY(buffer == data);
+    }
+
+    void testCryptoContext()
+    {
+        // Generate data
+        const QByteArray key = "1234567890abcdefghijklmnopqrstuvwxyz!#$%&/()=?";
+        QByteArray data(1000, 0);
+        for(int i = 0; i < data.length(); ++i)
+            data[i] = static_cast<char>(QRandomGenerator::global()->generate());
+
+        // Context must produce the same output as the key-based API
+        CryptoError error;
+        const CryptoContext context(key);
+        const QByteArray expected = Crypto::encryptData(data, key, &error);
+        QByteArray buffer(data.constData(), data.length());
+        Crypto::encryptInPlace(buffer.data(), 500, context, &error);
+        Crypto::encryptInPlace(buffer.data() + 500, 500, context, &error, 500);
+        QVERIFY(error == kNoError);
+        QVERIFY(buffer == expected);
+        Crypto::decryptInPlace(buffer.data(), buffer.length(), context, &error);
+        QVERIFY(buffer == data);
+
+        // Sealed key is derived once and matches the password-based API
+        QVERIFY(context.sealKey() == Crypto::deriveKey(key));
+        QVERIFY(context.sealKey().constData() == context.sealKey().constData());
+        const QByteArray sealed = Crypto::sealData(data, context, &error);
+        QVERIFY(Crypto::openData(sealed, key, &error) == data);
+        QVERIFY(error == kNoError);
+
+        // Scatter key is a subkey of the sealed key (never the password itself)
+        QCOMPARE(context.scatterKey().length(), 32);
+        QVERIFY(context.scatterKey() != key);
+        QVERIFY(context.scatterKey() != context.sealKey());
+        QVERIFY(context.scatterKey() == CryptoContext(key).scatterKey());
+
+        // Empty contexts must not modify the data
+        const CryptoContext empty;
+        QVERIFY(empty.isEmpty());
+        Crypto::encryptInPlace(buffer.data(), buffer.length(), empty, &error);
+        QVERIFY(error == kPasswordEmpty);
+        QVERIFY(buffer == data);
+        QVERIFY(Crypto::openData(sealed, empty, &error).isEmpty());
+        QVERIFY(error == kPasswordEmpty);
+    }
+
+    void testCryptoThreads()
+    {
+        // Generate 5 MB of data, enough to be split in several bands/chunks
+        const QByteArray key = "1234567890abcdefghijklmnopqrstuvwxyz!#$%&/()=?";
+        QByteArray data(5 * 1024 * 1024 + 33, 0);
+        for(int i = 0; i < data.length(); ++i)
+            data[i] = static_cast<char>(QRandomGenerator::global()->generate());
+
+        // Output must not depend on the number of threads
+        CryptoError error;
+        Crypto::setThreadCount(1);
+        const QByteArray expected = Crypto::encryptData(data, key, &error);
+        const QByteArray sealKey = Crypto::deriveKey(key);
+        const QByteArray sealed = AeadStream::seal(data, sealKey);
+        const int threads[] = {2, 3, 8, 0};
+        for(int count : threads) {
+            Crypto::setThreadCount(count);
+            QVERIFY(Crypto::encryptData(data, key, &error) == expected);
+            QVERIFY(Crypto::decryptData(expected, key, &error) == data);
+
+            QByteArray output;
+            QVERIFY(AeadStream::open(sealed, sealKey, &output, count));
+            QVERIFY(output == data);
+
+            // Every chunk sealed in parallel must open in order, one chunk at a time
+            const QByteArray parallel = AeadStream::seal(data, sealKey,
+                                                         AeadStream::DefaultChunkSize, count);
+            AeadStream stream(sealKey);
+            QVERIFY(stream.beginOpen(parallel.left(AeadStream::HeaderSize)));
+            int offset = AeadStream::HeaderSize;
+            for(int position = 0; position < data.length(); position += stream.chunkSize()) {
+                const int bytes = qMin(stream.chunkSize(), data.length() - position);
+                QByteArray chunk = parallel.mid(offset, bytes);
+                QVERIFY(stream.openChunk(reinterpret_cast<uchar*>(chunk.data()), bytes,
+                                         position + bytes == data.length(),
+                                         reinterpret_cast<const uchar*>(parallel.constData()) +
+                                         offset + bytes));
+                QVERIFY(chunk == data.mid(position, bytes));
+                offset += bytes + AeadStream::TagSize;
+            }
+        }
+
+        Crypto::setThreadCount(0);
+    }
+
+    void testChaCha20Poly1305()
+    {
+        // AEAD test vector (RFC 8439, section 2.8.2)
+        QByteArray key(ChaCha20Poly1305::KeySize, 0);
+        for(int i = 0; i < key.length(); ++i)
+            key[i] = static_cast<char>(0x80 + i);
+        const QByteArray nonce = QByteArray::fromHex("070000004041424344454647");
+        const QByteArray aad = QByteArray::fromHex("50515253c0c1c2c3c4c5c6c7");
+        const QByteArray plaintext = "Ladies and Gentlemen of the class of '99: If I could offer "
+                                     "you only one tip for the future, sunscreen would be it.";
+        const QByteArray ciphertext = QByteArray::fromHex(
+                                          "d31a8d34648e60db7b86afbc53ef7ec2a4aded51296e08fea9e2b5a7"
+                                          "36ee62d63dbea45e8ca9671282fafb69da92728b1a71de0a9e060b29"
+                                          "05d6a5b67ecd3b3692ddbd7f2d778b8c9803aee328091b58fab324e4"
+                                          "fad675945585808b4831d7bc3ff4def08e4b7a9de576d26586cec64b"
+                                          "6116");
+        const QByteArray tag = QByteArray::fromHex("1ae10b594f09e26a7e902ecbd0600691");
+
+        // Seal & open in place
+        const uchar* k = reinterpret_cast<const uchar*>(key.constData());
+        const uchar* n = reinterpret_cast<const uchar*>(nonce.constData());
+        const uchar* a = reinterpret_cast<const uchar*>(aad.constData());
+        QByteArray buffer(plaintext.constData(), plaintext.length());
+        QByteArray sealedTag(ChaCha20Poly1305::TagSize, 0);
+        uchar* data = reinterpret_cast<uchar*>(buffer.data());
+        ChaCha20Poly1305::seal(k, n, a, aad.length(), data, buffer.length(),
+                               reinterpret_cast<uchar*>(sealedTag.data()));
+        QVERIFY(buffer == ciphertext);
+        QVERIFY(sealedTag == tag);
+        QVERIFY(ChaCha20Poly1305::open(k, n, a, aad.length(), data, buffer.length(),
+                                       reinterpret_cast<const uchar*>(tag.constData())));
+        QVERIFY(buffer == plaintext);
+
+        // Modified data must be rejected and left untouched
+        buffer = QByteArray(ciphertext.constData(), ciphertext.length());
+        buffer[10] = static_cast<char>(buffer.at(10) ^ 1);
+        const QByteArray modified(buffer.constData(), buffer.length());
+        QVERIFY(!ChaCha20Poly1305::open(k, n, a, aad.length(),
+                                        reinterpret_cast<uchar*>(buffer.data()), buffer.length(),
+                                        reinterpret_cast<const uchar*>(tag.constData())));
+        QVERIFY(buffer == modified);
+
+        // All kernels must produce the same keystream for every length and counter
+        const ChaCha20Poly1305::Kernel kernels[] = {
+            ChaCha20Poly1305::KernelScalar,
+            ChaCha20Poly1305::KernelSSE2,
+            ChaCha20Poly1305::KernelAVX2
+        };
+        const quint32 counters[] = {0, 1, 0xfffffffa};
+        const int lengths[] = {0, 1, 63, 64, 65, 255, 256, 511, 512, 513, 1500, 4099};
+        for(quint32 counter : counters) {
+            for(int length : lengths) {
+                QByteArray expected(length, 0);
+                ChaCha20Poly1305::chacha20(ChaCha20Poly1305::KernelScalar, k, n, counter,
+                                           reinterpret_cast<uchar*>(expected.data()), length);
+                for(ChaCha20Poly1305::Kernel kernel : kernels) {
+                    if(!ChaCha20Poly1305::kernelSupported(kernel))
+                        continue;
+
+                    QByteArray output(length, 0);
+                    ChaCha20Poly1305::chacha20(kernel, k, n, counter,
+                                               reinterpret_cast<uchar*>(output.data()), length);
+                    QVERIFY(output == expected);
+                }
+            }
+        }
+    }
+
+    void testAeadStream()
+    {
+        // Generate key & data
+        QByteArray key(ChaCha20Poly1305::KeySize, 0);
+        QByteArray data(10000, 0);
+        for(int i = 0; i < key.length(); ++i)
+            key[i] = static_cast<char>(QRandomGenerator::global()->generate());
+        for(int i = 0; i < data.length(); ++i)
+            data[i] = static_cast<char>(QRandomGenerator::global()->generate());
+        QByteArray wrongKey = key;
+        wrongKey[0] = static_cast<char>(wrongKey.at(0) ^ 1);
+
+        // Round-trip with different lengths & chunk sizes
+        const int lengths[] = {0, 1, 64, 1000, 1024, 10000};
+        const int chunkSizes[] = {16, 1000, 1024, AeadStream::DefaultChunkSize};
+        for(int length : lengths) {
+            for(int chunkSize : chunkSizes) {
+                const QByteArray plaintext = data.left(length);
+                const QByteArray sealed = AeadStream::seal(plaintext, key, chunkSize);
+                QVERIFY(AeadStream::isSealed(sealed));
+                QCOMPARE(qint64(sealed.length()), AeadStream::sealedSize(length, chunkSize));
+
+                QByteArray output;
+                QVERIFY(AeadStream::open(sealed, key, &output));
+                QVERIFY(output == plaintext);
+                QVERIFY(!AeadStream::open(sealed, wrongKey, &output));
+                QVERIFY(output.isEmpty());
+            }
+        }
+
+        // A wrong key is rejected by the header alone (first 40 bytes)
+        const QByteArray sealed = AeadStream::seal(data, key, 1024);
+        AeadStream right(key);
+        AeadStream wrong(wrongKey);
+        QVERIFY(right.beginOpen(sealed.left(AeadStream::HeaderSize)));
+        QVERIFY(!wrong.beginOpen(sealed.left(AeadStream::HeaderSize)));
+
+        // Chunks can be opened one by one, modified/truncated streams are rejected
+        const int sealedChunk = 1024 + AeadStream::TagSize;
+        QByteArray chunk = sealed.mid(AeadStream::HeaderSize, 1024);
+        QVERIFY(!right.openChunk(reinterpret_cast<uchar*>(chunk.data()), 1024, true,
+                                 reinterpret_cast<const uchar*>(sealed.constData()) +
+                                 AeadStream::HeaderSize + 1024));
+        QVERIFY(right.openChunk(reinterpret_cast<uchar*>(chunk.data()), 1024, false,
+                                reinterpret_cast<const uchar*>(sealed.constData()) +
+                                AeadStream::HeaderSize + 1024));
+        QVERIFY(chunk == data.left(1024));
+
+        QByteArray output;
+        QByteArray modified = sealed;
+        const int offset = AeadStream::HeaderSize + 5;
+        modified[offset] = static_cast<char>(modified.at(offset) ^ 1);
+        QVERIFY(!AeadStream::open(modified, key, &output));
+        QVERIFY(!AeadStream::open(sealed.left(AeadStream::HeaderSize + 2 * sealedChunk), key,
+                                  &output));
+
+        // Password-based API
+        CryptoError error;
+        const QByteArray message = Crypto::sealData(data, "password", &error);
+        QVERIFY(error == kNoError);
+        QVERIFY(Crypto::openData(message, "password", &error) == data);
+        QVERIFY(error == kNoError);
+        QVERIFY(Crypto::openData(message, "Password", &error).isEmpty());
+        QVERIFY(error == kAuthenticationError);
+    }
+
+    void testMessageEnvelope()
+    {
+        // Wrap & unwrap payload
+        const QByteArray payload = "{\"MessageType\":\"Text\"}";
+        const MessageEnvelope sealed(MessageEnvelope::CipherChaCha20Poly1305,
+                                     MessageEnvelope::ContentJson);
+        const QByteArray data = sealed.wrap(payload);
+        QCOMPARE(data.length(), payload.length() + MessageEnvelope::HeaderSize);
+
+        QByteArray output;
+        MessageEnvelope envelope;
+        QVERIFY(MessageEnvelope::unwrap(data, &envelope, &output));
+        QVERIFY(envelope.isEncrypted());
+        QVERIFY(envelope.cipher() == MessageEnvelope::CipherChaCha20Poly1305);
+        QVERIFY(envelope.contentType() == MessageEnvelope::ContentJson);
+        QVERIFY(output == payload);
+
+        // Unencrypted payloads
+        const MessageEnvelope plain(MessageEnvelope::CipherNone, MessageEnvelope::ContentJson);
+        QVERIFY(MessageEnvelope::unwrap(plain.wrap(payload), &envelope, &output));
+        QVERIFY(!envelope.isEncrypted());
+        QVERIFY(output == payload);
+
+        // Messages of older clients, unknown versions & inconsistent flags are rejected
+        QByteArray modified = data;
+        QVERIFY(!MessageEnvelope::unwrap(payload, &envelope, &output));
+        modified[4] = 2;
+        QVERIFY(!MessageEnvelope::unwrap(modified, &envelope, &output));
+        modified = data;
+        modified[5] = 0;
+        QVERIFY(!MessageEnvelope::unwrap(modified, &envelope, &output));
+
+        // Payload sealed after reserved room, envelope written in place
+        CryptoError error;
+        QByteArray buffer(MessageEnvelope::HeaderSize, 0);
+        buffer.append(payload);
+        buffer = Crypto::sealData(buffer, CryptoContext("password"), &error,
+                                  MessageEnvelope::HeaderSize);
+        QVERIFY(error == kNoError);
+        sealed.writeHeader(buffer.data());
+        QVERIFY(buffer.left(MessageEnvelope::HeaderSize) == data.left(MessageEnvelope::HeaderSize));
+        QVERIFY(MessageEnvelope::unwrap(buffer, &envelope, &output));
+        QVERIFY(Crypto::openData(output, "password", &error) == payload);
+    }
+
+    void testChatMessage()
+    {
+        // Binary file (with zeros & invalid UTF-8) survives a CBOR round-trip
+        QByteArray fileData(4096, '\0');
+        for(int i = 0; i < fileData.length(); ++i)
+            fileData[i] = static_cast<char>((i * 7) & 0xFF);
+
+        const ChatMessage file(ChatMessage::File, "Image.png", fileData);
+        const QByteArray cbor = file.toCbor();
+        ChatMessage message = ChatMessage::fromCbor(cbor);
+        QVERIFY(message.isValid());
+        QVERIFY(message.type() == ChatMessage::File);
+        QCOMPARE(message.fileName(), QString("Image.png"));
+        QVERIFY(message.data() == fileData);
+
+        // Room can be reserved in front of the CBOR data (for the message envelope)
+        QVERIFY(file.toCbor(MessageEnvelope::HeaderSize).mid(MessageEnvelope::HeaderSize) == cbor);
+
+        // CBOR stores the content as raw bytes, JSON needs Base64
+        QVERIFY(cbor.length() < fileData.length() + 32);
+        QVERIFY(cbor.length() < file.toJson().length());
+
+        // Text messages
+        const QByteArray text = QString::fromUtf8("Hello \xC3\xA9").toUtf8();
+        message = ChatMessage::fromCbor(ChatMessage(ChatMessage::Text, "", text).toCbor());
+        QVERIFY(message.type() == ChatMessage::Text);
+        QVERIFY(message.fileName().isEmpty());
+        QVERIFY(message.data() == text);
+
+        // JSON container is still supported (round-trip & messages of older clients)
+        message = ChatMessage::fromJson(file.toJson());
+        QVERIFY(message.type() == ChatMessage::File);
+        QVERIFY(message.data() == fileData);
+
+        message = ChatMessage::fromJson("{\"MessageType\":\"Text\",\"Length\":8,"
+                                        "\"FileName\":\"\",\"Base64\":\"SGVsbG8h\"}");
+        QVERIFY(message.type() == ChatMessage::Text);
+        QVERIFY(message.data() == "Hello!");
+
+        // Invalid data is rejected
+        QVERIFY(!ChatMessage::fromCbor(QByteArray()).isValid());
+        QVERIFY(!ChatMessage::fromCbor(file.toJson()).isValid());
+        QVERIFY(!ChatMessage::fromCbor(cbor.left(cbor.length() / 2)).isValid());
+        QVERIFY(!ChatMessage::fromJson(cbor).isValid());
+        QVERIFY(!ChatMessage::fromJson("{\"MessageType\":\"Text\",\"Length\":2,"
+                                       "\"Base64\":\"SGVsbG8h\"}").isValid());
+
+        // Invalid messages are told apart from data that is not JSON (e.g. ciphertext)
+        bool isJson = false;
+        QVERIFY(!ChatMessage::fromJson("{\"MessageType\":\"Text\",\"Length\":2,"
+                                       "\"Base64\":\"SGVsbG8h\"}", &isJson).isValid());
+        QVERIFY(isJson);
+        QVERIFY(!ChatMessage::fromJson(cbor, &isJson).isValid());
+        QVERIFY(!isJson);
+    }
+
     void testCrypto()
     {
         // Define original data
@@ -1,4 +1,4 @@
-QT += testlib xml core network widgets
+QT += testlib xml core network widgets concurrent
 
 CONFIG += qt console warn_on depend_includepath testcase
 CONFIG -= app_bundle
@@ -7,13 +7,39 @@ TEMPLATE = app
 
 INCLUDEPATH += ../../program/src
 
+unix {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += libpng
+    PKGCONFIG += zlib
+}
+
+win32* {
+    LIBS += -llibpng16 -lzlib
+}
+
 SOURCES +=  \
     ../../program/src/Comms/NetworkComms.cpp \
     ../../program/src/Comms/P2P_Connection.cpp \
     ../../program/src/Comms/P2P_Manager.cpp \
     ../../program/src/Comms/TCP_Listener.cpp \
+    ../../program/src/LSB/AeadStream.cpp \
+    ../../program/src/LSB/BitPlane.cpp \
+    ../../program/src/LSB/ChaCha20Poly1305.cpp \
+    ../../program/src/LSB/ChatMessage.cpp \
+    ../../program/src/LSB/Checksum.cpp \
+    ../../program/src/LSB/CoverPool.cpp \
+    ../../program/src/LSB/CpuFeatures.cpp \
     ../../program/src/LSB/Crypto.cpp \
+    ../../program/src/LSB/DifferentialImage.cpp \
     ../../program/src/LSB/LSB.cpp \
+    ../../program/src/LSB/LsbCodec.cpp \
+    ../../program/src/LSB/MessageEnvelope.cpp \
+    ../../program/src/LSB/NoiseGenerator.cpp \
+    ../../program/src/LSB/PngRowReader.cpp \
+    ../../program/src/LSB/PngWriter.cpp \
+    ../../program/src/LSB/ScatterLayout.cpp \
+    ../../program/src/LSB/UndoLog.cpp \
+    ../../program/src/LSB/WireImage.cpp \
     TestMain.cpp
 
 HEADERS += \
@@ -21,5 +47,21 @@ HEADERS += \
     ../../program/src/Comms/P2P_Connection.h \
     ../../program/src/Comms/P2P_Manager.h \
     ../../program/src/Comms/TCP_Listener.h \
+    ../../program/src/LSB/AeadStream.h \
+    ../../program/src/LSB/BitPlane.h \
+    ../../program/src/LSB/ChaCha20Poly1305.h \
+    ../../program/src/LSB/ChatMessage.h \
+    ../../program/src/LSB/Checksum.h \
+    ../../program/src/LSB/CoverPool.h \
+    ../../program/src/LSB/CpuFeatures.h \
     ../../program/src/LSB/Crypto.h \
-    ../../program/src/LSB/LSB.h
+    ../../program/src/LSB/DifferentialImage.h \
+    ../../program/src/LSB/LSB.h \
+    ../../program/src/LSB/LsbCodec.h \
+    ../../program/src/LSB/MessageEnvelope.h \
+    ../../program/src/LSB/NoiseGenerator.h \
+    ../../program/src/LSB/PngRowReader.h \
+    ../../program/src/LSB/PngWriter.h \
+    ../../program/src/LSB/ScatterLayout.h \
+    ../../program/src/LSB/UndoLog.h \
+    ../../program/src/LSB/WireImage.h